@@ -76,6 +76,22 @@ else
 CFLAGS += -DXV6_WAIT_FOR_DEBUGGER=0
 endif
 
+# Bus-master DMA for the IDE disks, falling back to PIO when the controller
+# lacks it. Build with ide_dma=false to always use PIO.
+ifeq ($(ide_dma), false)
+CFLAGS += -DXV6_IDE_DMA=0
+else
+CFLAGS += -DXV6_IDE_DMA=1
+endif
+
+# Fill freed pages with junk to catch dangling references, and have kmemtest
+# check the fill. Build with kalloc_junk=true to debug memory corruption.
+ifeq ($(kalloc_junk), true)
+CFLAGS += -DXV6_KALLOC_JUNK=1
+else
+CFLAGS += -DXV6_KALLOC_JUNK=0
+endif
+
 OFLAGS = -O2
 CFLAGS += -DSTORAGE_DEVICE_SIZE=327680
 CFLAGS += $(shell $(CC) -fno-stack-protector -E -x c /dev/null >/dev/null 2>&1 && echo -fno-stack-protector)
@@ -0,0 +1,36 @@
+#ifndef XV6_DEV_STAT_H
+#define XV6_DEV_STAT_H
+
+#include "types.h"
+
+/* Buckets of the dev_stat histograms. Bucket 0 counts the value 0, bucket i
+   counts values in [2^(i-1), 2^i) and the last bucket everything above. */
+#define DEV_STAT_BUCKETS 8
+/* Unit of the latency histogram, in microseconds. */
+#define DEV_STAT_LATENCY_UNIT_US 100
+
+/* device statistics structure which defines what info every device
+   should supply.
+*/
+struct dev_stat {
+  /* number of read IO operation made on the device */
+  uint rios;
+  /* number of write IO operation made on the device */
+  uint wios;
+  /* Total bytes read from device */
+  uint rbytes;
+  /* Total bytes written to device */
+  uint wbytes;
+  /* Requests already pending when a request was queued, optional */
+  uint queue_depth[DEV_STAT_BUCKETS];
+  /* Time from queueing a request to its completion in
+     DEV_STAT_LATENCY_UNIT_US units, optional */
+  uint latency[DEV_STAT_BUCKETS];
+  /* CPU time the driver spent starting and completing requests, in
+     microseconds, optional */
+  uint cpu_us;
+  /* Nonzero when the device moves data by DMA */
+  uint dma;
+};
+
+#endif /* XV6_DEV_STAT_H */
@@ -10,20 +10,25 @@
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                          free bit map | data blocks | object store ]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
 struct native_superblock {
   uint size;        // Size of file system image (blocks)
   uint nblocks;     // Number of data blocks
-  uint nlog;        // Number of log blocks
+  uint nlog;        // Number of log blocks, the header included
   uint logstart;    // Block number of first log block
   uint inodestart;  // Block number of first inode block
   uint bmapstart;   // Block number of first free map block
   uint ninodes;     // Number of inodes.
+  uint objstart;    // Block number of the object store, past the file system
+  uint nobjblocks;  // Number of object store blocks, 0 if there is none
 };
 
+// Data blocks a log header block can describe.
+#define MAXLOGBLOCKS (BSIZE / sizeof(uint) - 1)
+
 #define NDIRECT 12
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT)
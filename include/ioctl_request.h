@@ -5,6 +5,20 @@ typedef enum ioctl_request {
   IOCTL_CPU_START = 1000,
   IOCTL_GET_PROCESS_CPU_TIME,
   IOCTL_GET_PROCESS_CPU_PERCENT,
+
+  IOCTL_DEV_START = 2000,
+  // Copy the struct dev_stat of a device file to the third argument.
+  IOCTL_GET_DEV_STAT,
+  // Make the device move data by DMA if the third argument is nonzero, else
+  // by PIO. Fails if the device has no DMA.
+  IOCTL_SET_DEV_DMA,
+
+  IOCTL_PIPE_START = 3000,
+  // Return the size in bytes of the buffer of a pipe.
+  IOCTL_GET_PIPE_SIZE,
+  // Resize the buffer of a pipe to hold at least the third argument bytes,
+  // up to 64KB. Returns the new size, or -1 if the pipe holds more data.
+  IOCTL_SET_PIPE_SIZE,
 } ioctl_request;
 
 #endif /* XV6_IOCTL_REQUEST */
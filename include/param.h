@@ -7,16 +7,23 @@
 #define NCPU 8                     // maximum number of CPUs
 #define NOFILE 16                  // open files per process
 #define NFILE 200                  // open files per system
-#define NINODE 120                 // maximum number of active i-nodes
+#define NINODE 120                 // i-nodes cached before reusing unused ones
 #define NDEV 10                    // maximum major device number
 #define MAX_TTY 4                  // maximum minor tty number
 #define ROOTDEV 1                  // device number of file system root disk
 #define MAXARG 32                  // max exec arguments
 #define MAXOPBLOCKS 10             // max # of blocks any FS op writes
-#define LOGSIZE (MAXOPBLOCKS * 3)  // max data blocks in on-disk log
+#define LOGSIZE (MAXOPBLOCKS * 6)  // default blocks in on-disk log
+#define INT_LOGSIZE (MAXOPBLOCKS * 3)  // blocks in internal fs log
 #define NBUF 200                   // size of system disks block cache
+#define BIO_BATCH_MAX 16           // max bufs of one batched disk request
+// max data blocks in on-disk log. They stay pinned in the block cache
+// until installed, so they get half of it, less a batch of log blocks,
+// a batch of home blocks and the block kreadahead reads into.
+#define MAXLOGSIZE (NBUF / 2 - 2 * BIO_BATCH_MAX - 1)
 #define FSSIZE 3600                // size of file system in blocks
 #define INT_FSSIZE 160             // size of internal file systems in blocks
+#define OBJSIZE 4096               // size of the root disk object store in blocks
 #define NNAMESPACE 20              // maximum number of namespaces
 #define MAX_PATH_LENGTH 512        // maximum path length allowed
 #define MAX_CGROUP_FILE_NAME_LENGTH \
@@ -32,5 +32,7 @@
 #define SYS_getcpu 28
 #define SYS_kmemtest 29
 #define SYS_pivot_root 30
+#define SYS_fsync 31
+#define SYS_copyfd 32
 
 #endif /* XV6_SYSCALL_H */
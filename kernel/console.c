@@ -251,8 +251,9 @@ int ttystat(int minor, struct dev_stat *device_stats) {
 int consoleread(struct vfs_inode *ip, int n, vector *dstvector) {
   uint target;
   int c;
-  int dstindx = 0;
+  vector_cursor dst;
   ip->i_op->iunlock(ip);
+  initvectorcursor(*dstvector, 0, &dst);
   target = n;
   acquire(&cons.lock);
   while (n > 0) {
@@ -273,8 +274,7 @@ int consoleread(struct vfs_inode *ip, int n, vector *dstvector) {
       }
       break;
     }
-    memmove_into_vector_bytes(*dstvector, dstindx++, (char *)&c, 1);
-    // test for vector \ buffer similarity using silent version of vectormemcmp
+    cursorwrite(&dst, (char *)&c, 1);
     --n;
 
     /* increment number of bytes read on the specific tty */
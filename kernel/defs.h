@@ -26,6 +26,8 @@ struct vfs_inode;
 // struct vfs_superblock;
 struct device;
 typedef struct kvec vector;
+typedef struct kvec_cursor vector_cursor;
+struct kvec_stats;
 struct devsw;
 struct dev_stat;
 struct cgroup_io_device_statistics_s;
@@ -59,6 +61,7 @@ struct vfs_file* vfs_filedup(struct vfs_file*);
 int vfs_fileread(struct vfs_file*, int n, vector* dstvector);
 int vfs_filestat(struct vfs_file*, struct stat*);
 int vfs_filewrite(struct vfs_file*, char*, int n);
+int vfs_filecopy(struct vfs_file* in, struct vfs_file* out, int n);
 
 // vfs_fs.c
 struct vfs_inode* vfs_namei(char*);
@@ -112,6 +115,7 @@ uint get_total_memory();
 
 // kvector.c
 vector newvector(unsigned int, unsigned int);
+vector buffervector(char*, unsigned int, unsigned int);
 void freevector(vector*);
 uint setelement(vector, unsigned int, char*);
 char* getelementpointer(const vector, unsigned int);
@@ -123,6 +127,10 @@ vector slicevector(vector, unsigned int, unsigned int);
 uint vectormemcmp(const vector v, void* m, uint bytes);
 uint copysubvector(vector* dstvector, vector* srcvector, unsigned int srcoffset,
                    unsigned int count);
+void initvectorcursor(vector, unsigned int byteoffset, vector_cursor*);
+unsigned int cursorwrite(vector_cursor*, const char* src, unsigned int size);
+unsigned int cursorread(vector_cursor*, char* dst, unsigned int size);
+void getvectorstats(struct kvec_stats*);
 
 // kbd.c
 void kbdintr(void);
@@ -141,6 +149,9 @@ void initlog(struct vfs_superblock*);
 void log_write(struct buf*);
 void begin_op();
 void end_op();
+void begin_op_blocks(int);
+void end_op_blocks(int);
+int log_op_blocks(void);
 
 // mount_ns.c
 void mount_nsinit(void);
@@ -161,6 +172,11 @@ struct nsproxy* namespacedup(struct nsproxy*);
 void namespaceput(struct nsproxy*);
 int unshare(int nstype);
 
+// pci.c
+uint pciconfread(uint, uint);
+void pciconfwrite(uint, uint, uint);
+int pcifind(uint, uint, uint*);
+
 // picirq.c
 void picenable(int);
 void picinit(void);
@@ -170,6 +186,8 @@ int pipealloc(struct vfs_file**, struct vfs_file**);
 void pipeclose(struct pipe*, int);
 int piperead(struct pipe*, int, vector* outputvector);
 int pipewrite(struct pipe*, char*, int);
+int pipesize(struct pipe*);
+int pipesetsize(struct pipe*, int);
 
 // PAGEBREAK: 16
 //  proc.c
@@ -180,6 +198,7 @@ int growproc(int);
 #ifndef HOST_TESTS
 int kill(int);
 #endif
+struct proc* kthread_create(char*, void (*)(void));
 struct cpu* mycpu(void);
 struct proc* myproc();
 void pinit(void);
@@ -17,6 +17,11 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+// * B_READAHEAD: the buffer was read by breadahead()
+//     and nobody has read it through bread() yet.
+//
+// breadahead() queues blocks to be read into the cache by the
+// kreadahead kernel thread, so that the caller does not wait for them.
 #include "bio.h"
 
 #include "buf.h"
@@ -29,15 +34,29 @@
 #include "kvector.h"
 #include "proc.h"
 
+#define READAHEAD_QUEUE 32  // max pending readahead requests
+
+static struct {
+  struct spinlock lock;
+  struct {
+    struct device *dev;
+    uint blockno;
+  } queue[READAHEAD_QUEUE];
+  uint head;  // next request to read
+  uint tail;  // next free slot
+  int started;
+  uint issued;
+  uint hits;
+  uint dropped;
+} readahead;
+
+void binit(void) { initlock(&readahead.lock, "readahead"); }
+
 static void devicerw(struct vfs_inode *const vfs_inode, struct buf *const b) {
   if ((b->flags & B_DIRTY) == 0) {
-    vector read_result_vector;
-    read_result_vector = newvector(BSIZE, 1);
+    vector read_result_vector = buffervector((char *)b->data, BSIZE, 1);
     vfs_inode->i_op->readi(vfs_inode, BSIZE * b->id.blockno, BSIZE,
                            &read_result_vector);
-    memmove_from_vector((char *)b->data, read_result_vector, 0, BSIZE);
-    // vectormemcmp("devicerw", read_result_vector, 0, (char *) b->data, BSIZE);
-    freevector(&read_result_vector);
   } else {
     vfs_inode->i_op->writei(vfs_inode, (char *)b->data, BSIZE * b->id.blockno,
                             BSIZE);
@@ -56,6 +75,30 @@ static void brw(struct buf *const b) {
   }
 }
 
+// Sync bufs of a single device with disk, skipping valid clean bufs.
+// IDE bufs are queued together so consecutive blocks share commands.
+static void brw_batch(struct buf *const *const bufs, const uint n) {
+  uint i;
+
+  if (n > BIO_BATCH_MAX) panic("brw_batch: too many bufs");
+  if (n == 0) return;
+  if (getinodefordevice(bufs[0]->dev) != 0) {
+    for (i = 0; i < n; i++) {
+      if ((bufs[i]->flags & (B_VALID | B_DIRTY)) != B_VALID) brw(bufs[i]);
+    }
+  } else {
+    iderw_batch(bufs, n);
+  }
+}
+
+// Return a locked buf for the indicated block without reading it, for
+// callers that overwrite the whole block or use bread_batch.
+struct buf *bget(const struct device *const dev, const uint blockno) {
+  union buf_id id = {.blockno = blockno};
+
+  return buf_cache_get(dev, &id, 0);
+}
+
 // Return a locked buf with the contents of the indicated block.
 struct buf *bread(const struct device *const dev, const uint blockno) {
   struct buf *b;
@@ -65,9 +108,91 @@ struct buf *bread(const struct device *const dev, const uint blockno) {
   if ((b->flags & B_VALID) == 0) {
     brw(b);
   }
+  if (b->flags & B_READAHEAD) {
+    b->flags &= ~B_READAHEAD;
+    __sync_add_and_fetch(&readahead.hits, 1);
+  }
   return b;
 }
 
+static void readahead_thread(void) {
+  struct device *dev;
+  union buf_id id = {0};
+  struct buf *b;
+
+  acquire(&readahead.lock);
+  for (;;) {
+    while (readahead.head == readahead.tail) {
+      sleep(&readahead, &readahead.lock);
+    }
+    dev = readahead.queue[readahead.head % READAHEAD_QUEUE].dev;
+    id.blockno = readahead.queue[readahead.head % READAHEAD_QUEUE].blockno;
+    readahead.head++;
+    release(&readahead.lock);
+
+    b = buf_cache_get(dev, &id, 0);
+    if ((b->flags & B_VALID) == 0) {
+      brw(b);
+      b->flags |= B_READAHEAD;
+      __sync_add_and_fetch(&readahead.issued, 1);
+    }
+    buf_cache_release(b);
+
+    if (dev->type == DEVICE_TYPE_LOOP) {
+      // Dropping the last reference to a loop device puts its backing inode.
+      begin_op();
+      deviceput(dev);
+      end_op();
+    } else {
+      deviceput(dev);
+    }
+
+    acquire(&readahead.lock);
+  }
+}
+
+// Read blockno into the cache in the background.
+// The request is dropped if too many are pending.
+void breadahead(struct device *const dev, const uint blockno) {
+  int start = 0;
+
+  acquire(&readahead.lock);
+  if (readahead.tail - readahead.head == READAHEAD_QUEUE) {
+    readahead.dropped++;
+    release(&readahead.lock);
+    return;
+  }
+  deviceget(dev);
+  readahead.queue[readahead.tail % READAHEAD_QUEUE].dev = dev;
+  readahead.queue[readahead.tail % READAHEAD_QUEUE].blockno = blockno;
+  readahead.tail++;
+  if (!readahead.started) {
+    readahead.started = start = 1;
+  }
+  wakeup(&readahead);
+  release(&readahead.lock);
+
+  if (start && kthread_create("kreadahead", readahead_thread) == 0)
+    panic("breadahead: no kreadahead");
+}
+
+void breadahead_get_stats(struct readahead_stats *const stats) {
+  struct buf_cache_stats cache_stats;
+
+  buf_cache_get_stats(&cache_stats);
+  acquire(&readahead.lock);
+  stats->issued = readahead.issued;
+  stats->hits = readahead.hits;
+  stats->dropped = readahead.dropped;
+  release(&readahead.lock);
+  stats->waste = cache_stats.readahead_waste;
+}
+
+// Read the contents of locked bufs of a single device, as from bget.
+void bread_batch(struct buf *const *const bufs, const uint n) {
+  brw_batch(bufs, n);
+}
+
 // Write b's contents to disk.  Must be locked.
 void bwrite(struct buf *const b) {
   if (!holdingsleep(&b->lock)) panic("bwrite");
@@ -75,5 +200,16 @@ void bwrite(struct buf *const b) {
   brw(b);
 }
 
+// Write the contents of locked bufs of a single device to disk.
+void bwrite_batch(struct buf *const *const bufs, const uint n) {
+  uint i;
+
+  for (i = 0; i < n; i++) {
+    if (!holdingsleep(&bufs[i]->lock)) panic("bwrite_batch");
+    bufs[i]->flags |= B_DIRTY;
+  }
+  brw_batch(bufs, n);
+}
+
 // PAGEBREAK!
 //  Blank page.
@@ -4,7 +4,20 @@
 #include "buf.h"
 #include "device.h"
 
+struct readahead_stats {
+  uint issued;   // blocks read into the cache ahead of their use
+  uint hits;     // prefetched blocks that were then read
+  uint waste;    // prefetched blocks evicted before being read
+  uint dropped;  // requests dropped because the queue was full
+};
+
+void binit(void);
+struct buf* bget(const struct device* const, uint);
 struct buf* bread(const struct device* const, uint);
+void bread_batch(struct buf* const*, uint);
+void breadahead(struct device*, uint);
 void bwrite(struct buf*);
+void bwrite_batch(struct buf* const*, uint);
+void breadahead_get_stats(struct readahead_stats*);
 
 #endif  // XV6_DEVICE_BIO_H
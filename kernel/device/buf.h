@@ -31,7 +31,13 @@ struct buf {
   uint refcnt;
   struct buf *prev;  // LRU cache list
   struct buf *next;
+  struct buf *hnext;  // hash bucket chain
+  struct buf **hprev;
+  uint shard;    // buffer cache shard owning the buffer
+  uint lru_seq;  // last use order, for eviction across shards
+  uint list;     // buffer cache list holding the buffer
   struct buf *qnext;  // disk queue
+  uint qtime;         // when queued on the disk, in microseconds
   struct cgroup *cgroup;
   uchar data[BUF_DATA_SIZE];
 };
@@ -39,9 +45,12 @@ struct buf {
 enum B_FLAGS_SHIFT {
   B_VALID_SHIFT = 1,
   B_DIRTY_SHIFT = 2,
+  B_READAHEAD_SHIFT = 3,
 };
 
 #define B_VALID (1 << B_VALID_SHIFT)  // buffer has been read from disk
 #define B_DIRTY (1 << B_DIRTY_SHIFT)  // buffer needs to be written to disk
+#define B_READAHEAD \
+  (1 << B_READAHEAD_SHIFT)  // buffer was prefetched and not read yet
 
 #endif /* XV6_DEVICE_BUF_H */
@@ -4,50 +4,417 @@
 #include "cgroup.h"
 #include "param.h"
 
-struct {
+// The cache is split into independently locked shards, so CPUs working on
+// different blocks don't serialize on a single lock. A block always lives in
+// the shard selected by the hash of its (device, id).
+#define BUF_CACHE_SHARDS NCPU
+
+// Number of hash buckets in each shard.
+// A prime number in the order of NBUF / BUF_CACHE_SHARDS keeps chains short.
+#define BUF_CACHE_HASH_BUCKETS 31
+
+// Number of recently evicted blocks remembered by each list of a shard.
+#define BUF_CACHE_GHOSTS (NBUF / BUF_CACHE_SHARDS)
+
+struct buf_cache_shard {
   struct spinlock lock;
+
+  // Lists of the shard's buffers that hold a block, through prev/next.
+  // lists[i].next is most recently used.
+  // Blocks enter the recent list. With the ARC policy, a block that is used
+  // again moves to the frequent list, so a long scan of blocks that are used
+  // only once can't push out the working set. The LRU policy uses only the
+  // recent list.
+  struct buf lists[BUF_CACHE_LISTS];
+  uint nlisted[BUF_CACHE_LISTS];
+
+  // Linked list of the shard's buffers that hold no block, through prev/next.
+  struct buf free;
+  uint nfree;
+
+  // Buffers of lists, indexed by (device, id), through hnext/hprev.
+  struct buf *hash[BUF_CACHE_HASH_BUCKETS];
+
+  // Hashes of the blocks most recently evicted from each list (the ARC
+  // "ghost" lists). A miss on such a block tells which list was too short.
+  uint ghosts[BUF_CACHE_LISTS][BUF_CACHE_GHOSTS];
+  uint nghosts[BUF_CACHE_LISTS];
+  uint ghosts_next[BUF_CACHE_LISTS];
+
+  uint hits[BUF_CACHE_LISTS];
+  uint ghost_hits[BUF_CACHE_LISTS];
+  uint misses;
+  uint readahead_waste;
+};
+
+struct {
   struct buf buf[NBUF];
+  struct buf_cache_shard shards[BUF_CACHE_SHARDS];
+
+  // Incremented whenever a buffer becomes the most recently used one of its
+  // list. Orders the buffers of all shards by their last use.
+  uint lru_clock;
+
+  enum buf_cache_policy policy;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  // ARC: the number of buffers the recent lists should hold, adapted upon
+  // misses on recently evicted blocks.
+  uint recent_target;
 
   // Whether buffers are cached upon release, or invalidated immediately.
   // Used mostly for performance measurements.
   uint is_cache_enabled;
 } bufs_cache;
 
+// FNV-1a over the device pointer and the whole buffer id.
+static uint buf_cache_hash(const struct device *const dev,
+                           const union buf_id *const id) {
+  const uchar *p = (const uchar *)&dev;
+  uint hash = 2166136261U;
+
+  for (uint i = 0; i < sizeof(dev); i++) {
+    hash = (hash ^ p[i]) * 16777619U;
+  }
+  p = (const uchar *)id;
+  for (uint i = 0; i < sizeof(*id); i++) {
+    hash = (hash ^ p[i]) * 16777619U;
+  }
+
+  return hash;
+}
+
+static struct buf **buf_cache_bucket(struct buf_cache_shard *const shard,
+                                     const uint hash) {
+  return &shard->hash[(hash / BUF_CACHE_SHARDS) % BUF_CACHE_HASH_BUCKETS];
+}
+
+static void list_remove(struct buf *const b) {
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+static void list_insert_first(struct buf *const head, struct buf *const b) {
+  b->next = head->next;
+  b->prev = head;
+  head->next->prev = b;
+  head->next = b;
+}
+
+static void list_insert_last(struct buf *const head, struct buf *const b) {
+  b->prev = head->prev;
+  b->next = head;
+  head->prev->next = b;
+  head->prev = b;
+}
+
+static void buf_cache_hash_insert(struct buf **const bucket,
+                                  struct buf *const b) {
+  b->hnext = *bucket;
+  b->hprev = bucket;
+  if (*bucket) {
+    (*bucket)->hprev = &b->hnext;
+  }
+  *bucket = b;
+}
+
+static void buf_cache_hash_remove(struct buf *const b) {
+  if (b->hprev == 0) {
+    return;
+  }
+  *b->hprev = b->hnext;
+  if (b->hnext) {
+    b->hnext->hprev = b->hprev;
+  }
+  b->hnext = 0;
+  b->hprev = 0;
+}
+
+static struct buf *buf_cache_hash_lookup(struct buf **const bucket,
+                                         const struct device *const dev,
+                                         const union buf_id *const id) {
+  struct buf *b;
+
+  for (b = *bucket; b != 0; b = b->hnext) {
+    if (b->dev == dev && (0 == memcmp(&(b->id), id, sizeof(*id)))) {
+      return b;
+    }
+  }
+
+  return 0;
+}
+
+// Caller must hold the shard's lock.
+static void buf_cache_list_insert(struct buf_cache_shard *const shard,
+                                  struct buf *const b, const uint list,
+                                  const uint insert_first) {
+  b->list = list;
+  shard->nlisted[list]++;
+  if (insert_first) {
+    b->lru_seq = __sync_add_and_fetch(&bufs_cache.lru_clock, 1);
+    list_insert_first(&shard->lists[list], b);
+  } else {
+    b->lru_seq = 0;
+    list_insert_last(&shard->lists[list], b);
+  }
+}
+
+// Caller must hold the shard's lock.
+static void buf_cache_list_remove(struct buf_cache_shard *const shard,
+                                  struct buf *const b) {
+  shard->nlisted[b->list]--;
+  list_remove(b);
+}
+
+// Move a buffer that holds no block to the free list of its shard.
+// Caller must hold the shard's lock.
+static void buf_cache_make_free(struct buf_cache_shard *const shard,
+                                struct buf *const b) {
+  buf_cache_hash_remove(b);
+  b->dev = 0;
+  b->flags = 0;
+  list_insert_first(&shard->free, b);
+  shard->nfree++;
+}
+
+static void buf_cache_ghost_add(struct buf_cache_shard *const shard,
+                                const uint list, const uint hash) {
+  shard->ghosts[list][shard->ghosts_next[list]] = hash;
+  shard->ghosts_next[list] = (shard->ghosts_next[list] + 1) % BUF_CACHE_GHOSTS;
+  if (shard->nghosts[list] < BUF_CACHE_GHOSTS) {
+    shard->nghosts[list]++;
+  }
+}
+
+// Returns the list the block was recently evicted from, or BUF_CACHE_LISTS.
+// Only hashes are remembered, so a rare false match merely skews the
+// adaptation a little.
+static uint buf_cache_ghost_take(struct buf_cache_shard *const shard,
+                                 const uint hash) {
+  for (uint list = 0; list < BUF_CACHE_LISTS; list++) {
+    for (uint i = 0; i < shard->nghosts[list]; i++) {
+      if (shard->ghosts[list][i] == hash) {
+        // Forget it, so it is counted only once.
+        shard->ghosts[list][i] = ~hash;
+        return list;
+      }
+    }
+  }
+
+  return BUF_CACHE_LISTS;
+}
+
+// ARC: grow the recent lists upon a miss on a block recently evicted from
+// them, and shrink them upon a miss on one evicted from the frequent lists.
+static void buf_cache_adapt_recent_target(
+    const struct buf_cache_shard *const shard, const uint ghost_list) {
+  const uint other_list = (ghost_list == BUF_CACHE_RECENT) ? BUF_CACHE_FREQUENT
+                                                           : BUF_CACHE_RECENT;
+  uint delta = 1;
+  uint old_target, new_target;
+
+  if (shard->nghosts[ghost_list] != 0 &&
+      shard->nghosts[other_list] > shard->nghosts[ghost_list]) {
+    delta = shard->nghosts[other_list] / shard->nghosts[ghost_list];
+  }
+
+  do {
+    old_target = bufs_cache.recent_target;
+    if (ghost_list == BUF_CACHE_RECENT) {
+      new_target = min(old_target + delta, NBUF);
+    } else {
+      new_target = (old_target > delta) ? old_target - delta : 0;
+    }
+  } while (!__sync_bool_compare_and_swap(&bufs_cache.recent_target,
+                                         old_target, new_target));
+}
+
+// Detach an unused buffer from the free list of the given shard.
+// Caller must hold the shard's lock.
+static struct buf *buf_cache_take_free(struct buf_cache_shard *const shard) {
+  struct buf *b;
+
+  if (shard->nfree == 0) {
+    return 0;
+  }
+  b = shard->free.next;
+  list_remove(b);
+  shard->nfree--;
+  return b;
+}
+
+// Evict the least recently used unused block of the given list of the shard.
+// Even if refcnt==0, B_DIRTY indicates a buffer is in use
+// because log.c has modified it but not yet committed it.
+// Caller must hold the shard's lock.
+static struct buf *buf_cache_take_victim(struct buf_cache_shard *const shard,
+                                         const uint list) {
+  struct buf *b;
+
+  for (b = shard->lists[list].prev; b != &shard->lists[list]; b = b->prev) {
+    if (b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+      buf_cache_list_remove(shard, b);
+      buf_cache_hash_remove(b);
+      if ((b->flags & B_VALID) && b->dev->ops && b->dev->ops->block_evicted) {
+        b->dev->ops->block_evicted(b->dev);
+      }
+      if (bufs_cache.policy == BUF_CACHE_POLICY_ARC) {
+        buf_cache_ghost_add(shard, list, buf_cache_hash(b->dev, &b->id));
+      }
+      return b;
+    }
+  }
+
+  return 0;
+}
+
+// The use order of the least recently used block of the shard's list.
+// Unlocked read, only a hint where the best victim is.
+static uint buf_cache_shard_oldest(const struct buf_cache_shard *const shard,
+                                   const uint list) {
+  const struct buf *tail = shard->lists[list].prev;
+
+  return tail == &shard->lists[list] ? ~0U : tail->lru_seq;
+}
+
+// Unlocked sum, only a hint for choosing which list to evict from.
+static uint buf_cache_listed(const uint list) {
+  uint listed = 0;
+
+  for (uint i = 0; i < BUF_CACHE_SHARDS; i++) {
+    listed += bufs_cache.shards[i].nlisted[list];
+  }
+
+  return listed;
+}
+
+// Evict the least recently used block of the given list of all shards.
+static struct buf *buf_cache_evict_oldest(const uint list) {
+  struct buf_cache_shard *shard;
+  struct buf *b = 0;
+  uint tried = 0;
+
+  while (b == 0 && tried != (1U << BUF_CACHE_SHARDS) - 1) {
+    uint oldest_index = BUF_CACHE_SHARDS;
+    uint oldest_seq = 0;
+    for (uint i = 0; i < BUF_CACHE_SHARDS; i++) {
+      if (tried & (1U << i)) continue;
+      uint seq = buf_cache_shard_oldest(&bufs_cache.shards[i], list);
+      if (oldest_index == BUF_CACHE_SHARDS || seq < oldest_seq) {
+        oldest_index = i;
+        oldest_seq = seq;
+      }
+    }
+    tried |= 1U << oldest_index;
+
+    shard = &bufs_cache.shards[oldest_index];
+    acquire(&shard->lock);
+    b = buf_cache_take_victim(shard, list);
+    release(&shard->lock);
+  }
+
+  return b;
+}
+
+// Find an unused buffer in any shard, without holding more than one shard
+// lock at a time. Buffers that hold no block are preferred, and otherwise
+// the least recently used block of all shards is evicted, so the shards
+// together still behave like a single cache.
+static struct buf *buf_cache_steal_victim(const uint shard_index) {
+  struct buf_cache_shard *shard;
+  struct buf *b = 0;
+  uint list = BUF_CACHE_RECENT;
+
+  for (uint i = 0; b == 0 && i < BUF_CACHE_SHARDS; i++) {
+    shard = &bufs_cache.shards[(shard_index + i) % BUF_CACHE_SHARDS];
+    if (shard->nfree == 0) continue;
+    acquire(&shard->lock);
+    b = buf_cache_take_free(shard);
+    release(&shard->lock);
+  }
+  if (b != 0) {
+    return b;
+  }
+
+  if (bufs_cache.policy == BUF_CACHE_POLICY_ARC &&
+      buf_cache_listed(BUF_CACHE_RECENT) <= bufs_cache.recent_target &&
+      buf_cache_listed(BUF_CACHE_FREQUENT) != 0) {
+    list = BUF_CACHE_FREQUENT;
+  }
+
+  if ((b = buf_cache_evict_oldest(list)) == 0) {
+    b = buf_cache_evict_oldest(list == BUF_CACHE_RECENT ? BUF_CACHE_FREQUENT
+                                                        : BUF_CACHE_RECENT);
+  }
+
+  return b;
+}
+
 void buf_cache_init(void) {
   struct buf *b;
+  struct buf_cache_shard *shard;
 
-  initlock(&bufs_cache.lock, "bufs_cache");
+  for (shard = bufs_cache.shards;
+       shard < bufs_cache.shards + BUF_CACHE_SHARDS; shard++) {
+    initlock(&shard->lock, "bufs_cache");
+    for (uint list = 0; list < BUF_CACHE_LISTS; list++) {
+      shard->lists[list].prev = &shard->lists[list];
+      shard->lists[list].next = &shard->lists[list];
+      shard->nlisted[list] = 0;
+      shard->nghosts[list] = 0;
+      shard->ghosts_next[list] = 0;
+      shard->hits[list] = 0;
+      shard->ghost_hits[list] = 0;
+    }
+    shard->free.prev = &shard->free;
+    shard->free.next = &shard->free;
+    shard->nfree = 0;
+    shard->misses = 0;
+    shard->readahead_waste = 0;
+    memset(shard->hash, 0, sizeof(shard->hash));
+  }
 
   // PAGEBREAK!
-  //  Create linked list of buffers
-  bufs_cache.head.prev = &bufs_cache.head;
-  bufs_cache.head.next = &bufs_cache.head;
+  //  Spread the buffers over the free lists of the shards
   for (b = bufs_cache.buf; b < bufs_cache.buf + NBUF; b++) {
-    b->flags = 0;
     b->refcnt = 0;
-    b->next = bufs_cache.head.next;
-    b->prev = &bufs_cache.head;
+    b->hnext = 0;
+    b->hprev = 0;
+    b->shard = (b - bufs_cache.buf) % BUF_CACHE_SHARDS;
     initsleeplock(&b->lock, "buffer");
-    bufs_cache.head.next->prev = b;
-    bufs_cache.head.next = b;
+    buf_cache_make_free(&bufs_cache.shards[b->shard], b);
   }
 
+  bufs_cache.lru_clock = 0;
+  bufs_cache.policy = BUF_CACHE_POLICY_LRU;
+  bufs_cache.recent_target = NBUF / 2;
+
   bufs_cache.is_cache_enabled = 1;
 }
 
 void buf_cache_invalidate_blocks(const struct device *const dev) {
-  acquire(&bufs_cache.lock);
-  struct buf *b;
-  for (b = bufs_cache.head.next; b != &bufs_cache.head; b = b->next) {
-    if (b->dev == dev) {
-      b->flags &= ~(B_VALID | B_DIRTY);
+  struct buf_cache_shard *shard;
+  struct buf *b, *next;
+
+  for (shard = bufs_cache.shards;
+       shard < bufs_cache.shards + BUF_CACHE_SHARDS; shard++) {
+    acquire(&shard->lock);
+    for (uint list = 0; list < BUF_CACHE_LISTS; list++) {
+      for (b = shard->lists[list].next; b != &shard->lists[list]; b = next) {
+        next = b->next;
+        if (b->dev != dev) {
+          continue;
+        }
+        b->flags &= ~(B_VALID | B_DIRTY);
+        // Nobody references the block anymore, so the buffer can be reused
+        // right away.
+        if (b->refcnt == 0) {
+          buf_cache_list_remove(shard, b);
+          buf_cache_make_free(shard, b);
+        }
+      }
     }
+    release(&shard->lock);
   }
-  release(&bufs_cache.lock);
 }
 
 // Look through buffer cache for block on device dev.
@@ -55,50 +422,96 @@ void buf_cache_invalidate_blocks(const struct device *const dev) {
 // In either case, return locked buffer.
 struct buf *buf_cache_get(const struct device *const dev,
                           const union buf_id *id, const uint alloc_flags) {
-  struct buf *b;
+  struct buf *b, *victim = 0;
   struct cgroup *cg = proc_get_cgroup();
+  const uint hash = buf_cache_hash(dev, id);
+  const uint shard_index = hash % BUF_CACHE_SHARDS;
+  struct buf_cache_shard *const shard = &bufs_cache.shards[shard_index];
+  struct buf **const bucket = buf_cache_bucket(shard, hash);
+  uint list = BUF_CACHE_RECENT;
 
-  acquire(&bufs_cache.lock);
+  acquire(&shard->lock);
 
   // Is the block already cached?
-  for (b = bufs_cache.head.next; b != &bufs_cache.head; b = b->next) {
-    if (b->dev == dev && (0 == memcmp(&(b->id), id, sizeof(*id)))) {
+  if ((b = buf_cache_hash_lookup(bucket, dev, id)) != 0) {
+    shard->hits[b->list]++;
+    // The first read of a prefetched block is not a reuse.
+    if (bufs_cache.policy == BUF_CACHE_POLICY_ARC &&
+        b->list == BUF_CACHE_RECENT && !(b->flags & B_READAHEAD)) {
+      // Used at least twice, promote it to the frequent list.
+      buf_cache_list_remove(shard, b);
+      buf_cache_list_insert(shard, b, BUF_CACHE_FREQUENT, 1);
+    }
+    b->refcnt++;
+    release(&shard->lock);
+    acquiresleep(&b->lock);
+    cgroup_mem_stat_pgfault_incr(cg);
+    return b;
+  }
+
+  // Not cached; recycle an unused buffer.
+  if ((victim = buf_cache_take_free(shard)) == 0) {
+    release(&shard->lock);
+    victim = buf_cache_steal_victim(shard_index);
+    if (victim == 0) {
+      panic("buf_cache_get: no buffers");
+    }
+    acquire(&shard->lock);
+
+    // The block might have been cached while the lock was released.
+    if ((b = buf_cache_hash_lookup(bucket, dev, id)) != 0) {
+      victim->shard = shard_index;
+      buf_cache_make_free(shard, victim);
+      shard->hits[b->list]++;
       b->refcnt++;
-      release(&bufs_cache.lock);
+      release(&shard->lock);
       acquiresleep(&b->lock);
       cgroup_mem_stat_pgfault_incr(cg);
       return b;
     }
   }
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for (b = bufs_cache.head.prev; b != &bufs_cache.head; b = b->prev) {
-    if (b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->id = *id;
-      b->flags = 0;
-      b->alloc_flags = alloc_flags;
-      b->cgroup = 0;
-      b->refcnt = 1;
-      release(&bufs_cache.lock);
-      acquiresleep(&b->lock);
-      cgroup_mem_stat_pgmajfault_incr(cg);
-      return b;
+  shard->misses++;
+  if (bufs_cache.policy == BUF_CACHE_POLICY_ARC) {
+    uint ghost_list = buf_cache_ghost_take(shard, hash);
+    if (ghost_list != BUF_CACHE_LISTS) {
+      // It was evicted too early, so it is used again: it is frequent.
+      shard->ghost_hits[ghost_list]++;
+      buf_cache_adapt_recent_target(shard, ghost_list);
+      list = BUF_CACHE_FREQUENT;
     }
   }
-  panic("buf_cache_get: no buffers");
+
+  if (victim->flags & B_READAHEAD) {
+    shard->readahead_waste++;
+  }
+
+  b = victim;
+  b->shard = shard_index;
+  b->dev = dev;
+  b->id = *id;
+  b->flags = 0;
+  b->alloc_flags = alloc_flags;
+  b->cgroup = 0;
+  b->refcnt = 1;
+  buf_cache_list_insert(shard, b, list, 1);
+  buf_cache_hash_insert(bucket, b);
+  release(&shard->lock);
+  acquiresleep(&b->lock);
+  cgroup_mem_stat_pgmajfault_incr(cg);
+  return b;
 }
 
 // Release a locked buffer.
 void buf_cache_release(struct buf *const b) {
   uint insert_first = 0;
+  // A referenced buffer never moves between shards.
+  struct buf_cache_shard *const shard = &bufs_cache.shards[b->shard];
   if (!holdingsleep(&b->lock)) panic("buf_cache_release");
 
   releasesleep(&b->lock);
 
-  acquire(&bufs_cache.lock);
+  acquire(&shard->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
@@ -118,58 +531,94 @@ void buf_cache_release(struct buf *const b) {
       }
     }
 
-    // Remove the buf from the list and re-insert it according to its type
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    if (insert_first) {
-      // Move to the head of the MRU list.
-      b->next = bufs_cache.head.next;
-      b->prev = &bufs_cache.head;
-      bufs_cache.head.next->prev = b;
-      bufs_cache.head.next = b;
-    } else {
-      // Move to the tail of the MRU list.
-      b->prev = bufs_cache.head.prev;
-      b->next = &bufs_cache.head;
-      bufs_cache.head.prev->next = b;
-      bufs_cache.head.prev = b;
-    }
+    // Remove the buf from its list and re-insert it according to its type:
+    // to the head of the MRU list, or to its tail.
+    buf_cache_list_remove(shard, b);
+    buf_cache_list_insert(shard, b, b->list, insert_first);
   }
 
-  release(&bufs_cache.lock);
+  release(&shard->lock);
 }
 
-uint buf_cache_is_cache_enabled(void) {
-  uint is_cache_enabled = 0;
+uint buf_cache_is_cache_enabled(void) { return bufs_cache.is_cache_enabled; }
 
-  acquire(&bufs_cache.lock);
-  is_cache_enabled = bufs_cache.is_cache_enabled;
-  release(&bufs_cache.lock);
-
-  return is_cache_enabled;
-}
+void buf_cache_enable_cache(void) { bufs_cache.is_cache_enabled = 1; }
 
-void buf_cache_enable_cache(void) {
-  acquire(&bufs_cache.lock);
+void buf_cache_disable_cache(void) {
+  struct buf_cache_shard *shard;
+  struct buf *b;
 
-  bufs_cache.is_cache_enabled = 1;
+  if (!bufs_cache.is_cache_enabled) {
+    return;
+  }
+  bufs_cache.is_cache_enabled = 0;
 
-  release(&bufs_cache.lock);
+  // Invalidate all unused bufs
+  for (shard = bufs_cache.shards;
+       shard < bufs_cache.shards + BUF_CACHE_SHARDS; shard++) {
+    acquire(&shard->lock);
+    for (uint list = 0; list < BUF_CACHE_LISTS; list++) {
+      for (b = shard->lists[list].next; b != &shard->lists[list];
+           b = b->next) {
+        if (b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+          b->flags &= ~B_VALID;
+        }
+      }
+    }
+    release(&shard->lock);
+  }
 }
 
-void buf_cache_disable_cache(void) {
-  struct buf *b;
-  acquire(&bufs_cache.lock);
+enum buf_cache_policy buf_cache_get_policy(void) { return bufs_cache.policy; }
 
-  if (bufs_cache.is_cache_enabled) {
-    // Invalidate all unused bufs
-    for (b = bufs_cache.head.next; b != &bufs_cache.head; b = b->next) {
-      if (b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-        b->flags &= ~B_VALID;
+void buf_cache_set_policy(const enum buf_cache_policy policy) {
+  struct buf_cache_shard *shard;
+  struct buf *recent, *frequent;
+
+  if (bufs_cache.policy == policy) {
+    return;
+  }
+  bufs_cache.policy = policy;
+  if (policy != BUF_CACHE_POLICY_LRU) {
+    return;
+  }
+
+  // The LRU policy uses only the recent lists. Merge the frequent lists into
+  // them, keeping the use order.
+  for (shard = bufs_cache.shards;
+       shard < bufs_cache.shards + BUF_CACHE_SHARDS; shard++) {
+    acquire(&shard->lock);
+    recent = shard->lists[BUF_CACHE_RECENT].next;
+    while ((frequent = shard->lists[BUF_CACHE_FREQUENT].next) !=
+           &shard->lists[BUF_CACHE_FREQUENT]) {
+      while (recent != &shard->lists[BUF_CACHE_RECENT] &&
+             recent->lru_seq > frequent->lru_seq) {
+        recent = recent->next;
       }
+      buf_cache_list_remove(shard, frequent);
+      frequent->list = BUF_CACHE_RECENT;
+      shard->nlisted[BUF_CACHE_RECENT]++;
+      // Insert before the first recent buffer that was used less recently.
+      list_insert_first(recent->prev, frequent);
     }
-    bufs_cache.is_cache_enabled = 0;
+    release(&shard->lock);
   }
+}
+
+void buf_cache_get_stats(struct buf_cache_stats *const stats) {
+  memset(stats, 0, sizeof(*stats));
 
-  release(&bufs_cache.lock);
+  for (uint i = 0; i < BUF_CACHE_SHARDS; i++) {
+    struct buf_cache_shard *shard = &bufs_cache.shards[i];
+    acquire(&shard->lock);
+    for (uint list = 0; list < BUF_CACHE_LISTS; list++) {
+      stats->lists[list].size += shard->nlisted[list];
+      stats->lists[list].hits += shard->hits[list];
+      stats->lists[list].ghost_hits += shard->ghost_hits[list];
+    }
+    stats->misses += shard->misses;
+    stats->readahead_waste += shard->readahead_waste;
+    release(&shard->lock);
+  }
+  stats->recent_target = bufs_cache.recent_target;
 }
@@ -3,6 +3,32 @@
 
 #include "defs.h"
 
+// Replacement policies of the buffer cache.
+enum buf_cache_policy {
+  // Evict the least recently used block.
+  BUF_CACHE_POLICY_LRU,
+  // Adaptive replacement: keep apart blocks used once (recent) and blocks
+  // used again (frequent), and adapt the share of each upon misses.
+  BUF_CACHE_POLICY_ARC,
+};
+
+enum buf_cache_list {
+  BUF_CACHE_RECENT,
+  BUF_CACHE_FREQUENT,
+  BUF_CACHE_LISTS,
+};
+
+struct buf_cache_stats {
+  struct {
+    uint size;        // number of buffers in the list
+    uint hits;        // lookups that found the block in the list
+    uint ghost_hits;  // misses on a block recently evicted from the list
+  } lists[BUF_CACHE_LISTS];
+  uint misses;
+  uint recent_target;    // ARC: the desired size of the recent list
+  uint readahead_waste;  // prefetched blocks evicted before being read
+};
+
 void buf_cache_init();
 void buf_cache_invalidate_blocks(const struct device*);
 struct buf* buf_cache_get(const struct device*, const union buf_id*, uint);
@@ -10,5 +36,8 @@ void buf_cache_release(struct buf* b);
 uint buf_cache_is_cache_enabled(void);
 void buf_cache_enable_cache(void);
 void buf_cache_disable_cache(void);
+enum buf_cache_policy buf_cache_get_policy(void);
+void buf_cache_set_policy(enum buf_cache_policy);
+void buf_cache_get_stats(struct buf_cache_stats*);
 
 #endif  // XV6_DEVICE_BUF_CACHE_H
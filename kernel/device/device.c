@@ -1,9 +1,11 @@
 #include "device.h"
 
+#include "bio.h"
 #include "buf_cache.h"
 #include "defs.h"
 #include "ide.h"
 #include "ide_device.h"
+#include "obj_device.h"
 #include "obj_disk.h"
 #include "param.h"
 #include "sleeplock.h"
@@ -25,7 +27,9 @@ void devinit() {
   memset(dev_holder.devs_count, 0, sizeof(dev_holder.devs_count));
 
   buf_cache_init();  // buffer cache
+  binit();           // block readahead
   ideinit();         // disk
+  obj_devices_init();
 
   // Register initial IDE device we booted from
   if (create_ide_device(ROOTDEV) == NULL) panic("Failed to mount /!");
@@ -22,6 +22,9 @@ enum device_type {
 
 struct device_ops {
   void (*destroy)(struct device* dev);
+  // Called by the buffer cache when it evicts a valid block of the device,
+  // with a lock of the cache held. Optional.
+  void (*block_evicted)(const struct device* dev);
 };
 
 struct device {
@@ -1,18 +1,29 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code. Data moves by bus-master DMA when the PIIX controller
+// supports it and XV6_IDE_DMA is set, else by PIO.
+//
+// Requests wait in a queue sorted by disk and sector and are served in
+// C-LOOK order: upwards from the last command, then back to the lowest
+// pending request. Pending requests for consecutive blocks of a disk going
+// the same direction are merged into one multi-sector command.
 #include "ide.h"
 
 #include "defs.h"
+#include "fs/vfs_file.h"
+#include "ioctl_request.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "param.h"
+#include "pci.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "spinlock.h"
+#include "steady_clock.h"
 #include "traps.h"
 #include "types.h"
 #include "x86.h"
 
 #define SECTOR_SIZE 512
+#define SECTOR_PER_BLOCK (BSIZE / SECTOR_SIZE)
 #define IDE_BSY 0x80
 #define IDE_DRDY 0x40
 #define IDE_DF 0x20
@@ -22,16 +33,63 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+#define IDE_CMD_IDENTIFY 0xec
+#define IDE_CTRL_NIEN 0x02  // no interrupts from the disk
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+#define IDE_DISKS 2
+// Sectors moved by one READ/WRITE MULTIPLE or DMA command, with a single
+// interrupt.
+#define IDE_MAX_SECTORS 16
+
+// Bus master registers of the primary channel, from the PCI BAR4 base.
+#define BM_CMD 0
+#define BM_STATUS 2
+#define BM_PRDT 4
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08  // controller writes to memory
+#define BM_STATUS_ERR 0x02
+#define BM_STATUS_INTR 0x04
+
+// Physical region descriptor: a run of memory the controller moves data
+// to or from.
+struct prd {
+  uint addr;
+  ushort count;  // bytes
+  ushort flags;
+};
+#define PRD_EOT 0x8000  // last entry of the table
+
+// A region may not cross a 64KB boundary, so a block takes up to two.
+#define IDE_MAX_PRDS (2 * IDE_MAX_SECTORS / SECTOR_PER_BLOCK)
+
+// The PRD table must not cross a 64KB boundary either: align it to its
+// own size.
+static struct prd prdt[IDE_MAX_PRDS] __attribute__((aligned(128)));
+
+// idequeue points to the first pending buf, in sector order, and idetail
+// to the last one. ideactive points to the bufs of the command the disk
+// is executing. Both are chained through qnext.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static struct buf *idetail;
+static struct buf *ideactive;
+static uint idenext;   // queue key following the active command
+static uint idedepth;  // requests pending or active
+static struct dev_stat idestats[IDE_DISKS];
+
+static ushort idebmbase;  // bus master registers
+static int idehasdma;     // controller can do bus-master DMA
+static int idedma;        // new commands use DMA
+static int ideactivedma;  // the active command uses DMA
 
 static int havedisk1;
-static void idestart(const struct buf *);
+static uint idesize[IDE_DISKS];  // blocks on each disk
+static void idestart(const struct buf *, uint);
 
 // Wait for IDE disk to become ready.
 static int idewait(const int checkerr) {
@@ -43,6 +101,93 @@ static int idewait(const int checkerr) {
   return 0;
 }
 
+static uint ide_port(const struct buf *const b) {
+  return (uint)b->dev->private & 1;
+}
+
+// Position of b in the queue: by disk, then by block.
+static uint ide_key(const struct buf *const b) {
+  return (ide_port(b) << 31) | b->id.blockno;
+}
+
+// Bucket of value in a dev_stat histogram.
+static uint ide_stat_bucket(uint value) {
+  uint bucket = 0;
+
+  while (value != 0 && bucket < DEV_STAT_BUCKETS - 1) {
+    value >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static int idestat(int minor, struct dev_stat *device_stats) {
+  if (minor < 0 || minor >= IDE_DISKS) return -1;
+
+  acquire(&idelock);
+  *device_stats = idestats[minor];
+  device_stats->dma = idedma;
+  release(&idelock);
+
+  return 0;
+}
+
+static int ideioctl(int minor, int request, int arg) {
+  if (minor < 0 || minor >= IDE_DISKS || request != IOCTL_SET_DEV_DMA)
+    return -1;
+  if (arg && !idehasdma) return -1;
+
+  // The active command completes in the mode it started in.
+  acquire(&idelock);
+  idedma = (arg != 0);
+  release(&idelock);
+
+  return 0;
+}
+
+// Find the PIIX bus master registers and let the controller master the bus.
+// Return whether DMA is usable.
+static int idedmainit(void) {
+  uint bdf, bar;
+
+  if (pcifind(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &bdf) < 0) return 0;
+  // Bit 7 of the programming interface marks bus master support.
+  if (!(pciconfread(bdf, PCI_REG_CLASS) & 0x8000)) return 0;
+  bar = pciconfread(bdf, PCI_REG_BAR4);
+  if (!(bar & PCI_BAR_IO) || (bar & ~3) == 0) return 0;
+
+  idebmbase = bar & 0xfffc;
+  pciconfwrite(bdf, PCI_REG_COMMAND,
+               pciconfread(bdf, PCI_REG_COMMAND) | PCI_COMMAND_IO |
+                   PCI_COMMAND_MASTER);
+  outl(idebmbase + BM_PRDT, V2P(prdt));
+  return 1;
+}
+
+// Returns the size of disk in blocks, from the sector count of its IDENTIFY
+// data. The disk does not interrupt for the command.
+static uint ideidentify(const int disk) {
+  uint id[SECTOR_SIZE / sizeof(uint)];
+
+  idewait(0);
+  outb(0x3f6, IDE_CTRL_NIEN);
+  outb(0x1f6, 0xe0 | (disk << 4));
+  outb(0x1f7, IDE_CMD_IDENTIFY);
+  if (idewait(1) < 0) return 0;
+  insl(0x1f0, id, SECTOR_SIZE / 4);
+  // Words 60 and 61 hold the number of sectors reachable by LBA28.
+  return id[30] / SECTOR_PER_BLOCK;
+}
+
+// Let READ/WRITE MULTIPLE move IDE_MAX_SECTORS sectors per interrupt.
+static void idesetmultiple(const int disk) {
+  idewait(0);
+  outb(0x1f2, IDE_MAX_SECTORS);
+  outb(0x1f6, 0xe0 | (disk << 4));
+  outb(0x1f7, IDE_CMD_SETMUL);
+  idewait(0);
+}
+
 void ideinit(void) {
   int i;
 
@@ -59,90 +204,272 @@ void ideinit(void) {
     }
   }
 
+  idesize[0] = ideidentify(0);
+  if (havedisk1) idesize[1] = ideidentify(1);
+  idesetmultiple(0);
+  if (havedisk1) idesetmultiple(1);
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0 << 4));
+
+  if (XV6_IDE_DMA) idehasdma = idedmainit();
+  idedma = idehasdma;
+
+  devsw[IDE_MAJOR].stat = idestat;
+  devsw[IDE_MAJOR].ioctl = ideioctl;
+}
+
+// Insert b into the queue, keeping it sorted.
+static void idequeue_insert(struct buf *const b) {
+  struct buf **pp;
+
+  b->qnext = 0;
+  if (idetail == 0 || ide_key(idetail) <= ide_key(b)) {
+    // Appending, the common case of sequential I/O, takes O(1).
+    if (idetail != 0) {
+      idetail->qnext = b;
+    } else {
+      idequeue = b;
+    }
+    idetail = b;
+    return;
+  }
+
+  for (pp = &idequeue; ide_key(*pp) <= ide_key(b); pp = &(*pp)->qnext) {
+  }
+  b->qnext = *pp;
+  *pp = b;
 }
 
-// Start the request for b.  Caller must hold idelock.
-static void idestart(const struct buf *const b) {
+// Take the next requests off the queue and start them.
+// Caller must hold idelock.
+static void idestart_next(void) {
+  struct buf *b, *last, *prev = 0;
+  uint nblocks = 1;
+
+  if (idequeue == 0) return;
+
+  // C-LOOK: go on upwards from the last command, else wrap around.
+  for (b = idequeue; b != 0 && ide_key(b) < idenext; b = b->qnext) {
+    prev = b;
+  }
+  if (b == 0) {
+    prev = 0;
+    b = idequeue;
+  }
+
+  // Merge the requests for the following blocks.
+  for (last = b; last->qnext != 0; last = last->qnext) {
+    if ((nblocks + 1) * SECTOR_PER_BLOCK > IDE_MAX_SECTORS ||
+        ide_port(last->qnext) != ide_port(b) ||
+        ide_key(last->qnext) != ide_key(last) + 1 ||
+        (last->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+    nblocks++;
+  }
+
+  if (prev != 0) {
+    prev->qnext = last->qnext;
+  } else {
+    idequeue = last->qnext;
+  }
+  if (idetail == last) idetail = prev;
+  last->qnext = 0;
+
+  ideactive = b;
+  idenext = ide_key(last) + 1;
+  idestart(b, nblocks);
+}
+
+// Point the PRD table at the data of the bufs chained from b.
+static void idesetprdt(const struct buf *b) {
+  struct prd *prd = prdt;
+  uint pa, n, run;
+
+  for (; b != 0; b = b->qnext) {
+    pa = V2P(b->data);
+    for (n = BSIZE; n > 0; n -= run) {
+      run = 0x10000 - (pa & 0xffff);
+      if (run > n) run = n;
+      prd->addr = pa;
+      prd->count = run;
+      prd->flags = 0;
+      prd++;
+      pa += run;
+    }
+  }
+  prd[-1].flags = PRD_EOT;
+}
+
+// Start the request for the nblocks bufs chained from b.
+// Caller must hold idelock.
+static void idestart(const struct buf *const b, const uint nblocks) {
   if (b == 0) panic("idestart");
-  if (b->id.blockno >= FSSIZE) panic("incorrect blockno");
-  int sector_per_block = BSIZE / SECTOR_SIZE;
-  int sector = b->id.blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ : IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  if (b->id.blockno + nblocks > idesize[ide_port(b)])
+    panic("incorrect blockno");
+  uint start = (uint)steady_clock_now();
+  int sector_count = nblocks * SECTOR_PER_BLOCK;
+  int sector = b->id.blockno * SECTOR_PER_BLOCK;
+  int read_cmd = (sector_count == 1) ? IDE_CMD_READ : IDE_CMD_RDMUL;
+  int write_cmd = (sector_count == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  int bm_cmd = (b->flags & B_DIRTY) ? 0 : BM_CMD_READ;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (sector_count > IDE_MAX_SECTORS) panic("idestart");
 
   uint ide_port_id = (uint)b->dev->private;
   idewait(0);
-  outb(0x3f6, 0);                 // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  ideactivedma = idedma;
+  if (ideactivedma) {
+    idesetprdt(b);
+    // The table must be in memory before the controller reads it.
+    __sync_synchronize();
+    outb(idebmbase + BM_CMD, bm_cmd);
+    outb(idebmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_INTR);
+    read_cmd = IDE_CMD_RDDMA;
+    write_cmd = IDE_CMD_WRDMA;
+  }
+  outb(0x3f6, 0);             // generate interrupt
+  outb(0x1f2, sector_count);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((ide_port_id & 1) << 4) | ((sector >> 24) & 0x0f));
   if (b->flags & B_DIRTY) {
     outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE / 4);
+    if (!ideactivedma) {
+      for (const struct buf *w = b; w != 0; w = w->qnext) {
+        outsl(0x1f0, w->data, BSIZE / 4);
+      }
+    }
   } else {
     outb(0x1f7, read_cmd);
   }
+  if (ideactivedma) outb(idebmbase + BM_CMD, bm_cmd | BM_CMD_START);
+
+  idestats[ide_port(b)].cpu_us += (uint)steady_clock_now() - start;
+}
+
+// Stop the finished DMA command and acknowledge its interrupt.
+// Return -1 if the controller or the disk failed the transfer.
+static int idedmadone(void) {
+  uchar status = inb(idebmbase + BM_STATUS);
+
+  outb(idebmbase + BM_CMD, 0);
+  outb(idebmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_INTR);
+  if ((status & BM_STATUS_ERR) != 0 || idewait(1) < 0) return -1;
+  return 0;
 }
 
 // Interrupt handler.
 void ideintr(void) {
-  struct buf *b;
+  struct buf *b, *next;
+  struct dev_stat *stats;
+  uint now, nblocks;
+  int read_ok;
 
-  // First queued buffer is the active request.
+  // ideactive holds the bufs of the finished command.
   acquire(&idelock);
 
-  if ((b = idequeue) == 0) {
+  if ((b = ideactive) == 0) {
+    release(&idelock);
+    return;
+  }
+  ideactive = 0;
+
+  // A failed DMA command moved no usable data: stop using DMA and
+  // retry the command by PIO.
+  if (ideactivedma && idedmadone() < 0) {
+    cprintf("ide: DMA error, falling back to PIO\n");
+    idedma = 0;
+    for (nblocks = 0, next = b; next != 0; next = next->qnext) nblocks++;
+    ideactive = b;
+    idestart(b, nblocks);
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if (!(b->flags & B_DIRTY) && idewait(1) >= 0) insl(0x1f0, b->data, BSIZE / 4);
+  now = (uint)steady_clock_now();
+  stats = &idestats[ide_port(b)];
+  if (b->flags & B_DIRTY) {
+    stats->wios++;
+  } else {
+    stats->rios++;
+  }
+
+  // DMA already moved the data, PIO reads still have to.
+  read_ok = !ideactivedma && !(b->flags & B_DIRTY) && idewait(1) >= 0;
+  for (; b != 0; b = next) {
+    next = b->qnext;
+
+    // Read data if needed.
+    if (read_ok) insl(0x1f0, b->data, BSIZE / 4);
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+    if (b->flags & B_DIRTY) {
+      stats->wbytes += BSIZE;
+    } else {
+      stats->rbytes += BSIZE;
+    }
+    stats->latency[ide_stat_bucket((now - b->qtime) /
+                                   DEV_STAT_LATENCY_UNIT_US)]++;
+    idedepth--;
+
+    // Wake process waiting for this buf.
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+  }
+  stats->cpu_us += (uint)steady_clock_now() - now;
 
-  // Start disk on next buf in queue.
-  if (idequeue != 0) idestart(idequeue);
+  // Start disk on next bufs in queue.
+  idestart_next();
 
   release(&idelock);
 }
 
+// Queue b for the disk. Caller must hold idelock.
+static void ide_enqueue(struct buf *const b) {
+  if (!holdingsleep(&b->lock)) panic("iderw: buf not locked");
+  if (b->dev != 0 && !havedisk1) panic("iderw: ide disk 1 not present");
+
+  b->qtime = (uint)steady_clock_now();
+  idestats[ide_port(b)].queue_depth[ide_stat_bucket(idedepth)]++;
+  idedepth++;
+  idequeue_insert(b);  // DOC:insert-queue
+}
+
 // PAGEBREAK!
 //  Sync buf with disk.
 //  If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 //  Else if B_VALID is not set, read buf from disk, set B_VALID.
 void iderw(struct buf *const b) {
-  struct buf **pp;
-
-  if (!holdingsleep(&b->lock)) panic("iderw: buf not locked");
   if ((b->flags & (B_VALID | B_DIRTY)) == B_VALID)
     panic("iderw: nothing to do");
-  if (b->dev != 0 && !havedisk1) panic("iderw: ide disk 1 not present");
+
+  iderw_batch(&b, 1);
+}
+
+// Sync n bufs with disk like iderw, skipping valid clean bufs.
+// All the bufs are queued before waiting, so runs of consecutive
+// blocks move in single READ/WRITE MULTIPLE commands.
+void iderw_batch(struct buf *const *const bufs, const uint n) {
+  uint i;
 
   acquire(&idelock);  // DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for (pp = &idequeue; *pp; pp = &(*pp)->qnext) {
-  }  // DOC:insert-queue
-  *pp = b;
+  for (i = 0; i < n; i++) {
+    if ((bufs[i]->flags & (B_VALID | B_DIRTY)) != B_VALID) {
+      ide_enqueue(bufs[i]);
+    }
+  }
 
   // Start disk if necessary.
-  if (idequeue == b) idestart(b);
+  if (ideactive == 0) idestart_next();
 
-  // Wait for request to finish.
-  while ((b->flags & (B_VALID | B_DIRTY)) != B_VALID) {
-    sleep(b, &idelock);
+  // Wait for requests to finish.
+  for (i = 0; i < n; i++) {
+    while ((bufs[i]->flags & (B_VALID | B_DIRTY)) != B_VALID) {
+      sleep(bufs[i], &idelock);
+    }
   }
 
   release(&idelock);
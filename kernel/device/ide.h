@@ -2,8 +2,12 @@
 #define XV6_DEVICE_IDE_H
 
 #include "buf.h"
+
+#define IDE_MAJOR 2  // major device number of the IDE disks
+
 void ideinit(void);
 void ideintr(void);
 void iderw(struct buf*);
+void iderw_batch(struct buf* const*, uint);
 
 #endif  // XV6_DEVICE_IDE_H
@@ -5,30 +5,39 @@
 #include "proc.h"
 #include "spinlock.h"
 
-struct obj_cache {
-  struct spinlock lock;
-  uint hits;
-  uint misses;
-};
-
 struct bufs_alloc_hint {
   uint start_index;
   uint count;
   uint flags;
 };
 
-static struct obj_cache obj_cache;
+// Each CPU counts in its own slot of the device, so no lock is taken.
+// Interrupts are off meanwhile, so the process does not move to another
+// CPU halfway through.
+#define OBJ_CACHE_STAT_ADD(dev, field, n)                      \
+  do {                                                         \
+    struct obj_device_private *device = dev_private(dev);      \
+    pushcli();                                                 \
+    device->cache_stats[cpuid()].stats.field += (n);           \
+    popcli();                                                  \
+  } while (0)
+
+// The object bytes of the buffers of `bufs` that are not valid, where
+// `bufs` holds the blocks of the object from `first_block` on.
+static uint obj_cache_invalid_bytes(vector bufs, uint first_block,
+                                    uint obj_size) {
+  struct buf *curr_buf;
+  uint offset, bytes = 0;
 
-static void obj_cahce_hits_inc(void) {
-  acquire(&obj_cache.lock);
-  obj_cache.hits++;
-  release(&obj_cache.lock);
-}
+  for (uint index = 0; index < bufs.vectorsize; index++) {
+    memmove_from_vector((char *)&curr_buf, bufs, index, 1);
+    offset = (first_block + index) * BUF_DATA_SIZE;
+    if (!(curr_buf->flags & B_VALID) && offset < obj_size) {
+      bytes += min(BUF_DATA_SIZE, obj_size - offset);
+    }
+  }
 
-static void obj_cahce_misses_inc(void) {
-  acquire(&obj_cache.lock);
-  obj_cache.misses++;
-  release(&obj_cache.lock);
+  return bytes;
 }
 
 static uint obj_cache_are_bufs_valid(vector bufs) {
@@ -107,6 +116,7 @@ static void obj_cache_copy_to_bufs(vector bufs, const void *data, uint size,
     memmove(curr_buf->data + in_block_offset, ((char *)data) + copied_bytes,
             block_size);
     curr_buf->flags |= B_VALID | B_DIRTY;
+    curr_buf->flags &= ~B_READAHEAD;
     copied_bytes += block_size;
   }
 }
@@ -133,33 +143,36 @@ static void obj_cache_copy_from_bufs(vector bufs, uint size, uint offset,
     memmove_into_vector_bytes(dst, copied_bytes,
                               (char *)(curr_buf->data + in_block_offset),
                               block_size);
+    // A prefetched block is read at last
+    curr_buf->flags &= ~B_READAHEAD;
     copied_bytes += block_size;
   }
 }
 
-static uint validate_bufs(struct device *dev, const char *name, uint obj_size,
-                          vector obj_bufs, uint size, uint offset) {
+// Make the buffer at `index` of `obj_bufs`, holding block `blockno` of the
+// object, valid. Only this block is read from the disk.
+static uint validate_buf(struct device *dev, const char *name, vector obj_bufs,
+                         uint index, uint blockno, uint obj_size) {
   uint err = NO_ERR;
   struct buf *curr_buf;
-  uint found_invalid = 0;
-
-  for (uint index = 0; index < size; index++) {
-    memmove_from_vector((char *)&curr_buf, obj_bufs, offset + index, 1);
-    if (!(curr_buf->flags & B_VALID)) {
-      found_invalid = 1;
-    }
-  }
-
-  if (found_invalid) {
-    obj_cahce_hits_inc();
-
-    // Read the object from disk
-    err = get_object(dev, name, obj_bufs);
+  vector buf_vec;
+
+  memmove_from_vector((char *)&curr_buf, obj_bufs, index, 1);
+  if (!(curr_buf->flags & B_VALID)) {
+    OBJ_CACHE_STAT_ADD(dev, misses, 1);
+
+    // Read the block from disk
+    buf_vec = newvector(1, sizeof(struct buf *));
+    memmove_into_vector_elements(buf_vec, 0, (char *)&curr_buf, 1);
+    OBJ_CACHE_STAT_ADD(dev, bytes_read,
+                       obj_cache_invalid_bytes(buf_vec, blockno, obj_size));
+    err = get_object_range(dev, name, buf_vec, blockno);
+    freevector(&buf_vec);
     if (NO_ERR != err) {
       return err;
     }
   } else {
-    obj_cahce_misses_inc();
+    OBJ_CACHE_STAT_ADD(dev, hits, 1);
   }
 
   return NO_ERR;
@@ -208,12 +221,6 @@ static void obj_cache_set_contiguous_area_hints(
   alloc_hints[hints_index++] = (struct bufs_alloc_hint){.count = 0};
 }
 
-void obj_cache_init(void) {
-  initlock(&obj_cache.lock, "obj_cache");
-  obj_cache.hits = 0;
-  obj_cache.misses = 0;
-}
-
 uint obj_cache_add(struct device *dev, const char *name, const void *data,
                    uint size) {
   uint err = NO_ERR;
@@ -251,41 +258,44 @@ uint obj_cache_write(struct device *dev, const char *name, const void *data,
   vector obj_bufs = {0};
   uint new_obj_size =
       max(offset + size, prev_obj_size);  // NOLINT(build/include_what_you_use)
-  uint first_buf_index;
-  uint bufs_count;
-  struct bufs_alloc_hint alloc_hints[3];
+  uint first_block = OFFSET_TO_BLOCKNO(offset);
+  uint last_block = OFFSET_TO_BLOCKNO(offset + size - 1);
 
-  // Don't cache the whole object, but just the requested data and padding
-  obj_cache_set_contiguous_area_hints(alloc_hints, size, offset, new_obj_size);
+  if (size == 0) {
+    return NO_ERR;
+  }
 
-  obj_bufs = obj_cache_get_bufs(
-      dev, name, 0, OFFSET_TO_BLOCKNO(new_obj_size - 1) + 1, alloc_hints);
+  // Only the blocks the data falls in are written
+  obj_bufs = obj_cache_get_bufs(dev, name, first_block,
+                                last_block - first_block + 1, 0);
 
-  // If we don't write the whole object we need to read the rest of the content
-  // (from either disk or cache) as writes are done on entire objects
-  if (offset > 0) {
-    err = validate_bufs(dev, name, prev_obj_size, obj_bufs,
-                        OFFSET_TO_BLOCKNO(offset - 1) + 1, 0);
+  // The bytes of the first and last blocks out of the written range keep
+  // their content, so these blocks are read (from either disk or cache)
+  if (offset != OFFSET_ROUND_DOWN(offset)) {
+    err = validate_buf(dev, name, obj_bufs, 0, first_block, prev_obj_size);
     if (NO_ERR != err) {
       goto clean;
     }
   }
 
-  if ((offset + size) < prev_obj_size) {
-    first_buf_index = OFFSET_TO_BLOCKNO(offset + size);
-    bufs_count = OFFSET_TO_BLOCKNO(prev_obj_size - 1) - first_buf_index + 1;
-    err = validate_bufs(dev, name, prev_obj_size, obj_bufs, bufs_count,
-                        first_buf_index);
+  if ((offset + size) < prev_obj_size &&
+      (offset + size) % BUF_DATA_SIZE != 0 &&
+      (last_block != first_block || offset == OFFSET_ROUND_DOWN(offset))) {
+    err = validate_buf(dev, name, obj_bufs, last_block - first_block,
+                       last_block, prev_obj_size);
     if (NO_ERR != err) {
       goto clean;
     }
   }
 
   // Copy the new data to bufs
-  obj_cache_copy_to_bufs(obj_bufs, data, size, offset);
+  obj_cache_copy_to_bufs(obj_bufs, data, size,
+                         offset - OFFSET_ROUND_DOWN(offset));
 
-  err = write_object(dev, name, obj_bufs, new_obj_size);
+  err = write_object_range(dev, name, obj_bufs, first_block, new_obj_size);
   if (NO_ERR != err) {
+    // The cached blocks must not hold data the object does not
+    obj_cache_invalidate_bufs(obj_bufs);
     goto clean;
   }
 
@@ -301,34 +311,46 @@ uint obj_cache_read(struct device *dev, const char *name, vector *dst,
   vector obj_bufs = {0};
   uint start_block = OFFSET_TO_BLOCKNO(offset);
   uint end_block = OFFSET_TO_BLOCKNO(offset + size - 1);
-  struct bufs_alloc_hint alloc_hints[3];
+  uint ahead_block;
+  struct buf *curr_buf;
 
   // Try to read the object directly from cache
   obj_bufs = obj_cache_get_bufs(dev, name, start_block,
                                 end_block - start_block + 1, 0);
   if (obj_cache_are_bufs_valid(obj_bufs)) {
-    obj_cahce_hits_inc();
-    obj_cache_copy_from_bufs(obj_bufs, size, offset - OFFSET_ROUND_DOWN(offset),
-                             *dst);
+    OBJ_CACHE_STAT_ADD(dev, hits, 1);
   } else {
-    // The data we want to read is not entirely on cache, we need to read the
-    // whole object directly from disk
+    // The data we want to read is not entirely on cache. Read the missing
+    // blocks from disk, along with the padding blocks after them, which a
+    // sequential reader asks for next
+    OBJ_CACHE_STAT_ADD(dev, misses, 1);
     obj_cache_release_bufs(obj_bufs);
-    obj_cahce_misses_inc();
-
-    // Don't cache the whole object, but just the requested data and padding
-    obj_cache_set_contiguous_area_hints(alloc_hints, size, offset, obj_size);
-
-    obj_bufs = obj_cache_get_bufs(
-        dev, name, 0, OFFSET_TO_BLOCKNO(obj_size - 1) + 1, alloc_hints);
-    err = get_object(dev, name, obj_bufs);
+    ahead_block = end_block;
+    if (obj_size > 0 && OFFSET_TO_BLOCKNO(obj_size - 1) > end_block) {
+      ahead_block = min(end_block + OBJ_CACHE_BLOCKS_PADDING,
+                        OFFSET_TO_BLOCKNO(obj_size - 1));
+    }
+    obj_bufs = obj_cache_get_bufs(dev, name, start_block,
+                                  ahead_block - start_block + 1, 0);
+    OBJ_CACHE_STAT_ADD(dev, bytes_read,
+                       obj_cache_invalid_bytes(obj_bufs, start_block, obj_size));
+    for (uint index = end_block - start_block + 1; index < obj_bufs.vectorsize;
+         index++) {
+      memmove_from_vector((char *)&curr_buf, obj_bufs, index, 1);
+      if (!(curr_buf->flags & B_VALID)) {
+        curr_buf->flags |= B_READAHEAD;
+        OBJ_CACHE_STAT_ADD(dev, blocks_prefetched, 1);
+      }
+    }
+    err = get_object_range(dev, name, obj_bufs, start_block);
     if (NO_ERR != err) {
       goto clean;
     }
-
-    obj_cache_copy_from_bufs(obj_bufs, size, offset, *dst);
   }
 
+  obj_cache_copy_from_bufs(obj_bufs, size, offset - OFFSET_ROUND_DOWN(offset),
+                           *dst);
+
 clean:
   obj_cache_release_bufs(obj_bufs);
   return err;
@@ -358,22 +380,21 @@ uint obj_cache_delete(struct device *dev, const char *name, uint obj_size) {
   return NO_ERR;
 }
 
-uint objects_cache_hits() {
-  uint hits;
-
-  acquire(&obj_cache.lock);
-  hits = obj_cache.hits;
-  release(&obj_cache.lock);
-
-  return hits;
+void obj_cache_get_stats(struct device *dev, struct obj_cache_stats *stats) {
+  struct obj_device_private *device = dev_private(dev);
+  struct obj_cache_stats *cpu_stats;
+
+  memset(stats, 0, sizeof(*stats));
+  for (uint cpu = 0; cpu < NCPU; cpu++) {
+    cpu_stats = &device->cache_stats[cpu].stats;
+    stats->hits += cpu_stats->hits;
+    stats->misses += cpu_stats->misses;
+    stats->bytes_read += cpu_stats->bytes_read;
+    stats->blocks_prefetched += cpu_stats->blocks_prefetched;
+    stats->blocks_evicted += cpu_stats->blocks_evicted;
+  }
 }
 
-uint objects_cache_misses() {
-  uint misses;
-
-  acquire(&obj_cache.lock);
-  misses = obj_cache.misses;
-  release(&obj_cache.lock);
-
-  return misses;
+void obj_cache_block_evicted(const struct device *dev) {
+  OBJ_CACHE_STAT_ADD((struct device *)dev, blocks_evicted, 1);
 }
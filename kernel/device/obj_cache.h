@@ -19,13 +19,18 @@
  * invalidation of much more useful cache buffers instead of using the now
  * unused cache buffers of the big object. Therefore, cache only buffers around
  * the requested data area, and use the rest of the buffers as temporal memory.
+ *
+ * Reads and writes only get the buffers of the blocks in the requested range.
+ * Missing blocks are read alone from the disk, and a write sends just the
+ * blocks it changed, so small accesses to a big object stay small.
  */
 
 #include "buf.h"
 #include "kvector.h"
 #include "types.h"
 
-/* The number of blocks to cache around the requested contiguous data area. */
+/* The number of blocks to cache around the requested contiguous data area,
+ * and to read ahead after it upon a miss. */
 #define OBJ_CACHE_BLOCKS_PADDING (3)
 
 #define OFFSET_ROUND_DOWN(offset) ((offset) & ~(BUF_DATA_SIZE - 1))
@@ -34,7 +39,7 @@
 #define OFFSET_TO_BLOCKNO(offset) ((offset) / BUF_DATA_SIZE)
 #define SIZE_TO_NUM_OF_BUFS(size) (OFFSET_ROUND_UP(size) / BUF_DATA_SIZE)
 
-void obj_cache_init();
+struct obj_cache_stats;
 
 /* NOTE: The following functions of this module assume the inode of the object
  *       param is locked when called. */
@@ -52,8 +57,10 @@ uint obj_cache_delete(struct device* dev, const char* name, uint obj_size);
  * optimize their run flow.
  */
 
-uint objects_cache_hits();
-uint objects_cache_misses();
+// Sum the counters of the CPUs for the objects of `dev` into `stats`.
+void obj_cache_get_stats(struct device* dev, struct obj_cache_stats* stats);
+// Count a block of `dev` the buffer cache evicted.
+void obj_cache_block_evicted(const struct device* dev);
 uint cache_max_object_size();
 
 #endif /* XV6_DEVICE_OBJ_CACHE_H */
@@ -1,11 +1,138 @@
 #include "obj_device.h"
 
+#include "bio.h"
+#include "buf_cache.h"
+#include "defs.h"
+#include "fsdefs.h"
 #include "obj_disk.h"
+#include "sleeplock.h"
+
+// Dedup mode of new object devices.
+static int obj_devices_dedup;
+
+// Serializes looking up and creating object devices kept on disks.
+static struct sleeplock disk_obj_devices_lock;
+
+void obj_devices_init(void) {
+  initsleeplock(&disk_obj_devices_lock, "disk_obj_devices");
+}
 
 struct device* create_obj_device() {
   acquire(&dev_holder.lock);
   struct device* dev = _get_new_device(DEVICE_TYPE_OBJ);
   init_obj_device(dev);
+  ((struct obj_device_private*)dev_private(dev))->dedup = obj_devices_dedup;
+  release(&dev_holder.lock);
+  return dev;
+}
+
+// The object device kept on `disk`, holding a reference to it. NULL if none.
+static struct device* find_disk_obj_device(struct device* disk) {
+  struct device* dev = NULL;
+
+  acquire(&dev_holder.lock);
+  for (int i = 0; i < NMAXDEVS && dev == NULL; i++) {
+    if (dev_holder.devs[i].type == DEVICE_TYPE_OBJ &&
+        dev_holder.devs[i].ref > 0 && dev_holder.devs[i].private != NULL &&
+        ((struct obj_device_private*)dev_holder.devs[i].private)->backing ==
+            disk) {
+      dev = &dev_holder.devs[i];
+      dev->ref++;
+    }
+  }
   release(&dev_holder.lock);
   return dev;
 }
+
+struct device* get_disk_obj_device(struct device* disk) {
+  struct native_superblock sb;
+  struct device* dev;
+  struct buf* b;
+
+  acquiresleep(&disk_obj_devices_lock);
+  if ((dev = find_disk_obj_device(disk)) != NULL) {
+    goto end;
+  }
+
+  b = bread(disk, 1);
+  memmove(&sb, b->data, sizeof(sb));
+  buf_cache_release(b);
+  if (sb.nobjblocks == 0) {
+    goto end;
+  }
+
+  acquire(&dev_holder.lock);
+  dev = _get_new_device(DEVICE_TYPE_OBJ);
+  release(&dev_holder.lock);
+  if (dev == NULL) {
+    goto end;
+  }
+  // The store is loaded from the disk, which may sleep.
+  if (init_block_obj_device(dev, disk, sb.objstart, sb.nobjblocks) !=
+      NO_ERR) {
+    deviceput(dev);
+    dev = NULL;
+    goto end;
+  }
+  set_obj_device_dedup(dev, obj_devices_dedup);
+
+end:
+  releasesleep(&disk_obj_devices_lock);
+  return dev;
+}
+
+struct device* next_obj_device(int* i) {
+  struct device* dev = NULL;
+
+  acquire(&dev_holder.lock);
+  for (; *i < NMAXDEVS && dev == NULL; (*i)++) {
+    if (dev_holder.devs[*i].type == DEVICE_TYPE_OBJ &&
+        dev_holder.devs[*i].ref > 0) {
+      dev = &dev_holder.devs[*i];
+      dev->ref++;
+    }
+  }
+  release(&dev_holder.lock);
+  return dev;
+}
+
+void compact_obj_devices(void) {
+  struct device* dev;
+  int i = 0;
+
+  while ((dev = next_obj_device(&i)) != NULL) {
+    compact_obj_device(dev);
+    deviceput(dev);
+  }
+}
+
+void obj_devices_set_dedup(int dedup) {
+  struct device* dev;
+  int i = 0;
+
+  obj_devices_dedup = dedup;
+  while ((dev = next_obj_device(&i)) != NULL) {
+    set_obj_device_dedup(dev, dedup);
+    deviceput(dev);
+  }
+}
+
+int obj_devices_get_dedup(void) { return obj_devices_dedup; }
+
+void obj_devices_get_stats(struct obj_disk_stats* stats) {
+  struct obj_disk_stats dev_stats;
+  struct device* dev;
+  int i = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  while ((dev = next_obj_device(&i)) != NULL) {
+    obj_device_get_stats(dev, &dev_stats);
+    stats->compactions += dev_stats.compactions;
+    stats->bytes_moved += dev_stats.bytes_moved;
+    stats->dedup_hits += dev_stats.dedup_hits;
+    stats->dedup_logical_bytes += dev_stats.dedup_logical_bytes;
+    stats->dedup_stored_bytes += dev_stats.dedup_stored_bytes;
+    stats->blocks_written += dev_stats.blocks_written;
+    deviceput(dev);
+  }
+}
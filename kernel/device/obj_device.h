@@ -2,6 +2,27 @@
 #define XV6_DEVICE_OBJ_DEVICE_H
 
 #include "device.h"
+#include "obj_disk.h"
+
+void obj_devices_init(void);
+
+// Create an object device kept in RAM.
 struct device* create_obj_device();
+// Return the object device kept on the object store region of `disk`,
+// holding a reference to it. It is created, loading the store, if it is
+// not in use. NULL if the disk has no object store.
+struct device* get_disk_obj_device(struct device* disk);
+
+// Return the first object device in use from index `*i` on, holding a
+// reference to it, and advance `*i` past it. NULL when there are no more.
+struct device* next_obj_device(int* i);
+
+// Compact every object device in use.
+void compact_obj_devices(void);
+// Set the dedup mode of every object device in use and of new ones.
+void obj_devices_set_dedup(int dedup);
+int obj_devices_get_dedup(void);
+// Sum the statistics of every object device in use into `stats`.
+void obj_devices_get_stats(struct obj_disk_stats* stats);
 
 #endif  // XV6_DEVICE_OBJ_DEVICE_H
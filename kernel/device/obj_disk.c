@@ -3,11 +3,14 @@
 
 #include "obj_disk.h"
 
+#include "bio.h"
 #include "buf.h"
 #include "defs.h"
 #include "device.h"
 #include "device/buf_cache.h"
 #include "kvector.h"
+#include "mmu.h"
+#include "obj_cache.h"
 #include "sleeplock.h"
 #include "types.h"
 
@@ -16,12 +19,49 @@ static inline int entry_index_to_entry_offset(
   return device->sb.objects_table_offset + index * sizeof(objects_table_entry);
 }
 
+// FNV-1a over the object id.
+static uint obj_id_hash(const char* object_id) {
+  uint hash = 2166136261u;
+
+  for (uint i = 0; i < OBJECT_ID_LENGTH && object_id[i]; i++) {
+    hash = (hash ^ (uchar)object_id[i]) * 16777619u;
+  }
+  return hash % OBJ_INDEX_BUCKETS;
+}
+
+static void index_insert(struct obj_device_private* device, uint slot) {
+  uint* head = &device->index->buckets[obj_id_hash(
+      get_objects_table_entry(device, slot)->object_id)];
+
+  device->index->next[slot] = *head;
+  *head = slot + 1;
+}
+
+static void index_remove(struct obj_device_private* device, uint slot) {
+  uint* link = &device->index->buckets[obj_id_hash(
+      get_objects_table_entry(device, slot)->object_id)];
+
+  while (*link != 0 && *link != slot + 1) {
+    link = &device->index->next[*link - 1];
+  }
+  if (*link == 0) panic("obj_disk: slot not indexed");
+  *link = device->index->next[slot];
+}
+
+static void index_rebuild(struct obj_device_private* device) {
+  memset(device->index, 0, sizeof(*device->index));
+  for (uint i = 0; i < get_object_table_size(device); ++i) {
+    if (get_objects_table_entry(device, i)->occupied) index_insert(device, i);
+  }
+}
+
 uint get_objects_table_index(struct obj_device_private* device,
                              const char* name, uint* output) {
-  for (uint i = 0; i < get_object_table_size(device); ++i) {
-    objects_table_entry* entry = get_objects_table_entry(device, i);
+  for (uint slot = device->index->buckets[obj_id_hash(name)]; slot != 0;
+       slot = device->index->next[slot - 1]) {
+    objects_table_entry* entry = get_objects_table_entry(device, slot - 1);
     if (entry->occupied && obj_id_cmp(entry->object_id, name) == 0) {
-      *output = i;
+      *output = slot - 1;
       return NO_ERR;
     }
   }
@@ -35,16 +75,6 @@ objects_table_entry* get_objects_table_entry(struct obj_device_private* device,
       ->memory_storage[entry_index_to_entry_offset(device, entry_index)];
 }
 
-uint flush_objects_table_entry(uint offset) {
-  /**
-   * Currently, because the implemntation is memory only, writing to the
-   * entry received by `objects_table_entry` changes the table itself.
-   * In the future, this method would write the specific bytes to the disk.
-   */
-
-  return NO_ERR;
-}
-
 int obj_id_cmp(const char* p, const char* q) {
   uint i = 0;
   while (*p && *p == *q && i < OBJECT_ID_LENGTH) {
@@ -63,115 +93,656 @@ uint obj_id_bytes(const char* object_id) {
   return bytes;
 }
 
-void swap(uint* xp, uint* yp) {
-  int temp = *xp;
-  *xp = *yp;
-  *yp = temp;
+/**
+ * Storage access by offset. A RAM device keeps the whole storage in its
+ * holder. A block device keeps there only the super block and the table,
+ * below `store_offset`, and goes to the backing device for anything else.
+ */
+
+static struct buf* storage_block(struct obj_device_private* device,
+                                 uint offset) {
+  return bread(device->backing, device->backing_start + offset / BSIZE);
 }
 
-void bubble_sort(struct obj_device_private* device, uint* arr, uint n) {
-  if (n >= 2) {
-    for (uint i = 0; i < n - 1; i++) {
-      for (uint j = 0; j < n - i - 1; j++) {
-        if (get_objects_table_entry(device, arr[j])->disk_offset >
-            get_objects_table_entry(device, arr[j + 1])->disk_offset) {
-          swap(&arr[j], &arr[j + 1]);  // NOLINT(build/include_what_you_use)
-        }
-      }
+static void storage_read(struct obj_device_private* device, uint offset,
+                         char* dst, uint n) {
+  struct buf* b;
+  uint m;
+
+  if (!device->backing) {
+    memmove(dst, device->storage_holder->memory_storage + offset, n);
+    return;
+  }
+  for (; n > 0; offset += m, dst += m, n -= m) {
+    m = min(n, BSIZE - offset % BSIZE);
+    b = storage_block(device, offset);
+    memmove(dst, b->data + offset % BSIZE, m);
+    buf_cache_release(b);
+  }
+}
+
+// Blocks of a block device whose bytes do not change are not written.
+static void storage_write(struct obj_device_private* device, uint offset,
+                          const char* src, uint n) {
+  struct buf* b;
+  uint m;
+
+  if (!device->backing) {
+    memmove(device->storage_holder->memory_storage + offset, src, n);
+    return;
+  }
+  for (; n > 0; offset += m, src += m, n -= m) {
+    m = min(n, BSIZE - offset % BSIZE);
+    b = storage_block(device, offset);
+    if (memcmp(b->data + offset % BSIZE, src, m) != 0) {
+      memmove(b->data + offset % BSIZE, src, m);
+      bwrite(b);
+      device->stats.blocks_written++;
+    }
+    buf_cache_release(b);
+  }
+}
+
+// Move `n` bytes from `src` to `dst`, the ranges may overlap.
+static void storage_move(struct obj_device_private* device, uint dst,
+                         uint src, uint n) {
+  uint m;
+
+  if (!device->backing) {
+    char* storage = device->storage_holder->memory_storage;
+    memmove(storage + dst, storage + src, n);
+    return;
+  }
+  // Move away from the overlap first, so no bytes are overwritten before
+  // they moved.
+  if (dst > src) {
+    for (; n > 0; n -= m) {
+      m = min((dst + n - 1) % BSIZE + 1, n);
+      storage_read(device, src + n - m, device->bounce, m);
+      storage_write(device, dst + n - m, device->bounce, m);
+    }
+  } else {
+    for (; n > 0; dst += m, src += m, n -= m) {
+      m = min(BSIZE - dst % BSIZE, n);
+      storage_read(device, src, device->bounce, m);
+      storage_write(device, dst, device->bounce, m);
+    }
+  }
+}
+
+// Table blocks changed by an operation, written when it ends.
+static void metadata_dirty(struct obj_device_private* device, uint offset,
+                           uint size) {
+  if (!device->backing || size == 0) return;
+  for (uint b = offset / BSIZE; b <= (offset + size - 1) / BSIZE; b++) {
+    device->dirty[b / 8] |= 1 << (b % 8);
+  }
+}
+
+static void table_entry_dirty(struct obj_device_private* device, uint slot) {
+  metadata_dirty(device, entry_index_to_entry_offset(device, slot),
+                 sizeof(objects_table_entry));
+}
+
+// Write the dirty table blocks to the backing device. The bytes of the last
+// one from `store_offset` on belong to the store and are left alone.
+static void flush_metadata(struct obj_device_private* device) {
+  uint end;
+
+  if (!device->backing) return;
+  for (uint b = 0; b * BSIZE < device->sb.store_offset; b++) {
+    if (!(device->dirty[b / 8] & (1 << (b % 8)))) continue;
+    device->dirty[b / 8] &= ~(1 << (b % 8));
+    end = min((b + 1) * BSIZE, device->sb.store_offset);
+    storage_write(device, b * BSIZE,
+                  device->storage_holder->memory_storage + b * BSIZE,
+                  end - b * BSIZE);
+  }
+}
+
+#define EXTENT(e, n) (&(e)->nodes[n])
+#define CHILD(e, t, n, dir) (EXTENT(e, n)->child[t][dir])
+
+// Treap priorities are derived from the node number, which is unrelated
+// to either key.
+static uint extent_priority(ushort n) { return n * 2654435761u; }
+
+static int extent_less(int tree, const struct obj_extent* a,
+                       const struct obj_extent* b) {
+  if (tree == OBJ_EXTENTS_BY_SIZE && a->size != b->size) {
+    return a->size < b->size;
+  }
+  return a->offset < b->offset;
+}
+
+// Split the treap at `n` into the nodes less than `key` and the rest.
+static void extent_split(struct obj_free_extents* e, int tree, ushort n,
+                         const struct obj_extent* key, ushort* less,
+                         ushort* rest) {
+  if (n == 0) {
+    *less = *rest = 0;
+  } else if (extent_less(tree, EXTENT(e, n), key)) {
+    *less = n;
+    extent_split(e, tree, CHILD(e, tree, n, 1), key, &CHILD(e, tree, n, 1),
+                 rest);
+  } else {
+    *rest = n;
+    extent_split(e, tree, CHILD(e, tree, n, 0), key, less,
+                 &CHILD(e, tree, n, 0));
+  }
+}
+
+// Merge two treaps, all of `a` less than all of `b`.
+static ushort extent_merge(struct obj_free_extents* e, int tree, ushort a,
+                           ushort b) {
+  if (a == 0 || b == 0) return a | b;
+  if (extent_priority(a) > extent_priority(b)) {
+    CHILD(e, tree, a, 1) = extent_merge(e, tree, CHILD(e, tree, a, 1), b);
+    return a;
+  }
+  CHILD(e, tree, b, 0) = extent_merge(e, tree, a, CHILD(e, tree, b, 0));
+  return b;
+}
+
+static ushort extent_insert(struct obj_free_extents* e, int tree,
+                            ushort root, ushort n) {
+  if (root == 0) return n;
+  if (extent_priority(n) > extent_priority(root)) {
+    extent_split(e, tree, root, EXTENT(e, n), &CHILD(e, tree, n, 0),
+                 &CHILD(e, tree, n, 1));
+    return n;
+  }
+  int dir = !extent_less(tree, EXTENT(e, n), EXTENT(e, root));
+  CHILD(e, tree, root, dir) =
+      extent_insert(e, tree, CHILD(e, tree, root, dir), n);
+  return root;
+}
+
+static ushort extent_erase(struct obj_free_extents* e, int tree, ushort root,
+                           ushort n) {
+  if (root == 0) panic("obj_disk: extent not found");
+  if (root == n) {
+    return extent_merge(e, tree, CHILD(e, tree, n, 0), CHILD(e, tree, n, 1));
+  }
+  int dir = !extent_less(tree, EXTENT(e, n), EXTENT(e, root));
+  CHILD(e, tree, root, dir) =
+      extent_erase(e, tree, CHILD(e, tree, root, dir), n);
+  return root;
+}
+
+static void extent_link(struct obj_free_extents* e, int tree, ushort n) {
+  CHILD(e, tree, n, 0) = CHILD(e, tree, n, 1) = 0;
+  e->root[tree] = extent_insert(e, tree, e->root[tree], n);
+}
+
+static void extent_unlink(struct obj_free_extents* e, int tree, ushort n) {
+  e->root[tree] = extent_erase(e, tree, e->root[tree], n);
+}
+
+static void extent_add(struct obj_free_extents* e, uint offset, uint size) {
+  ushort n = e->free;
+
+  if (n == 0) panic("obj_disk: out of free extents");
+  e->free = CHILD(e, 0, n, 0);
+  EXTENT(e, n)->offset = offset;
+  EXTENT(e, n)->size = size;
+  extent_link(e, OBJ_EXTENTS_BY_OFFSET, n);
+  extent_link(e, OBJ_EXTENTS_BY_SIZE, n);
+  e->count++;
+  e->bytes += size;
+}
+
+static void extent_remove(struct obj_free_extents* e, ushort n) {
+  extent_unlink(e, OBJ_EXTENTS_BY_OFFSET, n);
+  extent_unlink(e, OBJ_EXTENTS_BY_SIZE, n);
+  CHILD(e, 0, n, 0) = e->free;
+  e->free = n;
+  e->count--;
+  e->bytes -= EXTENT(e, n)->size;
+}
+
+// Change the size of `n`, keeping its offset.
+static void extent_resize(struct obj_free_extents* e, ushort n, uint size) {
+  extent_unlink(e, OBJ_EXTENTS_BY_SIZE, n);
+  e->bytes += size - EXTENT(e, n)->size;
+  EXTENT(e, n)->size = size;
+  extent_link(e, OBJ_EXTENTS_BY_SIZE, n);
+}
+
+// The extent of the highest offset not above `offset`, 0 if none.
+static ushort extent_floor(struct obj_free_extents* e, uint offset) {
+  ushort found = 0;
+
+  for (ushort n = e->root[OBJ_EXTENTS_BY_OFFSET]; n != 0;) {
+    if (EXTENT(e, n)->offset <= offset) {
+      found = n;
+      n = CHILD(e, OBJ_EXTENTS_BY_OFFSET, n, 1);
+    } else {
+      n = CHILD(e, OBJ_EXTENTS_BY_OFFSET, n, 0);
     }
   }
+  return found;
+}
+
+// The extent of the lowest offset above `offset`, 0 if none.
+static ushort extent_next(struct obj_free_extents* e, uint offset) {
+  ushort found = 0;
+
+  for (ushort n = e->root[OBJ_EXTENTS_BY_OFFSET]; n != 0;) {
+    if (EXTENT(e, n)->offset > offset) {
+      found = n;
+      n = CHILD(e, OBJ_EXTENTS_BY_OFFSET, n, 0);
+    } else {
+      n = CHILD(e, OBJ_EXTENTS_BY_OFFSET, n, 1);
+    }
+  }
+  return found;
+}
+
+// The smallest extent of at least `size` bytes, 0 if none.
+static ushort extent_best_fit(struct obj_free_extents* e, uint size) {
+  ushort found = 0;
+
+  for (ushort n = e->root[OBJ_EXTENTS_BY_SIZE]; n != 0;) {
+    if (EXTENT(e, n)->size >= size) {
+      found = n;
+      n = CHILD(e, OBJ_EXTENTS_BY_SIZE, n, 0);
+    } else {
+      n = CHILD(e, OBJ_EXTENTS_BY_SIZE, n, 1);
+    }
+  }
+  return found;
+}
+
+static void extents_init(struct obj_free_extents* e) {
+  e->root[OBJ_EXTENTS_BY_OFFSET] = e->root[OBJ_EXTENTS_BY_SIZE] = 0;
+  e->count = 0;
+  e->bytes = 0;
+  e->free = 0;
+  for (uint n = OBJ_EXTENTS_MAX; n > 0; n--) {
+    CHILD(e, 0, n, 0) = e->free;
+    e->free = n;
+  }
 }
 
 /**
- * The method finds a sequence of empty bytes of length `size`.
- * If no such sequence exists, NULL is returned.
- *
- * To achieve this, the method first sort the objects in the table by their
- * address in the disk. Then, we check the space between every 2 consecutive
- * entries. We also check the space left between the end of the last element
- * and the end of the disk.
- * Notice that there are at least 2 objects in the table at every moment: the
- * super block and the objects table itself. Also, the super block is located
- * at address 0, hence we don't check the "empty space" before it because
- * there is no such space.
- *
- * Smarter implementation can be used in future work such as saving free
- * blocks in a list. Read "malloc internals" for details.
+ * Return the given range to the free space, merging it with the free
+ * extents around it.
  */
-static void* find_empty_space(struct obj_device_private* device, uint size) {
-  // 1. put all occupied entries in an array
-  uint current_table_size =
-      min((device->sb.store_offset -  // NOLINT(build/include_what_you_use)
-           device->sb.objects_table_offset),
-          STORAGE_DEVICE_SIZE) /
-      sizeof(objects_table_entry);
-  const uint entries_arr_size = current_table_size - 2;
-  /* Be aware: Variable-length arrays are usually bad habit */
-  uint entries_indices[entries_arr_size];  // NOLINT
-  uint* current = entries_indices;
-  uint populated_size = 0;
-  for (uint i = 2; i < get_object_table_size(device); ++i) {
+static void free_space(struct obj_device_private* device, uint offset,
+                       uint size) {
+  struct obj_free_extents* e = device->extents;
+  ushort prev, next;
+
+  if (size == 0) return;
+  prev = extent_floor(e, offset);
+  next = extent_next(e, offset);
+  if ((prev && EXTENT(e, prev)->offset + EXTENT(e, prev)->size > offset) ||
+      (next && EXTENT(e, next)->offset < offset + size)) {
+    panic("obj_disk: freeing free space");
+  }
+
+  if (next && EXTENT(e, next)->offset == offset + size) {
+    size += EXTENT(e, next)->size;
+    extent_remove(e, next);
+  }
+  if (prev && EXTENT(e, prev)->offset + EXTENT(e, prev)->size == offset) {
+    extent_resize(e, prev, EXTENT(e, prev)->size + size);
+  } else {
+    extent_add(e, offset, size);
+  }
+}
+
+/**
+ * Take the given range, which must be free, out of the free space.
+ */
+static void reserve_space(struct obj_device_private* device, uint offset,
+                          uint size) {
+  struct obj_free_extents* e = device->extents;
+  ushort n;
+  uint end;
+
+  if (size == 0) return;
+  n = extent_floor(e, offset);
+  if (!n || EXTENT(e, n)->offset + EXTENT(e, n)->size < offset + size) {
+    panic("obj_disk: reserving occupied space");
+  }
+
+  end = EXTENT(e, n)->offset + EXTENT(e, n)->size;
+  if (EXTENT(e, n)->offset == offset) {
+    extent_remove(e, n);
+  } else {
+    extent_resize(e, n, offset - EXTENT(e, n)->offset);
+  }
+  if (offset + size < end) {
+    extent_add(e, offset + size, end - offset - size);
+  }
+}
+
+/**
+ * Give the unoccupied entries at the end of the objects table, down to its
+ * initial size, back to the store. Return whether the table shrunk.
+ */
+static int shrink_objects_table(struct obj_device_private* device) {
+  uint last = INITIAL_OBJECT_TABLE_SIZE - 1;
+  uint new_store_offset;
+
+  for (uint i = get_object_table_size(device) - 1; i > last; i--) {
     if (get_objects_table_entry(device, i)->occupied) {
-      *current = i;
-      current++;
-      populated_size++;
-      if (current - entries_indices > entries_arr_size) {
-        panic("found too much entries vs expected");
-      }
+      last = i;
     }
   }
+  new_store_offset = entry_index_to_entry_offset(device, last + 1);
+  if (new_store_offset >= device->sb.store_offset) {
+    return 0;
+  }
 
-  if (populated_size == 0 &&
-      STORAGE_DEVICE_SIZE - size >= device->sb.store_offset) {
-    return &device->storage_holder->memory_storage[STORAGE_DEVICE_SIZE - size];
-  }
-
-  uint last_occupied_entry = entries_indices[entries_arr_size - 1];
-  // 2. sort it by objects disk-offset. smaller first.
-  bubble_sort(device, entries_indices, populated_size);
-  // 3. Check for rightmost spot
-  objects_table_entry* last_entry =
-      get_objects_table_entry(device, entries_indices[populated_size - 1]);
-  uint space_left = device->sb.storage_device_size - last_entry->disk_offset -
-                    last_entry->size;
-  if (space_left >= size) {
-    return &device->storage_holder->memory_storage[STORAGE_DEVICE_SIZE - size];
-  }
-  // 4. for each occupied entry, measure space between this entry to the next.
-  // if an appropriate space is found, return the rightmost memory chunk for
-  // allocation.
-  if (populated_size >= 2) {
-    for (uint i = populated_size - 1; i > 0; i--) {
-      objects_table_entry* current_entry =
-          get_objects_table_entry(device, entries_indices[i]);
-      objects_table_entry* prev_entry =
-          get_objects_table_entry(device, entries_indices[i - 1]);
-      space_left = current_entry->disk_offset - prev_entry->disk_offset -
-                   prev_entry->size;
-      if (space_left >= size) {
-        return &device->storage_holder
-                    ->memory_storage[current_entry->disk_offset - size];
-      }
+  free_space(device, new_store_offset,
+             device->sb.store_offset - new_store_offset);
+  device->sb.bytes_occupied -= device->sb.store_offset - new_store_offset;
+  device->sb.store_offset = new_store_offset;
+  device->first_free_slot = min(device->first_free_slot, last + 1);
+  return 1;
+}
+
+#define BLOB(device, n) (&(device)->blobs->blobs[n])
+
+// FNV-1a over the object content.
+static uint digest_update(uint hash, const uchar* data, uint n) {
+  for (uint i = 0; i < n; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static uint bufs_digest(vector bufs, uint size) {
+  uint hash = 2166136261u, hashed = 0;
+  struct buf* curr_buf;
+
+  for (uint buf_index = 0; hashed < size; buf_index++) {
+    uint block_size = min(BUF_DATA_SIZE, size - hashed);
+    memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
+    hash = digest_update(hash, curr_buf->data, block_size);
+    hashed += block_size;
+  }
+  return hash;
+}
+
+static uint storage_digest(struct obj_device_private* device, uint offset,
+                           uint size) {
+  uint hash = 2166136261u;
+  uint m;
+
+  for (; size > 0; offset += m, size -= m) {
+    m = min(size, BSIZE);
+    storage_read(device, offset, device->bounce, m);
+    hash = digest_update(hash, (uchar*)device->bounce, m);
+  }
+  return hash;
+}
+
+static int bufs_equal_storage(struct obj_device_private* device, uint offset,
+                              vector bufs, uint size) {
+  uint compared = 0;
+  struct buf* curr_buf;
+
+  for (uint buf_index = 0; compared < size; buf_index++) {
+    uint block_size = min(BUF_DATA_SIZE, size - compared);
+    memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
+    storage_read(device, offset + compared, device->bounce, block_size);
+    if (memcmp(device->bounce, curr_buf->data, block_size) != 0) {
+      return 0;
     }
+    compared += block_size;
   }
-  // 5. could not find any space, consider moving the store space limit.
-  objects_table_entry* earliest_occupied_entry =
-      get_objects_table_entry(device, entries_indices[0]);
-  if (earliest_occupied_entry->disk_offset - device->sb.store_offset >= size) {
-    return &device->storage_holder
-                ->memory_storage[earliest_occupied_entry->disk_offset - size];
-  } else {
-    uint needed_space =
-        size - (earliest_occupied_entry->disk_offset - device->sb.store_offset);
-    uint offset_after_last_entry =
-        entry_index_to_entry_offset(device, last_occupied_entry + 1);
-    if (offset_after_last_entry < device->sb.store_offset - needed_space) {
-      device->sb.store_offset = device->sb.store_offset - needed_space;
-      return &device->storage_holder->memory_storage[device->sb.store_offset];
+  return 1;
+}
+
+static uint blob_offset_bucket(uint offset) {
+  return (offset * 2654435761u) % OBJ_BLOB_BUCKETS;
+}
+
+static void blobs_init(struct obj_blobs* blobs) {
+  memset(blobs, 0, sizeof(*blobs));
+  for (uint n = OBJ_BLOBS_MAX; n > 0; n--) {
+    blobs->blobs[n].next_by_digest = blobs->free;
+    blobs->free = n;
+  }
+}
+
+// The blob holding `size` bytes equal to `bufs`, 0 if none.
+static ushort blob_find(struct obj_device_private* device, uint digest,
+                        vector bufs, uint size) {
+  for (ushort n = device->blobs->by_digest[digest % OBJ_BLOB_BUCKETS]; n != 0;
+       n = BLOB(device, n)->next_by_digest) {
+    struct obj_blob* blob = BLOB(device, n);
+    if (blob->digest == digest && blob->size == size &&
+        bufs_equal_storage(device, blob->offset, bufs, size)) {
+      return n;
+    }
+  }
+  return 0;
+}
+
+// The blob an object at `offset` of `size` bytes points to, 0 if it owns
+// its space.
+static ushort blob_at(struct obj_device_private* device, uint offset,
+                      uint size) {
+  if (size == 0) return 0;
+  for (ushort n = device->blobs->by_offset[blob_offset_bucket(offset)];
+       n != 0; n = BLOB(device, n)->next_by_offset) {
+    if (BLOB(device, n)->offset == offset && BLOB(device, n)->size == size) {
+      return n;
+    }
+  }
+  return 0;
+}
+
+// Make the stored content at `offset` a blob with a single reference.
+// Return 0 if no blob is left.
+static ushort blob_add(struct obj_device_private* device, uint digest,
+                       uint offset, uint size) {
+  struct obj_blobs* blobs = device->blobs;
+  ushort n = blobs->free;
+
+  if (n == 0) return 0;
+  blobs->free = BLOB(device, n)->next_by_digest;
+  *BLOB(device, n) = (struct obj_blob){
+      .digest = digest,
+      .offset = offset,
+      .size = size,
+      .refs = 1,
+      .next_by_digest = blobs->by_digest[digest % OBJ_BLOB_BUCKETS],
+      .next_by_offset = blobs->by_offset[blob_offset_bucket(offset)]};
+  blobs->by_digest[digest % OBJ_BLOB_BUCKETS] = n;
+  blobs->by_offset[blob_offset_bucket(offset)] = n;
+  device->stats.dedup_stored_bytes += size;
+  device->stats.dedup_logical_bytes += size;
+  return n;
+}
+
+// Forget the blob. Its space is left to the caller.
+static void blob_drop(struct obj_device_private* device, ushort n) {
+  struct obj_blobs* blobs = device->blobs;
+  struct obj_blob* blob = BLOB(device, n);
+  ushort* link;
+
+  link = &blobs->by_digest[blob->digest % OBJ_BLOB_BUCKETS];
+  while (*link != n) link = &BLOB(device, *link)->next_by_digest;
+  *link = blob->next_by_digest;
+  link = &blobs->by_offset[blob_offset_bucket(blob->offset)];
+  while (*link != n) link = &BLOB(device, *link)->next_by_offset;
+  *link = blob->next_by_offset;
+
+  device->stats.dedup_stored_bytes -= blob->size;
+  blob->refs = 0;
+  blob->next_by_digest = blobs->free;
+  blobs->free = n;
+}
+
+// Rebuild the offset chains after blobs moved.
+static void blobs_rehash_offsets(struct obj_device_private* device) {
+  struct obj_blobs* blobs = device->blobs;
+
+  memset(blobs->by_offset, 0, sizeof(blobs->by_offset));
+  for (ushort n = 1; n <= OBJ_BLOBS_MAX; n++) {
+    struct obj_blob* blob = BLOB(device, n);
+    if (blob->refs == 0) continue;
+    blob->next_by_offset = blobs->by_offset[blob_offset_bucket(blob->offset)];
+    blobs->by_offset[blob_offset_bucket(blob->offset)] = n;
+  }
+}
+
+// Point `entry` at the blob, adding a reference.
+static void blob_reference(struct obj_device_private* device,
+                           objects_table_entry* entry, ushort n) {
+  BLOB(device, n)->refs++;
+  device->stats.dedup_hits++;
+  device->stats.dedup_logical_bytes += BLOB(device, n)->size;
+  entry->disk_offset = BLOB(device, n)->offset;
+  entry->size = BLOB(device, n)->size;
+}
+
+// Drop the reference of `entry` to its content, whose space is freed with
+// the last reference.
+static void release_entry_space(struct obj_device_private* device,
+                                objects_table_entry* entry) {
+  ushort n = blob_at(device, entry->disk_offset, entry->size);
+
+  if (n) {
+    device->stats.dedup_logical_bytes -= entry->size;
+    if (--BLOB(device, n)->refs > 0) return;
+    blob_drop(device, n);
+  }
+  free_space(device, entry->disk_offset, entry->size);
+  device->sb.bytes_occupied -= entry->size;
+}
+
+static uint slot_offset(struct obj_device_private* device, uint slot) {
+  return get_objects_table_entry(device, slot)->disk_offset;
+}
+
+static void sift_down(struct obj_device_private* device, uint* slots,
+                      uint root, uint n) {
+  uint child, tmp;
+
+  while ((child = 2 * root + 1) < n) {
+    if (child + 1 < n &&
+        slot_offset(device, slots[child + 1]) >
+            slot_offset(device, slots[child])) {
+      child++;
     }
+    if (slot_offset(device, slots[root]) >= slot_offset(device, slots[child]))
+      return;
+    tmp = slots[root];
+    slots[root] = slots[child];
+    slots[child] = tmp;
+    root = child;
+  }
+}
+
+// Heap sort, so it neither recurses nor allocates.
+static void sort_slots_by_offset(struct obj_device_private* device,
+                                 uint* slots, uint n) {
+  uint tmp;
+
+  for (uint i = n / 2; i-- > 0;) sift_down(device, slots, i, n);
+  for (uint i = n; i-- > 1;) {
+    tmp = slots[0];
+    slots[0] = slots[i];
+    slots[i] = tmp;
+    sift_down(device, slots, 0, i);
+  }
+}
+
+/**
+ * Slide the objects, highest first, against the end of the device. The
+ * free space of the store is left as a single extent at its beginning.
+ * The disk lock should be held by the caller.
+ */
+static uint compact_objects(struct obj_device_private* device) {
+  uint* slots = device->extents->order;
+  uint n = 0, end = device->sb.storage_device_size, moved = 0;
+  uint prev_offset = device->sb.storage_device_size;
+  ushort blob;
+
+  for (uint i = 2; i < get_object_table_size(device); i++) {
+    objects_table_entry* entry = get_objects_table_entry(device, i);
+    if (entry->occupied && entry->size > 0) slots[n++] = i;
+  }
+  sort_slots_by_offset(device, slots, n);
+
+  while (n-- > 0) {
+    objects_table_entry* entry = get_objects_table_entry(device, slots[n]);
+    // Entries sharing a blob are sorted together, move it once.
+    if (entry->disk_offset == prev_offset) {
+      if (entry->disk_offset != end) table_entry_dirty(device, slots[n]);
+      entry->disk_offset = end;
+      continue;
+    }
+    prev_offset = entry->disk_offset;
+    end -= entry->size;
+    if (entry->disk_offset != end) {
+      // Moved blobs are found by their old offset until the rehash, no
+      // blob moves onto the old offset of one not moved yet.
+      if ((blob = blob_at(device, entry->disk_offset, entry->size))) {
+        BLOB(device, blob)->offset = end;
+      }
+      storage_move(device, end, entry->disk_offset, entry->size);
+      entry->disk_offset = end;
+      table_entry_dirty(device, slots[n]);
+      moved += entry->size;
+    }
+  }
+  blobs_rehash_offsets(device);
+
+  extents_init(device->extents);
+  free_space(device, device->sb.store_offset, end - device->sb.store_offset);
+  device->stats.compactions++;
+  device->stats.bytes_moved += moved;
+  return moved;
+}
+
+// The size of the free extent the store begins with.
+static uint store_head_space(struct obj_device_private* device) {
+  ushort n = extent_floor(device->extents, device->sb.store_offset);
+
+  if (n && EXTENT(device->extents, n)->offset == device->sb.store_offset) {
+    return EXTENT(device->extents, n)->size;
+  }
+  return 0;
+}
+
+/**
+ * Allocate `size` bytes from the end of the smallest free extent that can
+ * hold them, and set `*offset` to their offset. If there is none, the
+ * objects table gives back its unused tail and the search is retried, then
+ * the store is compacted if it has enough free bytes in total.
+ * If no such sequence exists, NO_DISK_SPACE_FOUND is returned.
+ */
+static uint find_empty_space(struct obj_device_private* device, uint size,
+                             uint* offset) {
+  ushort n;
+
+  if (size == 0) {
+    *offset = device->sb.storage_device_size;
+    return NO_ERR;
+  }
+  n = extent_best_fit(device->extents, size);
+  if (!n && shrink_objects_table(device)) {
+    n = extent_best_fit(device->extents, size);
+  }
+  if (!n && device->extents->bytes >= size) {
+    compact_objects(device);
+    n = extent_best_fit(device->extents, size);
   }
-  // 6. no solution without defragmentation.
-  return NULL;
+  if (!n) {
+    return NO_DISK_SPACE_FOUND;
+  }
+  *offset = EXTENT(device->extents, n)->offset +
+            EXTENT(device->extents, n)->size - size;
+  reserve_space(device, *offset, size);
+  return NO_ERR;
 }
 
 static void initialize_super_block_entry(struct obj_device_private* device) {
@@ -190,10 +761,16 @@ static void initialize_objects_table_entry(struct obj_device_private* device) {
   entry->occupied = 1;
 }
 
-// the disk lock should be held by the caller
+// the disk lock should be held by the caller. Dirty table blocks are
+// written along.
 static void write_super_block(struct obj_device_private* device) {
-  memmove(device->storage_holder->memory_storage, &device->sb,
-          sizeof(device->sb));
+  char* sb = device->storage_holder->memory_storage;
+
+  if (memcmp(sb, &device->sb, sizeof(device->sb)) != 0) {
+    memmove(sb, &device->sb, sizeof(device->sb));
+    metadata_dirty(device, 0, sizeof(device->sb));
+  }
+  flush_metadata(device);
 }
 
 uint get_object_table_size(struct obj_device_private* device) {
@@ -201,7 +778,17 @@ uint get_object_table_size(struct obj_device_private* device) {
          sizeof(objects_table_entry);
 }
 
-static void copy_bufs_vector_to_disk(char* address, vector bufs, uint size) {
+static void mark_bufs_clean(vector bufs) {
+  struct buf* curr_buf;
+
+  for (uint buf_index = 0; buf_index < bufs.vectorsize; buf_index++) {
+    memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
+    curr_buf->flags &= ~B_DIRTY;
+  }
+}
+
+static void copy_bufs_vector_to_disk(struct obj_device_private* device,
+                                     uint offset, vector bufs, uint size) {
   uint copied_bytes = 0;
   struct buf* curr_buf;
 
@@ -209,7 +796,8 @@ static void copy_bufs_vector_to_disk(char* address, vector bufs, uint size) {
     for (uint buf_index = 0; buf_index < bufs.vectorsize; buf_index++) {
       uint block_size = min(BUF_DATA_SIZE, size - copied_bytes);
       memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
-      memmove(address + copied_bytes, curr_buf->data, block_size);
+      storage_write(device, offset + copied_bytes, (char*)curr_buf->data,
+                    block_size);
       curr_buf->flags &= ~B_DIRTY;
       copied_bytes += block_size;
     }
@@ -221,16 +809,28 @@ static struct memory_storage_holder memory_storage_holders[MAX_OBJ_DEVS_NUM] = {
     {.is_used = false},
 };
 
+// The index, free space and blobs of each memory_storage_holders entry.
+static struct obj_table_index obj_table_indexes[MAX_OBJ_DEVS_NUM];
+static struct obj_free_extents obj_free_extents[MAX_OBJ_DEVS_NUM];
+static struct obj_blobs obj_blobs[MAX_OBJ_DEVS_NUM];
+
 static void obj_dev_destroy(struct device* dev) {
   buf_cache_invalidate_blocks(dev);
   struct obj_device_private* device = dev_private(dev);
   device->storage_holder->is_used = false;
+  if (device->backing) {
+    deviceput(device->backing);
+  }
 }
 
-void init_obj_device(struct device* dev) {
+static struct obj_device_private* alloc_obj_device(struct device* dev) {
   struct obj_device_private* device = (struct obj_device_private*)kalloc();
+  static const struct device_ops obj_dev_ops = {
+      .destroy = obj_dev_destroy, .block_evicted = obj_cache_block_evicted};
+
+  XV6_ASSERT(sizeof(*device) <= PGSIZE);
   dev->private = device;
-  // with real device, we would read the block form the disk.
+  dev->ops = &obj_dev_ops;
   initsleeplock(&device->disklock, "disklock");
 
   // find a free memory_storage:
@@ -238,6 +838,9 @@ void init_obj_device(struct device* dev) {
   for (uint i = 0; i < MAX_OBJ_DEVS_NUM; i++) {
     if (!memory_storage_holders[i].is_used) {
       device->storage_holder = &memory_storage_holders[i];
+      device->index = &obj_table_indexes[i];
+      device->extents = &obj_free_extents[i];
+      device->blobs = &obj_blobs[i];
       memory_storage_holders[i].is_used = true;
       break;
     }
@@ -245,9 +848,26 @@ void init_obj_device(struct device* dev) {
 
   // should always find a free memory_storage!
   XV6_ASSERT(device->storage_holder != NULL);
+  // extents are numbered by ushort.
+  XV6_ASSERT(OBJ_EXTENTS_MAX < 0x10000);
+
+  device->backing = NULL;
+  device->backing_start = 0;
+  memset(device->dirty, 0, sizeof(device->dirty));
+  memset(&device->stats, 0, sizeof(device->stats));
+  memset(device->cache_stats, 0, sizeof(device->cache_stats));
+  device->dedup = 0;
+  device->first_free_slot = OBJ_ROOTINO - 1;
+  blobs_init(device->blobs);
+  extents_init(device->extents);
+  return device;
+}
 
+// Set up an empty store of `size` bytes.
+static void format_obj_device(struct obj_device_private* device, uint size) {
   // Super block initializing
-  device->sb.storage_device_size = STORAGE_DEVICE_SIZE;
+  device->sb.storage_device_size = size;
+  device->sb.magic = OBJ_SUPER_BLOCK_MAGIC;
   device->sb.objects_table_offset = sizeof(struct objsuperblock);
   device->sb.store_offset =
       device->sb.objects_table_offset +
@@ -266,28 +886,128 @@ void init_obj_device(struct device* dev) {
   for (uint i = 0; i < get_object_table_size(device); ++i) {
     get_objects_table_entry(device, i)->occupied = 0;
   }
-  write_super_block(device);
   initialize_super_block_entry(device);
   initialize_objects_table_entry(device);
+  index_rebuild(device);
+  free_space(device, device->sb.store_offset, size - device->sb.store_offset);
+  metadata_dirty(device, 0, device->sb.store_offset);
+  write_super_block(device);
+}
 
-  static const struct device_ops obj_dev_ops = {.destroy = obj_dev_destroy};
+void init_obj_device(struct device* dev) {
+  format_obj_device(alloc_obj_device(dev), STORAGE_DEVICE_SIZE);
+}
 
-  dev->ops = &obj_dev_ops;
+/**
+ * Rebuild the free space and the shared blobs of a loaded store from the
+ * objects table. Objects of equal offset share a blob, an object that was
+ * the single reference of a blob owns its space from now on.
+ */
+static void rebuild_store_space(struct obj_device_private* device) {
+  uint* slots = device->extents->order;
+  uint n = 0, end = device->sb.store_offset;
+  objects_table_entry *entry, *prev = NULL;
+  ushort blob;
+
+  for (uint i = 2; i < get_object_table_size(device); i++) {
+    entry = get_objects_table_entry(device, i);
+    if (entry->occupied && entry->size > 0) slots[n++] = i;
+  }
+  sort_slots_by_offset(device, slots, n);
+
+  for (uint i = 0; i < n; prev = entry, i++) {
+    entry = get_objects_table_entry(device, slots[i]);
+    if (prev && prev->disk_offset == entry->disk_offset) {
+      if (prev->size != entry->size) panic("obj_disk: overlapping objects");
+      blob = blob_at(device, entry->disk_offset, entry->size);
+      if (!blob) {
+        blob = blob_add(device,
+                        storage_digest(device, entry->disk_offset, entry->size),
+                        entry->disk_offset, entry->size);
+        if (!blob) panic("obj_disk: out of blobs");
+      }
+      BLOB(device, blob)->refs++;
+      device->stats.dedup_logical_bytes += entry->size;
+      continue;
+    }
+    if (entry->disk_offset < end ||
+        entry->disk_offset + entry->size > device->sb.storage_device_size) {
+      panic("obj_disk: overlapping objects");
+    }
+    free_space(device, end, entry->disk_offset - end);
+    end = entry->disk_offset + entry->size;
+  }
+  free_space(device, end, device->sb.storage_device_size - end);
+}
+
+// Load a store formatted before, return whether there was one.
+static int load_obj_device(struct obj_device_private* device, uint size) {
+  struct objsuperblock sb;
+
+  storage_read(device, 0, (char*)&sb, sizeof(sb));
+  if (sb.magic != OBJ_SUPER_BLOCK_MAGIC || sb.storage_device_size != size ||
+      sb.objects_table_offset != sizeof(sb) ||
+      sb.store_offset > STORAGE_DEVICE_SIZE || sb.store_offset > size) {
+    return 0;
+  }
+  device->sb = sb;
+  storage_read(device, 0, device->storage_holder->memory_storage,
+               sb.store_offset);
+  index_rebuild(device);
+  rebuild_store_space(device);
+  return 1;
+}
+
+uint init_block_obj_device(struct device* dev, struct device* backing,
+                           uint start, uint nblocks) {
+  struct obj_device_private* device;
+
+  if (nblocks > 0xffffffff / BSIZE ||
+      nblocks * BSIZE < sizeof(struct objsuperblock) +
+                            INITIAL_OBJECT_TABLE_SIZE *
+                                sizeof(objects_table_entry)) {
+    return NO_DISK_SPACE_FOUND;
+  }
+  device = alloc_obj_device(dev);
+  deviceget(backing);
+  device->backing = backing;
+  device->backing_start = start;
+  if (!load_obj_device(device, nblocks * BSIZE)) {
+    format_obj_device(device, nblocks * BSIZE);
+  }
+  return NO_ERR;
 }
 
 uint find_space_and_populate_entry(struct obj_device_private* device,
                                    objects_table_entry* entry, const char* name,
                                    vector bufs, uint size) {
-  void* address = find_empty_space(device, size);
-  if (!address) {
-    return NO_DISK_SPACE_FOUND;
+  uint digest = 0;
+  ushort blob = 0;
+
+  if (device->dedup && size > 0) {
+    digest = bufs_digest(bufs, size);
+    blob = blob_find(device, digest, bufs, size);
+  }
+  if (blob) {
+    blob_reference(device, entry, blob);
+    mark_bufs_clean(bufs);
+  } else {
+    uint offset;
+    if (find_empty_space(device, size, &offset) != NO_ERR) {
+      return NO_DISK_SPACE_FOUND;
+    }
+    entry->disk_offset = offset;
+    entry->size = size;
+    copy_bufs_vector_to_disk(device, offset, bufs, size);
+    device->sb.bytes_occupied += size;
+    if (device->dedup && size > 0) {
+      blob_add(device, digest, entry->disk_offset, size);
+    }
   }
   memmove(entry->object_id, name, obj_id_bytes(name));
-  entry->disk_offset = address - (void*)device->storage_holder->memory_storage;
-  entry->size = size;
-  copy_bufs_vector_to_disk(address, bufs, size);
   entry->occupied = 1;
-  device->sb.bytes_occupied += size;
+  index_insert(device, entry - get_objects_table_entry(device, 0));
+  table_entry_dirty(device, entry - get_objects_table_entry(device, 0));
   device->sb.occupied_objects += 1;
   write_super_block(device);
 
@@ -307,27 +1027,38 @@ uint add_object(struct device* dev, const char* name, vector bufs, uint size) {
   // 2. find first unoccupied entry of the objects table
   // then occupy it and allocate space for the new object.
   acquiresleep(&device->disklock);
-  uint leftmost_disk_allocation_offset = STORAGE_DEVICE_SIZE;
-  // We start to search after the superblock and entries table,
-  // minus 1 since indexing starts in 0
+  // We start to search after the superblock, entries table and the
+  // entries known to be occupied.
   uint i;
-  for (i = OBJ_ROOTINO - 1; i < get_object_table_size(device); i++) {
+  for (i = device->first_free_slot; i < get_object_table_size(device); i++) {
     objects_table_entry* entry = get_objects_table_entry(device, i);
-    if (entry->disk_offset < leftmost_disk_allocation_offset)
-      leftmost_disk_allocation_offset = entry->disk_offset;
     if (!entry->occupied) {
+      device->first_free_slot = i;
       err = find_space_and_populate_entry(device, entry, name, bufs, size);
       goto unlock;
     }
   }
   // 3. all entries are occupied. is it possible to extend the table?
-  // find offset of the first object.
-  if (leftmost_disk_allocation_offset - device->sb.store_offset >=
-      sizeof(objects_table_entry)) {
+  // the store must begin with enough free space, compact it if the free
+  // space is scattered. A block device mirrors the table in RAM, which
+  // bounds it.
+  if (device->sb.store_offset + sizeof(objects_table_entry) >
+      STORAGE_DEVICE_SIZE) {
+    err = OBJECTS_TABLE_FULL;
+    goto unlock;
+  }
+  if (store_head_space(device) < sizeof(objects_table_entry) &&
+      device->extents->bytes >= sizeof(objects_table_entry) + size) {
+    compact_objects(device);
+  }
+  if (store_head_space(device) >= sizeof(objects_table_entry)) {
+    reserve_space(device, device->sb.store_offset,
+                  sizeof(objects_table_entry));
     device->sb.store_offset =
         device->sb.store_offset + sizeof(objects_table_entry);
     device->sb.bytes_occupied += sizeof(objects_table_entry);
     objects_table_entry* entry = get_objects_table_entry(device, i);
+    entry->occupied = 0;
     err = find_space_and_populate_entry(device, entry, name, bufs, size);
     goto unlock;
   }
@@ -335,6 +1066,8 @@ uint add_object(struct device* dev, const char* name, vector bufs, uint size) {
   err = OBJECTS_TABLE_FULL;
 
 unlock:
+  // The table may have been compacted or resized before a failure.
+  write_super_block(device);
   releasesleep(&device->disklock);
 end:
   return err;
@@ -344,10 +1077,12 @@ uint write_object(struct device* dev, const char* name, vector bufs,
                   uint objectsize) {
   uint err;
   struct obj_device_private* device = dev_private(dev);
-  char* obj_addr;
+  uint obj_offset;
+  uint digest = 0;
+  ushort blob;
 
   // 1. check for name contraints validity
-  err = check_rewrite_object_validality(objectsize, name);
+  err = check_rewrite_object_validality(device, objectsize, name);
   if (err != NO_ERR) {
     goto end;
   }
@@ -359,40 +1094,240 @@ uint write_object(struct device* dev, const char* name, vector bufs,
     goto unlock;
   }
   objects_table_entry* entry = get_objects_table_entry(device, i);
+  if (device->dedup && objectsize > 0) {
+    digest = bufs_digest(bufs, objectsize);
+    blob = blob_find(device, digest, bufs, objectsize);
+    if (blob) {
+      // 3.D - the content is stored already, point the object at it.
+      if (blob != blob_at(device, entry->disk_offset, entry->size)) {
+        release_entry_space(device, entry);
+        blob_reference(device, entry, blob);
+      }
+      mark_bufs_clean(bufs);
+      goto written;
+    }
+  }
+
+  blob = blob_at(device, entry->disk_offset, entry->size);
+  if (blob && BLOB(device, blob)->refs > 1) {
+    // 3.C - the object shares its blob, the new content goes elsewhere.
+    err = find_empty_space(device, objectsize, &obj_offset);
+    if (err != NO_ERR) {
+      goto unlock;
+    }
+    release_entry_space(device, entry);
+    device->sb.bytes_occupied += objectsize;
+    entry->size = objectsize;
+    entry->disk_offset = obj_offset;
+    goto copy;
+  }
+
   device->sb.bytes_occupied -= entry->size;
   if (entry->size >= objectsize) {
     // 3.A - the new object written is smaller or equals the the original.
-    obj_addr = device->storage_holder->memory_storage + entry->disk_offset;
+    obj_offset = entry->disk_offset;
+    free_space(device, entry->disk_offset + objectsize,
+               entry->size - objectsize);
     entry->size = objectsize;
   } else {
-    // 3.B - the new object is larger
+    // 3.B - the new object is larger. It is left out of a compaction, its
+    // old content is not needed.
+    free_space(device, entry->disk_offset, entry->size);
     entry->occupied = 0;
-    device->sb.occupied_objects -= 1;
-    obj_addr = find_empty_space(device, objectsize);
+    err = find_empty_space(device, objectsize, &obj_offset);
     entry->occupied = 1;
-    device->sb.occupied_objects += 1;
-    if (!obj_addr) {
-      releasesleep(&device->disklock);
-      return NO_DISK_SPACE_FOUND;
+    if (err != NO_ERR) {
+      reserve_space(device, entry->disk_offset, entry->size);
+      device->sb.bytes_occupied += entry->size;
+      goto unlock;
     }
     entry->size = objectsize;
-    entry->disk_offset =
-        (void*)obj_addr - (void*)device->storage_holder->memory_storage;
+    entry->disk_offset = obj_offset;
+  }
+  device->sb.bytes_occupied += objectsize;
+  // The content of a blob the object owned is replaced.
+  if (blob) {
+    device->stats.dedup_logical_bytes -= BLOB(device, blob)->size;
+    blob_drop(device, blob);
   }
 
+copy:
   // 4. Write the object content
-  copy_bufs_vector_to_disk(obj_addr, bufs, objectsize);
+  copy_bufs_vector_to_disk(device, obj_offset, bufs, objectsize);
+  if (device->dedup && objectsize > 0) {
+    blob_add(device, digest, entry->disk_offset, objectsize);
+  }
 
-  device->sb.bytes_occupied += objectsize;
-  write_super_block(device);
+written:
+  table_entry_dirty(device, i);
   err = NO_ERR;
 
 unlock:
+  // The table may also have been compacted or resized before a failure.
+  write_super_block(device);
   releasesleep(&device->disklock);
 end:
   return err;
 }
 
+/**
+ * Give the object of `entry` content of its own, before it is changed in
+ * place. A shared blob is copied to new space, a blob the object owns is
+ * forgotten.
+ */
+static uint unshare_entry(struct obj_device_private* device,
+                          objects_table_entry* entry) {
+  ushort blob = blob_at(device, entry->disk_offset, entry->size);
+  uint offset;
+
+  if (!blob) return NO_ERR;
+  if (BLOB(device, blob)->refs == 1) {
+    device->stats.dedup_logical_bytes -= entry->size;
+    blob_drop(device, blob);
+    return NO_ERR;
+  }
+  if (find_empty_space(device, entry->size, &offset) != NO_ERR) {
+    return NO_DISK_SPACE_FOUND;
+  }
+  // A compaction looking for the space may have moved the blob.
+  storage_move(device, offset, entry->disk_offset, entry->size);
+  release_entry_space(device, entry);
+  device->sb.bytes_occupied += entry->size;
+  entry->disk_offset = offset;
+  return NO_ERR;
+}
+
+/**
+ * Grow the object of `entry` to `size` bytes, keeping its content. It is
+ * extended in place when the space after it is free. Else it moves to the
+ * beginning of a free extent with room for as much again, when there is
+ * one, so an object that keeps growing is seldom moved.
+ */
+static uint grow_entry(struct obj_device_private* device,
+                       objects_table_entry* entry, uint size) {
+  struct obj_free_extents* e = device->extents;
+  uint end = entry->disk_offset + entry->size;
+  uint offset;
+  ushort n;
+
+  if (entry->size > 0) {
+    n = extent_floor(e, end);
+    if (n && EXTENT(e, n)->offset == end &&
+        EXTENT(e, n)->size >= size - entry->size) {
+      reserve_space(device, end, size - entry->size);
+      goto grown;
+    }
+  }
+  n = size < 0x80000000 ? extent_best_fit(e, 2 * size) : 0;
+  if (n) {
+    offset = EXTENT(e, n)->offset;
+    reserve_space(device, offset, size);
+  } else if (find_empty_space(device, size, &offset) != NO_ERR) {
+    return NO_DISK_SPACE_FOUND;
+  }
+  // A compaction looking for the space may have moved the object.
+  storage_move(device, offset, entry->disk_offset, entry->size);
+  free_space(device, entry->disk_offset, entry->size);
+  entry->disk_offset = offset;
+
+grown:
+  device->sb.bytes_occupied += size - entry->size;
+  entry->size = size;
+  return NO_ERR;
+}
+
+uint write_object_range(struct device* dev, const char* name, vector bufs,
+                        uint first_block, uint objectsize) {
+  uint err;
+  struct obj_device_private* device = dev_private(dev);
+  struct buf* curr_buf;
+  uint offset;
+
+  // 1. check for name contraints validity
+  err = check_rewrite_object_validality(device, objectsize, name);
+  if (err != NO_ERR) {
+    goto end;
+  }
+  // 2. name is ok. get the index off the object's entry
+  acquiresleep(&device->disklock);
+  uint i;
+  err = get_objects_table_index(device, name, &i);
+  if (err != NO_ERR) {
+    goto unlock;
+  }
+  objects_table_entry* entry = get_objects_table_entry(device, i);
+  objects_table_entry prev = *entry;
+  // 3. the content is about to change in place, it cannot be shared.
+  err = unshare_entry(device, entry);
+  if (err != NO_ERR) {
+    goto unlock;
+  }
+  // 4. resize the object
+  if (objectsize > entry->size) {
+    err = grow_entry(device, entry, objectsize);
+    if (err != NO_ERR) {
+      goto entry_written;
+    }
+  } else if (objectsize < entry->size) {
+    free_space(device, entry->disk_offset + objectsize,
+               entry->size - objectsize);
+    device->sb.bytes_occupied -= entry->size - objectsize;
+    entry->size = objectsize;
+  }
+  // 5. write the blocks, up to the end of the object
+  for (uint buf_index = 0; buf_index < bufs.vectorsize; buf_index++) {
+    offset = (first_block + buf_index) * BUF_DATA_SIZE;
+    memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
+    if (offset < objectsize) {
+      storage_write(device, entry->disk_offset + offset,
+                    (char*)curr_buf->data,
+                    min(BUF_DATA_SIZE, objectsize - offset));
+    }
+    curr_buf->flags &= ~B_DIRTY;
+  }
+
+entry_written:
+  // The entry may have been moved even when growing failed.
+  if (memcmp(&prev, entry, sizeof(prev)) != 0) {
+    table_entry_dirty(device, i);
+  }
+
+unlock:
+  // The table may also have been compacted or resized before a failure.
+  write_super_block(device);
+  releasesleep(&device->disklock);
+end:
+  return err;
+}
+
+uint compact_obj_device(struct device* dev) {
+  struct obj_device_private* device = dev_private(dev);
+  uint moved;
+
+  acquiresleep(&device->disklock);
+  moved = compact_objects(device);
+  flush_metadata(device);
+  releasesleep(&device->disklock);
+
+  return moved;
+}
+
+void obj_device_get_stats(struct device* dev, struct obj_disk_stats* stats) {
+  struct obj_device_private* device = dev_private(dev);
+
+  acquiresleep(&device->disklock);
+  *stats = device->stats;
+  releasesleep(&device->disklock);
+}
+
+void set_obj_device_dedup(struct device* dev, int dedup) {
+  struct obj_device_private* device = dev_private(dev);
+
+  acquiresleep(&device->disklock);
+  device->dedup = dedup;
+  releasesleep(&device->disklock);
+}
+
 uint object_size(struct device* dev, const char* name, uint* output) {
   uint err = NO_ERR;
   struct obj_device_private* device = dev_private(dev);
@@ -420,7 +1355,6 @@ end:
 uint get_object(struct device* dev, const char* name, vector bufs) {
   uint err = NO_ERR;
   struct obj_device_private* device = dev_private(dev);
-  char* obj_addr;
   struct buf* curr_buf;
   uint copied_bytes = 0;
 
@@ -445,12 +1379,12 @@ uint get_object(struct device* dev, const char* name, vector bufs) {
     return BUFFER_TOO_SMALL;
   }
 
-  obj_addr = device->storage_holder->memory_storage + entry->disk_offset;
   for (uint buf_index = 0; buf_index < bufs.vectorsize; buf_index++) {
     uint block_size = min(BUF_DATA_SIZE,  // NOLINT(build/include_what_you_use)
                           entry->size - copied_bytes);
     memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
-    memmove(curr_buf->data, obj_addr + copied_bytes, block_size);
+    storage_read(device, entry->disk_offset + copied_bytes,
+                 (char*)curr_buf->data, block_size);
     curr_buf->flags |= B_VALID;
     copied_bytes += block_size;
   }
@@ -463,6 +1397,44 @@ end:
   return err;
 }
 
+uint get_object_range(struct device* dev, const char* name, vector bufs,
+                      uint first_block) {
+  uint err = NO_ERR;
+  struct obj_device_private* device = dev_private(dev);
+  struct buf* curr_buf;
+  uint offset, block_size;
+
+  if (strlen(name) > MAX_OBJECT_NAME_LENGTH) {
+    err = OBJECT_NAME_TOO_LONG;
+    goto end;
+  }
+  acquiresleep(&device->disklock);
+  uint i;
+  err = get_objects_table_index(device, name, &i);
+  if (err != NO_ERR) {
+    goto unlock;
+  }
+  objects_table_entry* entry = get_objects_table_entry(device, i);
+  for (uint buf_index = 0; buf_index < bufs.vectorsize; buf_index++) {
+    memmove_from_vector((char*)&curr_buf, bufs, buf_index, 1);
+    if (curr_buf->flags & B_VALID) {
+      continue;
+    }
+    offset = (first_block + buf_index) * BUF_DATA_SIZE;
+    block_size =
+        offset < entry->size ? min(BUF_DATA_SIZE, entry->size - offset) : 0;
+    storage_read(device, entry->disk_offset + offset, (char*)curr_buf->data,
+                 block_size);
+    memset(curr_buf->data + block_size, 0, BUF_DATA_SIZE - block_size);
+    curr_buf->flags |= B_VALID;
+  }
+
+unlock:
+  releasesleep(&device->disklock);
+end:
+  return err;
+}
+
 uint delete_object(struct device* dev, const char* name) {
   uint err = NO_ERR;
   struct obj_device_private* device = dev_private(dev);
@@ -478,9 +1450,12 @@ uint delete_object(struct device* dev, const char* name) {
     goto unlock;
   }
   objects_table_entry* entry = get_objects_table_entry(device, i);
+  index_remove(device, i);
+  release_entry_space(device, entry);
   entry->occupied = 0;
+  table_entry_dirty(device, i);
+  device->first_free_slot = min(device->first_free_slot, i);
   device->sb.occupied_objects -= 1;
-  device->sb.bytes_occupied -= entry->size;
   write_super_block(device);
   err = NO_ERR;
 
@@ -492,28 +1467,26 @@ end:
 
 uint check_add_object_validity(struct obj_device_private* device, uint size,
                                const char* name) {
-  // currently, because we don't use hash function, we must first scan the
-  // table and check if the object already exists.
+  uint i;
+
   if (strlen(name) > MAX_OBJECT_NAME_LENGTH) {
     return OBJECT_NAME_TOO_LONG;
   }
-  if (STORAGE_DEVICE_SIZE < size) {
+  if (device->sb.storage_device_size < size) {
     return NO_DISK_SPACE_FOUND;
   }
-  for (uint i = 0; i < get_object_table_size(device); ++i) {
-    if (get_objects_table_entry(device, i)->occupied &&
-        obj_id_cmp(get_objects_table_entry(device, i)->object_id, name) == 0) {
-      return OBJECT_EXISTS;
-    }
+  if (get_objects_table_index(device, name, &i) == NO_ERR) {
+    return OBJECT_EXISTS;
   }
   return NO_ERR;
 }
 
-uint check_rewrite_object_validality(uint size, const char* name) {
+uint check_rewrite_object_validality(struct obj_device_private* device,
+                                     uint size, const char* name) {
   if (strlen(name) > MAX_OBJECT_NAME_LENGTH) {
     return OBJECT_NAME_TOO_LONG;
   }
-  if (STORAGE_DEVICE_SIZE < size) {
+  if (device->sb.storage_device_size < size) {
     return NO_DISK_SPACE_FOUND;
   }
   return NO_ERR;
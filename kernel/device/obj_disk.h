@@ -3,7 +3,9 @@
 
 #include "device.h"
 #include "fs/obj_fs.h"
+#include "fsdefs.h"
 #include "kvector.h"
+#include "param.h"
 #include "sleeplock.h"
 #include "types.h"
 
@@ -34,11 +36,19 @@
  * is saved in the super-block of the file system as well as the position of
  * it.
  *
- * Hardware Mock
- * =============
- * In the current implementation, we use a "mock" storage device which saves
- * the data in the RAM. In future projcets, we can integrate with real
- * hardware and only this file would change. It would become asynchrony and
+ * Storage
+ * =======
+ * A device keeps its storage either in RAM, as a "mock" storage device, or
+ * on a region of a block device, see `init_block_obj_device`. On a block
+ * device only the super block and the objects table are mirrored in RAM.
+ * Object bytes are read and written through the buffer cache of the block
+ * device, and only the blocks whose bytes change are written. Table entries
+ * changed by an operation mark their blocks dirty, and those blocks are
+ * written with the super block when the operation ends. Writes are not
+ * journaled, a crash in the middle of an operation can leave the table and
+ * the objects out of sync.
+ * In future projcets, we can integrate with object storage hardware and
+ * only this file would change. It would become asynchrony and
  * handle hardware interrupts. The output interface this layer exports is
  * object based only. Hence, it doesn't matter for upper layers, if the
  * storage device handle the objects table itself or the kernel does it.
@@ -55,17 +65,17 @@
  *
  * The inner implementation has the following structure:
  * The memory is an array of size `STORAGE_DEVICE_SIZE` which must be defined.
- * The super block is located at offset 0 and the table right after it.
+ * The super block is located at offset 0 and the table right after it. On a
+ * block device the array holds them alone, which bounds the table.
  *
  * Futher improvments
  * ==================
  * Currently, the objects table is implemented in a naive way of storing the
- * object's name as it's id. In the future, better implementation can be
- * implemented. One such implementation would use hash method on the name.
- * This hash method should be collision-free (sha256 would be sufficient
- * here). This would provide us the abillity to find the object without
- * full scanning the objects-table. In addition, this method would set all
- * the ids to be with the same length in bytes.
+ * object's name as it's id. Lookups don't scan the table: an in-memory hash
+ * index maps ids to table slots (see `struct obj_table_index`). In the
+ * future, the id itself could be a collision-free hash of the name (sha256
+ * would be sufficient here), which would set all the ids to be with the
+ * same length in bytes.
  * Because we currently doesn't use such method, we set an upper length for
  * the objects name. Hence, a relevant error can occour when calling
  *
@@ -85,6 +95,9 @@
 // Or shrink, making room for content storage.
 #define INITIAL_OBJECT_TABLE_SIZE 200
 
+// Identifies a formatted store on a block device.
+#define OBJ_SUPER_BLOCK_MAGIC 0x6f626a73
+
 // Possible errors:
 #define NO_ERR 0
 #define OBJECT_EXISTS 1
@@ -108,6 +121,7 @@ struct objsuperblock {
   struct vfs_superblock vfs_sb;
   // determines the limit between object table space and the store itself
   uint store_offset;
+  uint magic;
 };
 
 struct memory_storage_holder {
@@ -115,10 +129,52 @@ struct memory_storage_holder {
   bool is_used;
 };
 
+struct obj_disk_stats {
+  uint compactions;          // times the store was compacted.
+  uint bytes_moved;          // object bytes moved by compactions.
+  uint dedup_hits;           // objects stored by referencing equal content.
+  uint dedup_logical_bytes;  // size of the objects stored in blobs.
+  uint dedup_stored_bytes;   // size of the blobs themselves.
+  uint blocks_written;       // blocks written to the backing device.
+};
+
+// Statistics of the objects cache of a device, see obj_cache.h.
+struct obj_cache_stats {
+  uint hits;               // reads and partial writes found in the cache.
+  uint misses;             // reads and partial writes that went to the store.
+  uint bytes_read;         // object bytes read from the store.
+  uint blocks_prefetched;  // blocks read ahead of a missed read.
+  uint blocks_evicted;     // cached blocks the buffer cache evicted.
+};
+
+// Blocks of the backing device the super block and the table can span.
+#define OBJ_METADATA_BLOCKS ((STORAGE_DEVICE_SIZE + BSIZE - 1) / BSIZE)
+
 struct obj_device_private {
   struct sleeplock disklock;
   struct memory_storage_holder* storage_holder;
+  struct obj_table_index* index;
+  struct obj_free_extents* extents;
+  struct obj_blobs* blobs;
+  // Store new objects by content, see `struct obj_blobs`.
+  int dedup;
+  // No table entry below this one is unoccupied.
+  uint first_free_slot;
+  struct obj_disk_stats stats;
   struct objsuperblock sb;
+  // The device the storage is kept on from block `backing_start`, NULL
+  // when it is kept in RAM.
+  struct device* backing;
+  uint backing_start;
+  // Blocks of the super block and the table to write to the backing device.
+  uchar dirty[(OBJ_METADATA_BLOCKS + 7) / 8];
+  // Scratch for object bytes of the backing device.
+  char bounce[BSIZE];
+  // Counters of the objects cache, each CPU counting in its own cache line
+  // of the device.
+  struct {
+    struct obj_cache_stats stats;
+  } __attribute__((aligned(64))) cache_stats[NCPU];
 };
 
 typedef struct objects_table_entry {
@@ -132,6 +188,87 @@ typedef struct objects_table_entry {
   int occupied;
 } objects_table_entry;
 
+// Buckets of the object id index of a device.
+#define OBJ_INDEX_BUCKETS 1024
+// Most objects table entries a device can hold.
+#define OBJ_INDEX_MAX_ENTRIES \
+  (STORAGE_DEVICE_SIZE / sizeof(objects_table_entry))
+
+/**
+ * In-memory hash index from object id to objects table slot. It is built
+ * by `init_obj_device` and kept in sync by `add_object` and
+ * `delete_object`, under the disk lock. Chains link slot + 1, so 0 ends
+ * them.
+ */
+struct obj_table_index {
+  uint buckets[OBJ_INDEX_BUCKETS];
+  uint next[OBJ_INDEX_MAX_ENTRIES];
+};
+
+// Most free extents a device can have. Every extent but the last is
+// followed by an object, which holds a table entry, so this bounds the
+// extents of a backing device of any size.
+#define OBJ_EXTENTS_MAX (OBJ_INDEX_MAX_ENTRIES + 1)
+
+enum { OBJ_EXTENTS_BY_OFFSET, OBJ_EXTENTS_BY_SIZE, OBJ_EXTENTS_TREES };
+
+struct obj_extent {
+  uint offset;
+  uint size;
+  // Left and right children in each tree, 0 is none.
+  ushort child[OBJ_EXTENTS_TREES][2];
+};
+
+/**
+ * The free space of the store, `[store_offset, STORAGE_DEVICE_SIZE)` minus
+ * the objects, as maximal extents. Each extent is kept in two treaps: one
+ * ordered by offset to coalesce neighbours on free, and one ordered by
+ * size (then offset) for best-fit allocation, so both take O(log n).
+ * Nodes are numbered from 1 and unused ones are chained through
+ * `child[0][0]` from `free`.
+ */
+struct obj_free_extents {
+  ushort root[OBJ_EXTENTS_TREES];
+  ushort free;
+  uint count;
+  uint bytes;  // total size of the extents.
+  struct obj_extent nodes[OBJ_EXTENTS_MAX + 1];
+  // Scratch for compaction: the occupied table slots, by offset.
+  uint order[OBJ_INDEX_MAX_ENTRIES];
+};
+
+// Most blobs a device can have, objects beyond are stored apart.
+#define OBJ_BLOBS_MAX 1024
+#define OBJ_BLOB_BUCKETS 256
+
+struct obj_blob {
+  uint digest;
+  uint offset;
+  uint size;
+  uint refs;  // 0 when unused.
+  ushort next_by_digest;
+  ushort next_by_offset;
+};
+
+/**
+ * Content addressing. In dedup mode an object's content is stored once as
+ * a blob, keyed by its digest, and objects of equal content share the blob
+ * by pointing their table entries at it. A blob is released with its last
+ * reference, and rewriting a shared object moves it to a blob of its own.
+ * Digests only narrow the search, equal content is confirmed by comparing
+ * the bytes. Objects written outside dedup mode, or when no blob is left,
+ * own their space as usual, and are told apart by not having a blob at
+ * their offset.
+ * Blobs are numbered from 1, 0 ends the chains, and unused blobs are
+ * chained through `next_by_digest` from `free`.
+ */
+struct obj_blobs {
+  ushort by_digest[OBJ_BLOB_BUCKETS];
+  ushort by_offset[OBJ_BLOB_BUCKETS];
+  ushort free;
+  struct obj_blob blobs[OBJ_BLOBS_MAX + 1];
+};
+
 int obj_id_cmp(const char* p, const char* q);
 uint obj_id_bytes(const char* object_id);
 
@@ -144,6 +281,17 @@ uint obj_id_bytes(const char* object_id);
  */
 void init_obj_device(struct device* dev);
 
+/**
+ * Set the state of the driver for a store kept on `nblocks` blocks of
+ * `backing` from block `start`. A store formatted before is loaded,
+ * anything else is formatted. The device holds a reference to `backing`.
+ * The method returns a code indicates the error occured.
+ *   NO_ERR              - no error occured.
+ *   NO_DISK_SPACE_FOUND - the region is too small for a store.
+ */
+uint init_block_obj_device(struct device* dev, struct device* backing,
+                           uint start, uint nblocks);
+
 /**
  * Writes a new object of size `size` to the disk.
  * The name of the object is specified by the parameter `name` using a null
@@ -173,6 +321,41 @@ uint add_object(struct device* dev, const char* name, vector bufs, uint size);
 uint write_object(struct device* dev, const char* name, vector bufs,
                   uint objectsize);
 
+/**
+ * Writes the buffers of `bufs` as the blocks of the object from block
+ * `first_block` on, and sets the size of the object to `objectsize`. Only
+ * the bytes of the blocks below `objectsize` are written, and the other
+ * blocks of the object keep their content, so the caller passes just the
+ * blocks it changed. An object growing is extended in place when it can.
+ * The object stops sharing its content with others in dedup mode.
+ * The method returns a code indicates the error occured.
+ *   NO_ERR              - no error occured.
+ *   OBJECT_NOT_EXISTS   - no object with this name exists.
+ *   NO_DISK_SPACE_FOUND - no space for the object to grow.
+ */
+uint write_object_range(struct device* dev, const char* name, vector bufs,
+                        uint first_block, uint objectsize);
+
+/**
+ * Slide all the objects against the end of the device so the free space of
+ * the store becomes a single extent. Objects keep their ids, and cached
+ * blocks are keyed by id and block number, so they stay valid.
+ * Compaction also runs when an allocation fails although enough free bytes
+ * exist. Returns the number of object bytes moved.
+ */
+uint compact_obj_device(struct device* dev);
+
+/**
+ * Copies the compaction and dedup statistics of the device to `stats`.
+ */
+void obj_device_get_stats(struct device* dev, struct obj_disk_stats* stats);
+
+/**
+ * Turns dedup mode of the device on or off. It applies to objects written
+ * from now on, existing blobs stay shared.
+ */
+void set_obj_device_dedup(struct device* dev, int dedup);
+
 /**
  * Delete the specific object from the objects table. The bytes on the disk
  * does not change.
@@ -200,6 +383,17 @@ uint object_size(struct device* dev, const char* name, uint* output);
  */
 uint get_object(struct device* dev, const char* name, vector bufs);
 
+/**
+ * Read the blocks of the object from block `first_block` on into the
+ * buffers of `bufs` that are not valid yet. Bytes past the end of the
+ * object read as zeros.
+ * The method returns a code indicates the error occured.
+ *   NO_ERR            - no error occured.
+ *   OBJECT_NOT_EXISTS - no object with this name exists.
+ */
+uint get_object_range(struct device* dev, const char* name, vector bufs,
+                      uint first_block);
+
 /**
  * The following methods are utility methods to help restore the disk in case
  * of state failures. The usages are fixing a corrupted disk by utility
@@ -209,7 +403,7 @@ uint get_object(struct device* dev, const char* name, vector bufs);
  */
 
 /**
- * Returns the object index in the objects table.
+ * Returns the object index in the objects table, using the index.
  *   NO_ERR            - no error occured.
  *   OBJECT_NOT_EXISTS - no object with this name exists.
  */
@@ -231,7 +425,8 @@ objects_table_entry* get_objects_table_entry(struct obj_device_private* device,
 //@{
 uint check_add_object_validity(struct obj_device_private* device, uint size,
                                const char* name);
-uint check_rewrite_object_validality(uint size, const char* name);
+uint check_rewrite_object_validality(struct obj_device_private* device,
+                                     uint size, const char* name);
 uint check_delete_object_validality(const char* name);
 //@}
 
@@ -21,8 +21,8 @@ int exec(char *path, char **argv) {
   struct vfs_inode *ip;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
-  elfv = newvector(sizeof(elf), 1);
-  phv = newvector(sizeof(ph), 1);
+  elfv = buffervector((char *)&elf, sizeof(elf), 1);
+  phv = buffervector((char *)&ph, sizeof(ph), 1);
   struct cgroup *cgroup = curproc->cgroup;
 
   begin_op();
@@ -37,11 +37,6 @@ int exec(char *path, char **argv) {
   // Check ELF header
   if (ip->i_op->readi(ip, 0, sizeof(elf), &elfv) != sizeof(elf)) goto bad;
 
-  // vectormemcmp("exec", elfv, 0, (char*)&elf, sizeof(struct elfhdr));
-  // Restore data from vector to object
-  memmove_from_vector((char *)(&elf), elfv, 0,
-                      elfv.vectorsize);  // now elfv is the source of elf.
-
   if (elf.magic != ELF_MAGIC) goto bad;
 
   if ((pgdir = setupkvm()) == 0) goto bad;
@@ -50,8 +45,6 @@ int exec(char *path, char **argv) {
   sz = 0;
   for (i = 0, off = elf.phoff; i < elf.phnum; i++, off += sizeof(ph)) {
     if (ip->i_op->readi(ip, off, sizeof(ph), &phv) != sizeof(ph)) goto bad;
-    memmove_from_vector((char *)(&ph), phv, 0,
-                        phv.vectorsize);  // now phv is the source of ph.
     if (ph.type != ELF_PROG_LOAD) continue;
     if (ph.memsz < ph.filesz) goto bad;
     if (ph.vaddr + ph.memsz < ph.vaddr) goto bad;
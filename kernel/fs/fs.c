@@ -1,11 +1,13 @@
 #include "fs.h"
 
+#include "fs/vfs_dcache.h"
 #include "fs/vfs_file.h"
 #include "native_fs.h"
 #include "obj_fs.h"
 
 void fsinit() {
   vfs_fileinit();  // file table
+  vfs_dcache_init();
   native_iinit();
   obj_fs_init();
 }
@@ -28,6 +28,7 @@
 #include "stat.h"
 #include "types.h"
 #include "vfs_fs.h"
+#include "vfs_icache.h"
 
 static const struct sb_ops native_ops;
 static const struct inode_operations native_inode_ops;
@@ -115,7 +116,7 @@ static void bfree(struct vfs_superblock *vfs_sb, uint b) {
 // sb.startinode. Each inode has a number, indicating its
 // position on the disk.
 //
-// The kernel keeps a cache of in-use inodes in memory
+// The kernel keeps a cache of inodes in memory
 // to provide a place for synchronizing access
 // to inodes used by multiple processes. The cached
 // inodes include book-keeping information that is
@@ -129,18 +130,18 @@ static void bfree(struct vfs_superblock *vfs_sb, uint b) {
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and current
+//   directories). iget() finds or creates a cache entry and
+//   increments its ref; iput() decrements ref. An entry
+//   whose ref is zero stays cached until it is recycled
+//   (see vfs_icache.h).
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -165,72 +166,46 @@ static void bfree(struct vfs_superblock *vfs_sb, uint b) {
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// entries. Since ip->ref indicates whether an entry is in use,
+// and ip->sb and ip->inum indicate which i-node an entry
+// holds, those fields are only used through the vfs_icache_*()
+// functions, which hold icache.lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
-struct {
-  struct spinlock lock;
-  struct native_inode inode[NINODE];
-} icache;
+static struct vfs_icache icache;
 
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct vfs_inode *iget(struct vfs_superblock *vfs_sb, uint inum) {
-  struct native_inode *ip, *empty;
+  struct vfs_inode *ip;
+  int first_ref;
   XV6_ASSERT(vfs_sb->private != NULL);
-  acquire(&icache.lock);
-
-  // Is the inode already cached?
-  empty = 0;
-  for (ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++) {
-    if (ip->vfs_inode.ref > 0 && ip->vfs_inode.sb == vfs_sb &&
-        ip->vfs_inode.inum == inum) {
-      ip->vfs_inode.ref++;
-      release(&icache.lock);
-      return &ip->vfs_inode;
-    }
-    if (empty == 0 && ip->vfs_inode.ref == 0)  // Remember empty slot.
-      empty = ip;
-  }
 
-  if (empty == 0 && ip->vfs_inode.ref == 0)  // Remember empty slot.
-    empty = ip;
+  ip = vfs_icache_get(&icache, vfs_sb, inum, &first_ref);
+  if (first_ref) {
+    struct native_superblock_private *sbp = sb_private(vfs_sb);
+    deviceget(sbp->dev);
 
-  // Recycle an inode cache entry.
-  if (empty == 0) {
-    panic("iget: no inodes");
+    /* Initiate inode operations for regular fs */
+    ip->i_op = &native_inode_ops;
   }
-
-  struct native_superblock_private *sbp = sb_private(vfs_sb);
-  deviceget(sbp->dev);
-
-  ip = empty;
-  ip->vfs_inode.sb = vfs_sb;
-  ip->vfs_inode.inum = inum;
-  ip->vfs_inode.ref = 1;
-  ip->vfs_inode.valid = 0;
-
-  /* Initiate inode operations for regular fs */
-  ip->vfs_inode.i_op = &native_inode_ops;
-
-  release(&icache.lock);
-  return &ip->vfs_inode;
+  return ip;
 }
 
 // PAGEBREAK!
 //  Allocate an inode on device dev.
 //  Mark it as allocated by  giving it type type.
-//  Returns an unlocked but allocated and referenced inode.
+//  Returns an unlocked but allocated and referenced inode, or 0 if the
+//  inode cache is full.
 static struct vfs_inode *ialloc(struct vfs_superblock *vfs_sb, file_type type) {
   int inum;
   struct buf *bp;
   struct native_dinode *dip;
+  struct vfs_inode *ip;
 
   XV6_ASSERT(vfs_sb->private != NULL);
   struct native_superblock_private *sbp = sb_private(vfs_sb);
@@ -239,11 +214,13 @@ static struct vfs_inode *ialloc(struct vfs_superblock *vfs_sb, file_type type) {
     bp = fs_bread(vfs_sb, IBLOCK(inum, *sb));
     dip = (struct native_dinode *)bp->data + inum % IPB;
     if (dip->base_dinode.type == 0) {  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->base_dinode.type = type;
-      log_write(bp);  // mark it allocated on the disk
+      if ((ip = iget(vfs_sb, inum)) != 0) {
+        memset(dip, 0, sizeof(*dip));
+        dip->base_dinode.type = type;
+        log_write(bp);  // mark it allocated on the disk
+      }
       buf_cache_release(bp);
-      return iget(vfs_sb, inum);
+      return ip;
     }
     buf_cache_release(bp);
   }
@@ -326,10 +303,7 @@ static void fsstart(struct vfs_superblock *vfs_sb) {
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct vfs_inode *idup(struct vfs_inode *ip) {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
-  return ip;
+  return vfs_icache_dup(&icache, ip);
 }
 
 // Lock the given inode.
@@ -379,10 +353,7 @@ static void iunlock(struct vfs_inode *ip) {
 static void iput(struct vfs_inode *ip) {
   acquiresleep(&ip->lock);
   if (ip->valid && ip->nlink == 0) {
-    acquire(&icache.lock);
-    int r = ip->ref;
-    release(&icache.lock);
-    if (r == 1) {
+    if (vfs_icache_last_ref(&icache, ip)) {
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
       ip->type = 0;
@@ -392,11 +363,7 @@ static void iput(struct vfs_inode *ip) {
   }
   releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
-  ip->ref--;
-  release(&icache.lock);
-
-  if (ip->ref == 0) {
+  if (vfs_icache_put(&icache, ip)) {
     struct native_superblock_private *sbp = sb_private(ip->sb);
     deviceput(sbp->dev);
   }
@@ -446,6 +413,26 @@ static uint bmap(struct native_inode *ip, uint bn) {
   panic("bmap: out of range");
 }
 
+// Return the disk block address of the nth block in inode ip,
+// or 0 if there is no such block.
+static uint bmap_lookup(struct native_inode *ip, uint bn) {
+  uint addr;
+  struct buf *bp;
+
+  if (bn < NDIRECT) return ip->addrs[bn];
+  bn -= NDIRECT;
+
+  if (bn < NINDIRECT) {
+    if ((addr = ip->addrs[NDIRECT]) == 0) return 0;
+    bp = fs_bread(ip->vfs_inode.sb, addr);
+    addr = ((uint *)bp->data)[bn];
+    buf_cache_release(bp);
+    return addr;
+  }
+
+  return 0;
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 static void stati(struct vfs_inode *vfs_ip, struct stat *st) {
@@ -467,6 +454,7 @@ static int readi(struct vfs_inode *vfs_ip, uint off, uint n,
                  vector *dstvector) {
   uint tot, m;
   struct buf *bp;
+  vector_cursor dst;
   struct native_inode *ip =
       container_of(vfs_ip, struct native_inode, vfs_inode);
 
@@ -483,20 +471,33 @@ static int readi(struct vfs_inode *vfs_ip, uint off, uint n,
   if (off > ip->vfs_inode.size || off + n < off) return -1;
   if (off + n > ip->vfs_inode.size) n = ip->vfs_inode.size - off;
 
-  unsigned int dstoffset = 0;
-  for (tot = 0; tot < n; tot += m, off += m, dstoffset += m) {
+  initvectorcursor(*dstvector, 0, &dst);
+  for (tot = 0; tot < n; tot += m, off += m) {
     bp = fs_bread(ip->vfs_inode.sb, bmap(ip, off / BSIZE));
     m = min(n - tot,
             BSIZE - off % BSIZE);  // NOLINT(build/include_what_you_use)
-    memmove_into_vector_bytes(*dstvector, dstoffset,
-                              (char *)(bp->data + off % BSIZE), m);
-    // vectormemcmp("readi", *dstvector, dstoffset, (char*)(bp->data + off %
-    // BSIZE), m);
+    cursorwrite(&dst, (char *)(bp->data + off % BSIZE), m);
     buf_cache_release(bp);
   }
   return n;
 }
 
+// Prefetch blocks [bn, bn + n) of inode in the background.
+// Caller must hold ip->lock.
+static void readahead(struct vfs_inode *vfs_ip, uint bn, uint n) {
+  uint addr, nblocks;
+  struct native_inode *ip =
+      container_of(vfs_ip, struct native_inode, vfs_inode);
+  struct native_superblock_private *sbp = sb_private(ip->vfs_inode.sb);
+
+  if (ip->vfs_inode.type == T_DEV) return;
+
+  nblocks = (ip->vfs_inode.size + BSIZE - 1) / BSIZE;
+  for (; n > 0 && bn < nblocks; bn++, n--) {
+    if ((addr = bmap_lookup(ip, bn)) != 0) breadahead(sbp->dev, addr);
+  }
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -623,12 +624,8 @@ static int dirlink(struct vfs_inode *vfs_dp, char *name, uint inum) {
 }
 
 void native_iinit() {
-  int i = 0;
-
-  initlock(&icache.lock, "icache");
-  for (i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].vfs_inode.lock, "inode");
-  }
+  vfs_icache_init(&icache, "nativefs", sizeof(struct native_inode),
+                  offsetof(struct native_inode, vfs_inode));
 }
 
 void native_fs_init(struct vfs_superblock *vfs_sb, struct device *dev) {
@@ -639,7 +636,8 @@ void native_fs_init(struct vfs_superblock *vfs_sb, struct device *dev) {
 
   vfs_sb->private = sbp;
   vfs_sb->ops = &native_ops;
-  vfs_sb->root_ip = iget(vfs_sb, ROOTINO);
+  if ((vfs_sb->root_ip = iget(vfs_sb, ROOTINO)) == 0)
+    panic("native_fs_init: no root inode");
   /* cprintf(
       "sb: size %d nblocks %d ninodes %d nlog %d logstart %d "
       "inodestart %d bmap start %d\n",
@@ -651,15 +649,7 @@ static void fsdestroy(struct vfs_superblock *vfs_sb) {
   struct native_superblock_private *sbp = sb_private(vfs_sb);
   iput(vfs_sb->root_ip);
   // Invalidate all inodes in the cache.
-  for (int i = 0; i < NINODE; i++) {
-    acquire(&icache.lock);
-    if (icache.inode[i].vfs_inode.ref > 0 &&
-        icache.inode[i].vfs_inode.sb == vfs_sb) {
-      cprintf("Destroying inode %d\n", i);
-      icache.inode[i].vfs_inode.ref = 0;
-    }
-    release(&icache.lock);
-  }
+  vfs_icache_purge(&icache, vfs_sb);
   deviceput(sbp->dev);
   kfree((char *)sbp);
 }
@@ -680,4 +670,5 @@ static const struct inode_operations native_inode_ops = {
     .writei = &writei,
     .iunlockput = &iunlockput,
     .isdirempty = &isdirempty,
+    .readahead = &readahead,
 };
@@ -4,11 +4,14 @@
 #include "device/buf.h"
 #include "device/buf_cache.h"
 #include "device/device.h"
+#include "mmu.h"
 #include "native_fs.h"
+#include "native_log.h"
 #include "param.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "spinlock.h"
+#include "steady_clock.h"
 #include "types.h"
 
 // Simple logging that allows concurrent FS system calls.
@@ -20,10 +23,24 @@
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
+// its start and end. Usually begin_op() just reserves
+// MAXOPBLOCKS log blocks for the FS system call and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// System calls that write more, like large file writes, reserve
+// log_op_blocks() with begin_op_blocks() and split their work
+// into transactions of that size.
+//
+// mkfs records the size of the log in the superblock, up to
+// MAXLOGBLOCKS data blocks.
+//
+// Commits are grouped: the last outstanding end_op() closes the
+// transaction by copying its blocks to their log entries in memory,
+// and only then writes them to the disk. The next transaction opens
+// as soon as the copy is done, and one commit writes every transaction
+// closed while the previous commit was writing. In async mode end_op()
+// returns right after closing, kwriteback commits within a tick and
+// log_sync() waits for the commit.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -32,58 +49,145 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, unless in async mode.
+//
+// Installing committed blocks to their home location is not: commit()
+// leaves them pinned in the buffer cache and the kwriteback kernel
+// thread writes them back once the committed part of the log passes
+// WRITEBACK_DIRTY_RATIO percent of the log, once the oldest committed
+// block is WRITEBACK_AGE ticks old, or once begin_op() runs out of
+// log space. Later transactions append after the closed blocks and
+// never absorb into them, so the on-disk log stays a valid redo log.
+
+#define WRITEBACK_DIRTY_RATIO 50  // % of the log committed before writeback
+#define WRITEBACK_AGE 100         // max ticks a committed block waits
+#define LOG_OP_SHARE 4  // a large op reserves up to 1/LOG_OP_SHARE of the log
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int block[MAXLOGBLOCKS];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
-  int outstanding;  // how many FS sys calls are executing.
-  int committing;   // in commit(), please wait.
+  int size;              // data blocks in the log.
+  int outstanding;       // how many FS sys calls are executing.
+  int reserved;          // log blocks reserved by outstanding FS sys calls.
+  int committing;        // closing the transaction, please wait.
+  int installing;        // writeback waits for outstanding ops, please wait.
+  int writing;           // commit() is writing closed transactions.
+  int closed;            // lh.block[0..closed) are in closed transactions.
+  int committed;         // lh.block[0..committed) are committed, not installed.
+  uint closed_txn;       // transactions closed so far.
+  uint committed_txn;    // transactions committed so far.
+  uint commits;          // log writes that committed transactions.
+  uint commit_us;        // total time of the commits, in microseconds.
+  int async;             // end_op() does not wait for the commit.
+  uint commit_tick;      // when lh.block[0] was closed.
+  int writeback_wanted;  // begin_op() is out of log space.
   struct device *dev;
   struct logheader lh;
+  struct cgroup *cgroup[MAXLOGBLOCKS];  // cgroup that dirtied each log block.
+  // Closed contents of each log block until commit() writes it. Kept out
+  // of the buffer cache, which already pins the blocks they copy.
+  char *stage[(MAXLOGBLOCKS * BSIZE + PGSIZE - 1) / PGSIZE];
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static uint close_trans(void);
+static void commit(uint txn);
+static void writeback_thread(void);
 
 void initlog(struct vfs_superblock *vfs_sb) {
   XV6_ASSERT(vfs_sb->private != NULL);
 
   struct native_superblock_private *sb = sb_private(vfs_sb);
-  if (sizeof(struct logheader) >= BSIZE) panic("initlog: too big logheader");
+  if (sizeof(struct logheader) > BSIZE) panic("initlog: too big logheader");
 
   struct native_superblock_private *sbp = sb_private(vfs_sb);
   deviceget(sbp->dev);
 
   initlock(&log.lock, "log");
   log.start = sb->sb.logstart;
-  log.size = sb->sb.nlog;
+  log.size = sb->sb.nlog - 1;  // the header takes a block
+  if (log.size > MAXLOGBLOCKS || log.size > MAXLOGSIZE)
+    panic("initlog: too big log");
+  if (log.size < MAXOPBLOCKS) panic("initlog: too small log");
+  for (int i = 0; i < (log.size * BSIZE + PGSIZE - 1) / PGSIZE; i++) {
+    if (log.stage[i] == 0 && (log.stage[i] = kalloc()) == 0)
+      panic("initlog: out of memory");
+  }
   log.dev = sbp->dev;
   recover_from_log();
+
+  static struct proc *writeback_proc;
+  if (writeback_proc == 0 &&
+      (writeback_proc = kthread_create("kwriteback", writeback_thread)) == 0)
+    panic("initlog: no kwriteback");
 }
 
-// Copy committed blocks from log to their home location
+// Whether the block of log entry tail is logged again before entry end.
+// A block committed by several transactions is installed from its
+// last copy only.
+static int logged_again(int tail, int end) {
+  int i;
+
+  for (i = tail + 1; i < end; i++) {
+    if (log.lh.block[i] == log.lh.block[tail]) return 1;
+  }
+  return 0;
+}
+
+// Copy committed blocks from log to their home location, BIO_BATCH_MAX
+// blocks at a time.
 static void install_trans(void) {
-  int tail;
+  struct buf *lbufs[BIO_BATCH_MAX], *dbufs[BIO_BATCH_MAX];
+  int tail = 0, i, n;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start + tail + 1);  // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]);    // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);                            // write dst to disk
-    cgroup_mem_stat_file_dirty_decr(dbuf->cgroup);
-    cgroup_mem_stat_file_dirty_aggregated_incr(dbuf->cgroup);
-    buf_cache_release(lbuf);
-    buf_cache_release(dbuf);
+  while (tail < log.lh.n) {
+    for (n = 0; n < BIO_BATCH_MAX && tail < log.lh.n; tail++) {
+      if (logged_again(tail, log.lh.n)) continue;
+      lbufs[n] = bget(log.dev, log.start + tail + 1);  // log block
+      dbufs[n] = bget(log.dev, log.lh.block[tail]);    // dst
+      n++;
+    }
+
+    bread_batch(lbufs, n);  // read log blocks
+    for (i = 0; i < n; i++) {
+      memmove(dbufs[i]->data, lbufs[i]->data, BSIZE);  // copy block to dst
+      buf_cache_release(lbufs[i]);
+    }
+    bwrite_batch(dbufs, n);  // write dst to disk
+    for (i = 0; i < n; i++) {
+      buf_cache_release(dbufs[i]);
+    }
+  }
+}
+
+// Copy committed blocks from the cache to their home location.
+// No FS system call is active, so the cached blocks hold exactly
+// the committed contents and the log blocks need not be read back.
+static void install_cached(void) {
+  struct buf *dbufs[BIO_BATCH_MAX];
+  int tail = 0, i, n;
+
+  while (tail < log.committed) {
+    for (n = 0; n < BIO_BATCH_MAX && tail < log.committed; tail++) {
+      cgroup_mem_stat_file_dirty_decr(log.cgroup[tail]);
+      cgroup_mem_stat_file_dirty_aggregated_incr(log.cgroup[tail]);
+      log.cgroup[tail] = 0;
+      if (logged_again(tail, log.committed)) continue;
+      dbufs[n++] = bread(log.dev, log.lh.block[tail]);
+    }
+
+    bwrite_batch(dbufs, n);
+    for (i = 0; i < n; i++) {
+      buf_cache_release(dbufs[i]);
+    }
   }
 }
 
@@ -99,15 +203,15 @@ static void read_head(void) {
   buf_cache_release(buf);
 }
 
-// Write in-memory log header to disk.
+// Write the first n entries of the in-memory log header to disk.
 // This is the true point at which the
-// current transaction commits.
-static void write_head(void) {
+// transactions holding them commit.
+static void write_head(int n) {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *)(buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
+  hb->n = n;
+  for (i = 0; i < n; i++) {
     hb->block[i] = log.lh.block[i];
   }
   bwrite(buf);
@@ -118,33 +222,53 @@ static void recover_from_log(void) {
   read_head();
   install_trans();  // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head();  // clear the log
+  write_head(0);  // clear the log
 }
 
-// called at the start of each FS system call.
-void begin_op(void) {
+// called at the start of each FS system call that writes up to
+// nblocks blocks.
+void begin_op_blocks(const int nblocks) {
   acquire(&log.lock);
+  // Fail before the op modifies anything rather than in log_write().
+  if (nblocks > log.size) panic("too big a transaction");
   while (1) {
-    if (log.committing) {
+    if (log.committing || log.installing) {
       sleep(&log, &log.lock);
-    } else if (log.lh.n + (log.outstanding + 1) * MAXOPBLOCKS > LOGSIZE) {
-      // this op might exhaust log space; wait for commit.
+    } else if (log.lh.n + log.reserved + nblocks > log.size) {
+      // this op might exhaust log space; wait for commit, and for
+      // writeback to free the space held by closed transactions.
+      if (log.closed > 0) log.writeback_wanted = 1;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += nblocks;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
-void end_op(void) {
+// called at the start of each FS system call.
+void begin_op(void) { begin_op_blocks(MAXOPBLOCKS); }
+
+// Blocks a large FS system call may reserve, leaving room for others.
+int log_op_blocks(void) {
+  int nblocks = log.size / LOG_OP_SHARE;
+
+  return nblocks > MAXOPBLOCKS ? nblocks : MAXOPBLOCKS;
+}
+
+// called at the end of each FS system call that began with
+// begin_op_blocks(nblocks).
+// closes the transaction if this was the last outstanding operation,
+// and commits it unless in async mode.
+void end_op_blocks(const int nblocks) {
   int do_commit = 0;
+  uint txn;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= nblocks;
   if (log.committing) panic("log.committing");
   if (log.outstanding == 0) {
     do_commit = 1;
@@ -158,43 +282,199 @@ void end_op(void) {
   release(&log.lock);
 
   if (do_commit) {
-    // call commit w/o holding locks, since not allowed
+    // call close_trans and commit w/o holding locks, since not allowed
     // to sleep with locks.
-    commit();
+    txn = close_trans();
     acquire(&log.lock);
     log.committing = 0;
     wakeup(&log);
     release(&log.lock);
+    if (!log.async) commit(txn);
   }
 }
 
-// Copy modified blocks from cache to log.
-static void write_log(void) {
+// called at the end of each FS system call.
+void end_op(void) { end_op_blocks(MAXOPBLOCKS); }
+
+// Staged contents of log entry tail.
+static char *log_stage(int tail) {
+  return log.stage[tail * BSIZE / PGSIZE] + tail * BSIZE % PGSIZE;
+}
+
+// Copy modified blocks of the current transaction from cache to their
+// staged log entries, and return the number of the closed transaction.
+// No FS system call is active, so the cached blocks hold exactly the
+// contents of the transaction.
+static uint close_trans(void) {
   int tail;
+  uint txn;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start + tail + 1);  // log block
+  for (tail = log.closed; tail < log.lh.n; tail++) {
     struct buf *from = bread(log.dev, log.lh.block[tail]);  // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    memmove(log_stage(tail), from->data, BSIZE);
     buf_cache_release(from);
-    buf_cache_release(to);
   }
+
+  acquire(&log.lock);
+  if (log.lh.n > log.closed) {
+    if (log.closed == 0) log.commit_tick = ticks;
+    log.closed = log.lh.n;
+    log.closed_txn++;
+  }
+  txn = log.closed_txn;
+  release(&log.lock);
+
+  return txn;
+}
+
+// Write the staged log entries [from, to) to disk, BIO_BATCH_MAX blocks
+// at a time.
+static void write_log(int from, int to) {
+  struct buf *tos[BIO_BATCH_MAX];
+  int tail = from, i, n;
+
+  while (tail < to) {
+    for (n = 0; n < BIO_BATCH_MAX && tail < to; tail++) {
+      // The log block is overwritten, no need to read it.
+      tos[n] = bget(log.dev, log.start + tail + 1);
+      memmove(tos[n++]->data, log_stage(tail), BSIZE);
+    }
+
+    bwrite_batch(tos, n);  // write the log
+    for (i = 0; i < n; i++) {
+      buf_cache_release(tos[i]);
+    }
+  }
+}
+
+// Commit the closed transactions up to txn, along with any other
+// transaction closed by then.
+static void commit(uint txn) {
+  int from, to;
+  uint to_txn, start;
+
+  acquire(&log.lock);
+  while (log.writing && log.committed_txn < txn) {
+    sleep(&log, &log.lock);
+  }
+  if (log.committed_txn >= txn) {
+    // A commit that was writing when we closed took our transaction.
+    release(&log.lock);
+    return;
+  }
+  log.writing = 1;
+  from = log.committed;
+  to = log.closed;
+  to_txn = log.closed_txn;
+  release(&log.lock);
+
+  start = (uint)steady_clock_now();
+  write_log(from, to);  // Write staged blocks to log
+  write_head(to);       // Write header to disk -- the real commit
+  // kwriteback installs the writes to home locations later.
+
+  acquire(&log.lock);
+  log.committed = to;
+  log.committed_txn = to_txn;
+  log.commits++;
+  log.commit_us += (uint)steady_clock_now() - start;
+  log.writing = 0;
+  wakeup(&log);
+  release(&log.lock);
+}
+
+// Wait until the FS system calls that already ended are committed.
+void log_sync(void) {
+  uint txn;
+
+  acquire(&log.lock);
+  txn = log.closed_txn;
+  if (log.lh.n > log.closed) {
+    // Some are in the open transaction, wait for it to close.
+    txn++;
+    while (log.closed_txn < txn) {
+      sleep(&log, &log.lock);
+    }
+  }
+  release(&log.lock);
+
+  commit(txn);
+}
+
+void log_set_async(const int async) {
+  acquire(&log.lock);
+  log.async = async;
+  release(&log.lock);
+}
+
+void log_get_stats(struct log_stats *const stats) {
+  acquire(&log.lock);
+  stats->async = log.async;
+  stats->transactions = log.closed_txn;
+  stats->commits = log.commits;
+  stats->commit_us = log.commit_us;
+  stats->size = log.size;
+  stats->used = log.lh.n;
+  stats->committed = log.committed;
+  release(&log.lock);
+}
+
+static int commit_due(void) { return log.committed_txn != log.closed_txn; }
+
+static int writeback_due(void) {
+  return log.committed > 0 &&
+         (log.writeback_wanted ||
+          log.committed * 100 >= log.size * WRITEBACK_DIRTY_RATIO ||
+          ticks - log.commit_tick >= WRITEBACK_AGE);
+}
+
+// Install all committed blocks and erase them from the log.
+static void writeback(void) {
+  acquire(&log.lock);
+  // Hold off new FS system calls until the running ones close.
+  log.installing = 1;
+  while (log.outstanding > 0 || log.committing) {
+    sleep(&log, &log.lock);
+  }
+  release(&log.lock);
+
+  commit(log.closed_txn);  // Commit what async mode left behind
+
+  acquire(&log.lock);
+  log.committing = 1;
+  release(&log.lock);
+
+  install_cached();  // Install writes to home locations
+  log.lh.n = 0;
+  log.closed = 0;
+  log.committed = 0;
+  write_head(0);  // Erase the transactions from the log
+
+  acquire(&log.lock);
+  log.writeback_wanted = 0;
+  log.committing = 0;
+  log.installing = 0;
+  wakeup(&log);
+  release(&log.lock);
 }
 
-static void commit() {
-  if (log.lh.n > 0) {
-    write_log();      // Write modified blocks from cache to log
-    write_head();     // Write header to disk -- the real commit
-    install_trans();  // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();  // Erase the transaction from the log
+static void writeback_thread(void) {
+  for (;;) {
+    // The log fields are only peeked at here, writeback() runs
+    // under the log lock. Timer ticks wake us up to recheck.
+    acquire(&tickslock);
+    while (!commit_due() && !writeback_due()) {
+      sleep(&ticks, &tickslock);
+    }
+    release(&tickslock);
+    if (commit_due()) commit(log.closed_txn);
+    if (writeback_due()) writeback();
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// close_trans()/commit() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -204,8 +484,7 @@ static void commit() {
 void log_write(struct buf *b) {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
+  if (log.lh.n >= log.size) panic("too big a transaction");
   if (log.outstanding < 1) panic("log_write outside of trans");
 
   if (b->dev->type == DEVICE_TYPE_LOOP) {
@@ -215,7 +494,9 @@ void log_write(struct buf *b) {
   }
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
+  // Closed blocks are already copied to the log, only absorb into
+  // blocks of the current transaction.
+  for (i = log.closed; i < log.lh.n; i++) {
     if (log.lh.block[i] == b->id.blockno)  // log absorbtion
       break;
   }
@@ -223,6 +504,7 @@ void log_write(struct buf *b) {
   if (i == log.lh.n) {
     log.lh.n++;
     b->cgroup = proc_get_cgroup();
+    log.cgroup[i] = b->cgroup;
     cgroup_mem_stat_file_dirty_incr(b->cgroup);
   }
   b->flags |= B_DIRTY;  // prevent eviction
@@ -0,0 +1,20 @@
+#ifndef XV6_FS_NATIVE_LOG_H
+#define XV6_FS_NATIVE_LOG_H
+
+#include "types.h"
+
+struct log_stats {
+  int async;          // end_op() does not wait for the commit.
+  uint transactions;  // transactions closed.
+  uint commits;       // log writes, each committing one or more transactions.
+  uint commit_us;     // total time of the commits, in microseconds.
+  uint size;          // data blocks in the log.
+  uint used;          // log blocks holding transactions.
+  uint committed;     // log blocks holding committed transactions.
+};
+
+void log_sync(void);
+void log_set_async(int);
+void log_get_stats(struct log_stats*);
+
+#endif /* XV6_FS_NATIVE_LOG_H */
@@ -13,6 +13,8 @@
 // vfs_inode counterpart
 struct obj_inode {
   char data_object_name[MAX_OBJECT_NAME_LENGTH];
+  // header of a directory's index, loaded if nslots != 0.
+  struct obj_dindex dindex;
   struct vfs_inode vfs_inode;
 };
 
@@ -21,26 +21,21 @@
 #include "stat.h"
 #include "types.h"
 #include "vfs_fs.h"
+#include "vfs_icache.h"
 
 static const struct inode_operations obj_inode_ops;
 static const struct sb_ops obj_ops;
 
-struct {
-  struct spinlock lock;
-  struct obj_inode inode[NINODE];
-} obj_icache;
+static void dindex_delete(struct obj_inode *dp);
+
+static struct vfs_icache obj_icache;
 
 void obj_iinit() {
-  initlock(&obj_icache.lock, "obj_icache");
-  for (uint i = 0; i < NINODE; i++) {
-    initsleeplock(&obj_icache.inode[i].vfs_inode.lock, "obj_inode");
-    obj_icache.inode[i].vfs_inode.ref = 0;
-    obj_icache.inode[i].vfs_inode.valid = 0;
-  }
+  vfs_icache_init(&obj_icache, "objfs", sizeof(struct obj_inode),
+                  offsetof(struct obj_inode, vfs_inode));
 }
 
-void inode_name(char *output, uint inum) {
-  const char *prefix = "inode";
+static void encoded_name(char *output, const char *prefix, uint inum) {
   memmove(output, prefix, strlen(prefix));
   for (uint i = 0; i <= sizeof(uint); i++) {
     output[i + strlen(prefix)] = inum % 127 + 128;
@@ -49,22 +44,22 @@ void inode_name(char *output, uint inum) {
   output[strlen(prefix) + sizeof(uint) + 1] = 0;  // null terminator
 }
 
-void file_name(char *output, uint inum) {
-  for (uint i = 0; i <= sizeof(uint); i++) {
-    output[i] = inum % 127 + 128;
-    inum /= 127;
-  }
-  output[sizeof(uint) + 1] = 0;  // null terminator
+void inode_name(char *output, uint inum) {
+  encoded_name(output, "inode", inum);
 }
 
-void obj_fs_init(void) {
-  obj_cache_init();
-  obj_iinit();
+void file_name(char *output, uint inum) { encoded_name(output, "", inum); }
+
+static void dindex_name(char *output, uint inum) {
+  encoded_name(output, "dindex", inum);
 }
 
+void obj_fs_init(void) { obj_iinit(); }
+
 // PAGEBREAK!
 //  Allocate an object and its corresponding inode object to the device object
-//  table. Returns an unlocked but allocated and referenced inode.
+//  table. Returns an unlocked but allocated and referenced inode, or 0 if the
+//  inode cache is full.
 static struct vfs_inode *obj_ialloc(struct vfs_superblock *sb, file_type type) {
   struct device *const dev = sb_private(sb);
   int inum = new_inode_number(dev);
@@ -72,6 +67,8 @@ static struct vfs_inode *obj_ialloc(struct vfs_superblock *sb, file_type type) {
   struct obj_dinode di = {0};
   struct vfs_inode *ip;
 
+  if ((ip = obj_ops.iget(sb, inum)) == 0) return 0;
+
   di.base_dinode.type = type;
   di.base_dinode.nlink = 0;
   if (type == T_DEV) {
@@ -90,8 +87,6 @@ static struct vfs_inode *obj_ialloc(struct vfs_superblock *sb, file_type type) {
     }
   }
 
-  ip = obj_ops.iget(sb, inum);
-
   return ip;
 }
 
@@ -120,44 +115,28 @@ void obj_iupdate(struct vfs_inode *vfs_ip) {
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct vfs_inode *obj_iget(struct vfs_superblock *sb, uint inum) {
-  struct obj_inode *ip, *empty;
-
-  acquire(&obj_icache.lock);
-
-  // Is the inode already cached?
-  empty = 0;
-  for (ip = &obj_icache.inode[0]; ip < &obj_icache.inode[NINODE]; ip++) {
-    if (ip->vfs_inode.ref > 0 && ip->vfs_inode.sb == sb &&
-        ip->vfs_inode.inum == inum) {
-      ip->vfs_inode.ref++;
-      release(&obj_icache.lock);
-      return &ip->vfs_inode;
-    }
-    if (empty == 0 && ip->vfs_inode.ref == 0)  // Remember empty slot.
-      empty = ip;
-  }
-
-  // Recycle an inode cache entry.
-  if (empty == 0) panic("iget: no inodes");
+  struct vfs_inode *vfs_ip;
+  struct obj_inode *ip;
+  int first_ref;
 
-  ip = empty;
-  ip->vfs_inode.sb = sb;
-  ip->vfs_inode.inum = inum;
-  ip->vfs_inode.ref = 1;
-  ip->vfs_inode.valid = 0;
+  vfs_ip = vfs_icache_get(&obj_icache, sb, inum, &first_ref);
+  if (!first_ref) return vfs_ip;
 
-  ip->data_object_name[0] = 0;
-  file_name(ip->data_object_name, inum);
+  // No one else holds the inode, so it can be set up without its lock.
+  ip = container_of(vfs_ip, struct obj_inode, vfs_inode);
+  if (!vfs_ip->valid) {
+    ip->data_object_name[0] = 0;
+    file_name(ip->data_object_name, inum);
+    ip->dindex.nslots = 0;
+  }
 
   struct device *const dev = sb_private(sb);
   deviceget(dev);
 
   /* Initiate inode operations for obj fs */
-  ip->vfs_inode.i_op = &obj_inode_ops;
+  vfs_ip->i_op = &obj_inode_ops;
 
-  release(&obj_icache.lock);
-
-  return &ip->vfs_inode;
+  return vfs_ip;
 }
 
 void obj_iput(struct vfs_inode *vfs_ip);
@@ -165,6 +144,7 @@ void obj_iput(struct vfs_inode *vfs_ip);
 static void obj_fsdestroy(struct vfs_superblock *vfs_sb) {
   struct vfs_inode *root_ip = vfs_sb->root_ip;
   obj_iput(root_ip);
+  vfs_icache_purge(&obj_icache, vfs_sb);
   deviceput(vfs_sb->private);
   vfs_sb->root_ip = NULL;
   vfs_sb->ops = NULL;
@@ -174,10 +154,7 @@ static void obj_fsdestroy(struct vfs_superblock *vfs_sb) {
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct vfs_inode *obj_idup(struct vfs_inode *ip) {
-  acquire(&obj_icache.lock);
-  ip->ref++;
-  release(&obj_icache.lock);
-  return ip;
+  return vfs_icache_dup(&obj_icache, ip);
 }
 
 // Lock the given inode.
@@ -217,6 +194,8 @@ void obj_ilock(struct vfs_inode *vfs_ip) {
 
 // Deletes inode and it's content from the disk.
 static void idelete(struct obj_inode *ip) {
+  if (ip->vfs_inode.type == T_DIR) dindex_delete(ip);
+
   if (ip->data_object_name[0] != 0) {
     struct device *const dev = sb_private(ip->vfs_inode.sb);
     if (obj_cache_delete(dev, ip->data_object_name, ip->vfs_inode.size) !=
@@ -253,10 +232,7 @@ void obj_iput(struct vfs_inode *vfs_ip) {
 
   acquiresleep(&ip->vfs_inode.lock);
   if (ip->vfs_inode.valid && ip->vfs_inode.nlink == 0) {
-    acquire(&obj_icache.lock);
-    int r = ip->vfs_inode.ref;
-    release(&obj_icache.lock);
-    if (r == 1) {
+    if (vfs_icache_last_ref(&obj_icache, &ip->vfs_inode)) {
       // inode has no links and no other references: truncate and free.
       idelete(ip);
       ip->vfs_inode.type = 0;
@@ -264,14 +240,11 @@ void obj_iput(struct vfs_inode *vfs_ip) {
     }
   }
   releasesleep(&ip->vfs_inode.lock);
-  acquire(&obj_icache.lock);
 
-  ip->vfs_inode.ref--;
-  if (ip->vfs_inode.ref == 0) {
+  if (vfs_icache_put(&obj_icache, &ip->vfs_inode)) {
     struct device *const dev = sb_private(ip->vfs_inode.sb);
     deviceput(dev);
   }
-  release(&obj_icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -325,6 +298,22 @@ int obj_readi(struct vfs_inode *vfs_ip, uint off, uint n, vector *dstvector) {
   return n;
 }
 
+// Write n bytes at off to the data object of ip, growing it if needed.
+static void write_content(struct obj_inode *ip, const char *src, uint off,
+                          uint n) {
+  struct device *const dev = sb_private(ip->vfs_inode.sb);
+  if (obj_cache_write(dev, ip->data_object_name, src, n, off,
+                      ip->vfs_inode.size) != NO_ERR) {
+    panic("obj_writei failed to write object content");
+  }
+
+  if (ip->vfs_inode.size < off + n) {
+    ip->vfs_inode.size = off + n;
+  }
+}
+
+static void obj_dirunlink(struct obj_inode *dp, uint i);
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -345,22 +334,194 @@ int obj_writei(struct vfs_inode *vfs_ip, char *src, uint off, uint n) {
   if (off > vfs_ip->size || off + n < off) return -1;
   if (off + n > MAX_INODE_OBJECT_DATA) return -1;
 
-  struct device *const dev = sb_private(ip->vfs_inode.sb);
-  if (obj_cache_write(dev, ip->data_object_name, src, n, off, vfs_ip->size) !=
-      NO_ERR) {
-    panic("obj_writei failed to write object content");
-  }
-
-  if (vfs_ip->size < off + n) {
-    vfs_ip->size = off + n;
+  // Unlink frees a directory entry by zeroing it.
+  if (vfs_ip->type == T_DIR && n == sizeof(struct dirent) && off % n == 0 &&
+      off + n <= vfs_ip->size && ((struct dirent *)src)->inum == 0) {
+    obj_dirunlink(ip, off / n);
+    return n;
   }
 
+  write_content(ip, src, off, n);
   return n;
 }
 
 // PAGEBREAK!
 //  Directories
 
+// Read dirent i of the directory dp.
+static void read_dirent(struct obj_inode *dp, uint i, struct dirent *de) {
+  vector direntryvec = newvector(sizeof(*de), 1);
+  if (obj_readi(&dp->vfs_inode, i * sizeof(*de), sizeof(*de), &direntryvec) !=
+      sizeof(*de))
+    panic("read_dirent");
+  memmove_from_vector((char *)de, direntryvec, 0, sizeof(*de));
+  freevector(&direntryvec);
+}
+
+#define DINDEX_MIN_SLOTS 16
+
+// FNV-1a of a dirent name.
+static uint dindex_hash(const char *name) {
+  uint h = 2166136261u;
+  for (uint i = 0; i < DIRSIZ && name[i] != 0; i++) {
+    h ^= (uchar)name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static uint dindex_size(const struct obj_dindex *dindex) {
+  return sizeof(*dindex) + dindex->nslots * sizeof(uint);
+}
+
+static uint dindex_slot_offset(uint slot) {
+  return sizeof(struct obj_dindex) + slot * sizeof(uint);
+}
+
+static void dindex_read(struct obj_inode *dp, void *dst, uint n, uint off) {
+  struct device *const dev = sb_private(dp->vfs_inode.sb);
+  char name[DINDEX_NAME_LENGTH];
+  vector v = newvector(n, 1);
+
+  dindex_name(name, dp->vfs_inode.inum);
+  if (obj_cache_read(dev, name, &v, n, off, dindex_size(&dp->dindex)) !=
+      NO_ERR) {
+    panic("dindex_read failed reading the directory index");
+  }
+  memmove_from_vector(dst, v, 0, n);
+  freevector(&v);
+}
+
+static void dindex_write(struct obj_inode *dp, const void *src, uint n,
+                         uint off) {
+  struct device *const dev = sb_private(dp->vfs_inode.sb);
+  char name[DINDEX_NAME_LENGTH];
+
+  dindex_name(name, dp->vfs_inode.inum);
+  if (obj_cache_write(dev, name, src, n, off, dindex_size(&dp->dindex)) !=
+      NO_ERR) {
+    panic("dindex_write failed writing the directory index");
+  }
+}
+
+static void dindex_write_header(struct obj_inode *dp) {
+  dindex_write(dp, &dp->dindex, sizeof(dp->dindex), 0);
+}
+
+// Point the first empty slot on the probe sequence of name at dirent i.
+static void dindex_insert(struct obj_inode *dp, const char *name, uint i) {
+  const uint mask = dp->dindex.nslots - 1;
+  uint h = dindex_hash(name) & mask;
+  uint slot;
+
+  for (;; h = (h + 1) & mask) {
+    dindex_read(dp, &slot, sizeof(slot), dindex_slot_offset(h));
+    if (slot == 0) break;
+  }
+  slot = i + 1;
+  dindex_write(dp, &slot, sizeof(slot), dindex_slot_offset(h));
+  dp->dindex.nused++;
+}
+
+// Chain the free dirent i to the head of the free list of dp.
+static void dindex_push_free(struct obj_inode *dp, uint i) {
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  memmove(de.name, &dp->dindex.free_head, sizeof(dp->dindex.free_head));
+  write_content(dp, (char *)&de, i * sizeof(de), sizeof(de));
+  dp->dindex.free_head = i + 1;
+}
+
+// Take a dirent off the free list of dp, or return the number of the dirent
+// past the end of the directory if the list is empty.
+static uint dindex_pop_free(struct obj_inode *dp) {
+  struct dirent de;
+  uint i;
+
+  if (dp->dindex.free_head == 0) return dp->vfs_inode.size / sizeof(de);
+  i = dp->dindex.free_head - 1;
+  if (i >= dp->vfs_inode.size / sizeof(de)) panic("dindex_pop_free: bad list");
+  read_dirent(dp, i, &de);
+  if (de.inum != 0) panic("dindex_pop_free: dirent in use");
+  memmove(&dp->dindex.free_head, de.name, sizeof(dp->dindex.free_head));
+  return i;
+}
+
+// Build the index of dp from its dirents, replacing the old one. The table
+// gets at least 4 slots per dirent, so it is at most a quarter full.
+static void dindex_build(struct obj_inode *dp) {
+  struct device *const dev = sb_private(dp->vfs_inode.sb);
+  const uint ndirents = dp->vfs_inode.size / sizeof(struct dirent);
+  char name[DINDEX_NAME_LENGTH];
+  struct dirent de;
+  uint size, off, n, i;
+  char *zeros;
+
+  dindex_name(name, dp->vfs_inode.inum);
+  if (object_size(dev, name, &size) == NO_ERR &&
+      obj_cache_delete(dev, name, size) != NO_ERR) {
+    panic("dindex_build: failed to delete the old index");
+  }
+
+  dp->dindex.nslots = DINDEX_MIN_SLOTS;
+  while (dp->dindex.nslots < 4 * ndirents) dp->dindex.nslots *= 2;
+  dp->dindex.nused = 0;
+  dp->dindex.free_head = 0;
+  if (obj_cache_add(dev, name, &dp->dindex, sizeof(dp->dindex)) != NO_ERR) {
+    panic("dindex_build: failed adding the index to disk");
+  }
+  if ((zeros = kalloc()) == 0) panic("dindex_build: out of memory");
+  memset(zeros, 0, PGSIZE);
+  for (off = sizeof(dp->dindex); off < dindex_size(&dp->dindex); off += n) {
+    n = min(PGSIZE, dindex_size(&dp->dindex) - off);
+    if (obj_cache_write(dev, name, zeros, n, off, off) != NO_ERR) {
+      panic("dindex_build: failed growing the index");
+    }
+  }
+  kfree(zeros);
+
+  // Walk backwards so that the free list hands out the lowest dirent first.
+  for (i = ndirents; i-- > 0;) {
+    read_dirent(dp, i, &de);
+    if (de.inum == 0) {
+      dindex_push_free(dp, i);
+    } else {
+      dindex_insert(dp, de.name, i);
+    }
+  }
+  dindex_write_header(dp);
+}
+
+// Load the index header of dp, building the index if the directory has none.
+static void dindex_load(struct obj_inode *dp) {
+  struct device *const dev = sb_private(dp->vfs_inode.sb);
+  char name[DINDEX_NAME_LENGTH];
+  uint size;
+
+  if (dp->dindex.nslots != 0) return;
+  dindex_name(name, dp->vfs_inode.inum);
+  if (object_size(dev, name, &size) != NO_ERR) {
+    dindex_build(dp);
+    return;
+  }
+  dp->dindex.nslots = (size - sizeof(dp->dindex)) / sizeof(uint);
+  dindex_read(dp, &dp->dindex, sizeof(dp->dindex), 0);
+}
+
+static void dindex_delete(struct obj_inode *dp) {
+  struct device *const dev = sb_private(dp->vfs_inode.sb);
+  char name[DINDEX_NAME_LENGTH];
+  uint size;
+
+  dindex_name(name, dp->vfs_inode.inum);
+  if (object_size(dev, name, &size) == NO_ERR &&
+      obj_cache_delete(dev, name, size) != NO_ERR) {
+    panic("dindex_delete: failed to delete the index");
+  }
+  dp->dindex.nslots = 0;
+}
+
 // Is the directory dp empty except for "." and ".." ?
 int obj_isdirempty(struct vfs_inode *vfs_dp) {
   int off;
@@ -388,11 +549,9 @@ int obj_isdirempty(struct vfs_inode *vfs_dp) {
 // If found, set *poff to byte offset of entry.
 struct vfs_inode *obj_dirlookup(struct vfs_inode *vfs_dp, char *name,
                                 uint *poff) {
-  uint off;
   struct dirent de;
   struct obj_inode *dp = container_of(vfs_dp, struct obj_inode, vfs_inode);
-  vector direntryvec;
-  direntryvec = newvector(sizeof(de), 1);
+  uint mask, h, probes, slot;
 
   if (dp->vfs_inode.type != T_DIR) panic("obj_dirlookup not DIR");
 
@@ -400,32 +559,29 @@ struct vfs_inode *obj_dirlookup(struct vfs_inode *vfs_dp, char *name,
     panic("ob_dirlookup received inode without data");
   }
 
-  for (off = 0; off < vfs_dp->size; off += sizeof(de)) {
-    if (obj_readi(&dp->vfs_inode, off, sizeof(de), &direntryvec) != sizeof(de))
-      panic("obj_dirlookup read");
-    memmove_from_vector((char *)&de, direntryvec, 0, sizeof(de));
+  dindex_load(dp);
+  mask = dp->dindex.nslots - 1;
+  h = dindex_hash(name) & mask;
+  for (probes = 0; probes < dp->dindex.nslots; probes++, h = (h + 1) & mask) {
+    dindex_read(dp, &slot, sizeof(slot), dindex_slot_offset(h));
+    if (slot == 0) break;
+    read_dirent(dp, slot - 1, &de);
     if (de.inum == 0) continue;
     if (vfs_namecmp(name, de.name) == 0) {
       // entry matches path element
-      if (poff) *poff = off;
-      freevector(&direntryvec);
+      if (poff) *poff = (slot - 1) * sizeof(de);
       return dp->vfs_inode.sb->ops->iget(dp->vfs_inode.sb, de.inum);
     }
   }
-  freevector(&direntryvec);
   return 0;
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
 int obj_dirlink(struct vfs_inode *vfs_dp, char *name, uint inum) {
-  int off;
   struct dirent de;
   struct vfs_inode *ip;
   struct obj_inode *dp = container_of(vfs_dp, struct obj_inode, vfs_inode);
-  char iname[INODE_NAME_LENGTH];
-  struct obj_dinode di;
-  vector direntryvec;
-  direntryvec = newvector(sizeof(de), 1);
+  uint i;
 
   // Check that name is not present.
   if ((ip = obj_dirlookup(&dp->vfs_inode, name, 0)) != 0) {
@@ -436,55 +592,52 @@ int obj_dirlink(struct vfs_inode *vfs_dp, char *name, uint inum) {
     panic("obj_dirlink received inode without data");
   }
 
+  i = dindex_pop_free(dp);
   memset(&de, 0, sizeof(de));
-
-  // Look for an empty dirent.
-  for (off = 0; off < vfs_dp->size; off += sizeof(de)) {
-    if (obj_readi(&dp->vfs_inode, off, sizeof(de), &direntryvec) != sizeof(de))
-      panic("obj_dirlink read");
-    memmove_from_vector((char *)&de, direntryvec, 0, sizeof(de));
-    if (de.inum == 0) break;
-  }
-
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
-  inode_name(iname, inum);
-  memset(&di, 0, sizeof(di));
-  vector div = newvector(sizeof(di), 1);
+  write_content(dp, (char *)&de, i * sizeof(de), sizeof(de));
 
-  struct device *const dev = sb_private(vfs_dp->sb);
-  if (obj_cache_read(dev, iname, &div, sizeof(di), 0, sizeof(di)) != NO_ERR) {
-    panic("inode doesn't exists in the disk");
+  // Keep the table at most half full; the rebuild indexes the new entry.
+  if ((dp->dindex.nused + 1) * 2 > dp->dindex.nslots) {
+    dindex_build(dp);
+  } else {
+    dindex_insert(dp, de.name, i);
+    dindex_write_header(dp);
   }
-  memmove_from_vector((char *)&di, div, 0, div.vectorsize);
-  if (obj_writei(&dp->vfs_inode, (char *)&de, off, sizeof(de)) != sizeof(de))
-    panic("obj_dirlink");
-
-  freevector(&direntryvec);
   return 0;
 }
 
+// Put dirent i of dp, whose entry was just unlinked, on the free list.
+static void obj_dirunlink(struct obj_inode *dp, uint i) {
+  dindex_load(dp);
+  dindex_push_free(dp, i);
+  dindex_write_header(dp);
+}
+
 void obj_fs_init_dev(struct vfs_superblock *vfs_sb, struct device *dev) {
   struct vfs_inode *root_inode;
   struct dirent de;
-  uint off = 0;
+  char iname[INODE_NAME_LENGTH];
+  uint off = 0, size;
 
   deviceget(dev);
   vfs_sb->private = dev;
   vfs_sb->ops = &obj_ops;
 
-  acquire(&obj_icache.lock);
-  for (uint i = 0; i < NINODE; i++) {
-    if (obj_icache.inode[i].vfs_inode.sb == vfs_sb) {
-      initsleeplock(&obj_icache.inode[i].vfs_inode.lock, "obj_inode");
-      obj_icache.inode[i].vfs_inode.ref = 0;
-      obj_icache.inode[i].vfs_inode.valid = 0;
-    }
+  vfs_icache_purge(&obj_icache, vfs_sb);
+
+  /* A store loaded from a disk has its root dir already */
+  inode_name(iname, OBJ_ROOTINO);
+  if (object_size(dev, iname, &size) == NO_ERR) {
+    if ((vfs_sb->root_ip = obj_iget(vfs_sb, OBJ_ROOTINO)) == 0)
+      panic("obj_fs_init_dev: no root inode");
+    return;
   }
-  release(&obj_icache.lock);
 
   /* Initiate root dir */
-  root_inode = obj_ialloc(vfs_sb, T_DIR);
+  if ((root_inode = obj_ialloc(vfs_sb, T_DIR)) == 0)
+    panic("obj_fs_init_dev: no root inode");
   obj_ilock(root_inode);
 
   if (root_inode->inum != OBJ_ROOTINO) {
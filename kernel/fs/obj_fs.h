@@ -46,6 +46,34 @@ struct obj_dinode {
  */
 #define INODE_NAME_LENGTH (5 + sizeof(uint) + 1 + 1)
 
+/**
+ * On-disk directory index
+ * The entries of a directory stay in its data object in the linear `dirent`
+ * format, and a free entry is still one with `inum == 0`. Next to it lives an
+ * index object named "dindex" and the inode id, encoded as for inodes, which
+ * holds this header followed by `nslots` hash slots. A slot holds 1 + the
+ * number of a dirent whose name hashes to it (with linear probing), or 0 if
+ * it is empty. Unlinked entries are not removed from the slots; a lookup
+ * compares the name of the dirent, so a stale slot is just skipped. When the
+ * used slots pass half of the table the index is rebuilt from the dirents.
+ *
+ * Free dirents are chained through their name field, which holds 1 + the
+ * number of the next free dirent, so dirlink reuses them without a scan.
+ *
+ * A directory without an index, like one written by an older kernel, is read
+ * as before and gets its index built on first use.
+ */
+struct obj_dindex {
+  uint nslots;     // hash slots following the header, a power of two.
+  uint nused;      // slots holding a dirent number.
+  uint free_head;  // 1 + the number of the first free dirent, 0 if none.
+};
+
+/**
+ * 6 is `strlen("dindex")`
+ */
+#define DINDEX_NAME_LENGTH (6 + sizeof(uint) + 1 + 1)
+
 void obj_fs_init(void);
 void obj_fs_init_dev(struct vfs_superblock*, struct device*);
 
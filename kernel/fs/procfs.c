@@ -1,9 +1,16 @@
 #include "procfs.h"
 
 #include "defs.h"
+#include "device/bio.h"
 #include "device/buf_cache.h"
 #include "device/device.h"
+#include "device/obj_cache.h"
+#include "device/obj_device.h"
 #include "fcntl.h"
+#include "fs/native_log.h"
+#include "fs/vfs_icache.h"
+#include "kalloc.h"
+#include "kvector.h"
 #include "mount_ns.h"
 #include "namespace.h"
 #include "param.h"
@@ -109,6 +116,20 @@ static proc_file_name_t get_file_name_constant(char* filename) {
 
   if (strcmp(filename, PROCFS_CACHE) == 0) return PROC_CACHE;
 
+  if (strcmp(filename, PROCFS_READAHEAD) == 0) return PROC_READAHEAD;
+
+  if (strcmp(filename, PROCFS_LOG) == 0) return PROC_LOG;
+
+  if (strcmp(filename, PROCFS_OBJDISK) == 0) return PROC_OBJDISK;
+
+  if (strcmp(filename, PROCFS_OBJCACHE) == 0) return PROC_OBJCACHE;
+
+  if (strcmp(filename, PROCFS_ICACHE) == 0) return PROC_ICACHE;
+
+  if (strcmp(filename, PROCFS_KVECTOR) == 0) return PROC_KVECTOR;
+
+  if (strcmp(filename, PROCFS_KMEM) == 0) return PROC_KMEM;
+
   return NONE;
 }
 
@@ -159,6 +180,8 @@ int unsafe_proc_open_file(char* filename, int omode) {
       break;
 
     case PROC_CACHE:
+    case PROC_LOG:
+    case PROC_OBJDISK:
       file_writeable = 1;
 
     default:
@@ -294,16 +317,405 @@ static int read_file_proc_devices(struct vfs_file* f, char* addr, int n) {
   return copy_buffer(addr, f->off, n);
 }
 
-static int read_file_proc_cache(struct vfs_file* f, char* addr, int n) {
+// Formats /proc/cache into buf: the enabled state on the first line,
+// followed by the replacement policy and its statistics.
+static int format_proc_cache(void) {
+  static char* list_names[BUF_CACHE_LISTS] = {
+      [BUF_CACHE_RECENT] = CACHE_LIST_RECENT,
+      [BUF_CACHE_FREQUENT] = CACHE_LIST_FREQUENT};
+  struct buf_cache_stats stats;
+  char* bufp = buf;
+
+  memset(buf, 0, sizeof(buf));
+  buf_cache_get_stats(&stats);
+
   if (buf_cache_is_cache_enabled()) {
-    strncpy(buf, CACHE_ENABLED, sizeof(CACHE_ENABLED));
+    copy_and_move_buffer(&bufp, CACHE_ENABLED, sizeof(CACHE_ENABLED));
+  } else {
+    copy_and_move_buffer(&bufp, CACHE_DISABLED, sizeof(CACHE_DISABLED));
+  }
+
+  copy_and_move_buffer(&bufp, CACHE_POLICY, sizeof(CACHE_POLICY));
+  if (buf_cache_get_policy() == BUF_CACHE_POLICY_ARC) {
+    copy_and_move_buffer(&bufp, CACHE_POLICY_ARC, sizeof(CACHE_POLICY_ARC));
+  } else {
+    copy_and_move_buffer(&bufp, CACHE_POLICY_LRU, sizeof(CACHE_POLICY_LRU));
+  }
+
+  for (int list = 0; list < BUF_CACHE_LISTS; list++) {
+    copy_and_move_buffer(&bufp, list_names[list], MAX_BUF);
+    copy_and_move_buffer(&bufp, CACHE_LIST_SIZE, sizeof(CACHE_LIST_SIZE));
+    bufp += utoa(bufp, stats.lists[list].size);
+    copy_and_move_buffer(&bufp, CACHE_LIST_HITS, sizeof(CACHE_LIST_HITS));
+    bufp += utoa(bufp, stats.lists[list].hits);
+    copy_and_move_buffer(&bufp, CACHE_LIST_GHOST_HITS,
+                         sizeof(CACHE_LIST_GHOST_HITS));
+    bufp += utoa(bufp, stats.lists[list].ghost_hits);
+    *bufp++ = '\n';
+  }
+
+  copy_and_move_buffer(&bufp, CACHE_MISSES, sizeof(CACHE_MISSES));
+  bufp += utoa(bufp, stats.misses);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, CACHE_RECENT_TARGET, sizeof(CACHE_RECENT_TARGET));
+  bufp += utoa(bufp, stats.recent_target);
+  *bufp++ = '\n';
+
+  return bufp - buf;
+}
+
+static int read_file_proc_cache(struct vfs_file* f, char* addr, int n) {
+  format_proc_cache();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+// Formats /proc/readahead into buf, one counter per line.
+static int format_proc_readahead(void) {
+  struct readahead_stats stats;
+  char* bufp = buf;
+
+  memset(buf, 0, sizeof(buf));
+  breadahead_get_stats(&stats);
+
+  copy_and_move_buffer(&bufp, READAHEAD_ISSUED, sizeof(READAHEAD_ISSUED));
+  bufp += utoa(bufp, stats.issued);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, READAHEAD_HITS, sizeof(READAHEAD_HITS));
+  bufp += utoa(bufp, stats.hits);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, READAHEAD_WASTE, sizeof(READAHEAD_WASTE));
+  bufp += utoa(bufp, stats.waste);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, READAHEAD_DROPPED, sizeof(READAHEAD_DROPPED));
+  bufp += utoa(bufp, stats.dropped);
+  *bufp++ = '\n';
+
+  return bufp - buf;
+}
+
+static int read_file_proc_readahead(struct vfs_file* f, char* addr, int n) {
+  format_proc_readahead();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+// Formats /proc/kvector into buf: the pages allocated for vector links and
+// the bytes copied through them since boot.
+static int format_proc_kvector(void) {
+  struct kvec_stats stats;
+  char* bufp = buf;
+
+  memset(buf, 0, sizeof(buf));
+  getvectorstats(&stats);
+
+  copy_and_move_buffer(&bufp, KVECTOR_PAGES, sizeof(KVECTOR_PAGES));
+  bufp += utoa(bufp, stats.pages);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, KVECTOR_COPIED, sizeof(KVECTOR_COPIED));
+  bufp += utoa(bufp, stats.copied);
+  *bufp++ = '\n';
+
+  return bufp - buf;
+}
+
+static int read_file_proc_kvector(struct vfs_file* f, char* addr, int n) {
+  format_proc_kvector();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+// Formats /proc/kmem into buf, one page allocator counter per line.
+static int format_proc_kmem(void) {
+  struct kmem_stats stats;
+  char* bufp = buf;
+
+  memset(buf, 0, sizeof(buf));
+  kmem_get_stats(&stats);
+
+  copy_and_move_buffer(&bufp, KMEM_FREE, sizeof(KMEM_FREE));
+  bufp += utoa(bufp, stats.free);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, KMEM_CACHED, sizeof(KMEM_CACHED));
+  bufp += utoa(bufp, stats.cached);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, KMEM_ALLOCS, sizeof(KMEM_ALLOCS));
+  bufp += utoa(bufp, stats.allocs);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, KMEM_REFILLS, sizeof(KMEM_REFILLS));
+  bufp += utoa(bufp, stats.refills);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, KMEM_DRAINS, sizeof(KMEM_DRAINS));
+  bufp += utoa(bufp, stats.drains);
+  *bufp++ = '\n';
+
+  return bufp - buf;
+}
+
+static int read_file_proc_kmem(struct vfs_file* f, char* addr, int n) {
+  format_proc_kmem();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+// Formats /proc/log into buf: the commit mode on the first line,
+// followed by the log statistics.
+static int format_proc_log(void) {
+  struct log_stats stats;
+  char* bufp = buf;
+
+  memset(buf, 0, sizeof(buf));
+  log_get_stats(&stats);
+
+  copy_and_move_buffer(&bufp, LOG_COMMIT, sizeof(LOG_COMMIT));
+  if (stats.async) {
+    copy_and_move_buffer(&bufp, LOG_COMMIT_ASYNC, sizeof(LOG_COMMIT_ASYNC));
+  } else {
+    copy_and_move_buffer(&bufp, LOG_COMMIT_SYNC, sizeof(LOG_COMMIT_SYNC));
+  }
+
+  copy_and_move_buffer(&bufp, LOG_TRANSACTIONS, sizeof(LOG_TRANSACTIONS));
+  bufp += utoa(bufp, stats.transactions);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, LOG_COMMITS, sizeof(LOG_COMMITS));
+  bufp += utoa(bufp, stats.commits);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, LOG_AVG_COMMIT_US, sizeof(LOG_AVG_COMMIT_US));
+  bufp += utoa(bufp, stats.commits ? stats.commit_us / stats.commits : 0);
+  *bufp++ = '\n';
+
+  // Occupancy of the log, in blocks.
+  copy_and_move_buffer(&bufp, LOG_SIZE, sizeof(LOG_SIZE));
+  bufp += utoa(bufp, stats.size);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, LOG_USED, sizeof(LOG_USED));
+  bufp += utoa(bufp, stats.used);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, LOG_COMMITTED, sizeof(LOG_COMMITTED));
+  bufp += utoa(bufp, stats.committed);
+  *bufp++ = '\n';
+
+  return bufp - buf;
+}
+
+static int read_file_proc_log(struct vfs_file* f, char* addr, int n) {
+  format_proc_log();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+static int write_file_proc_log(struct vfs_file* f, char* addr, int n) {
+  if ((n == (sizeof(LOG_COMMIT_SYNC) - 1)) &&
+      (0 == memcmp(addr, LOG_COMMIT_SYNC, n))) {
+    log_set_async(0);
+    return sizeof(LOG_COMMIT_SYNC) - 1;
+  } else if ((n == (sizeof(LOG_COMMIT_ASYNC) - 1)) &&
+             (0 == memcmp(addr, LOG_COMMIT_ASYNC, n))) {
+    log_set_async(1);
+    return sizeof(LOG_COMMIT_ASYNC) - 1;
+  }
+
+  return RESULT_ERROR;
+}
+
+// Formats /proc/objdisk into buf: the dedup mode on the first line,
+// followed by the compaction, disk write and dedup statistics of the object
+// devices in use. The dedup ratio, logical over stored bytes, has two decimals.
+static int format_proc_objdisk(void) {
+  struct obj_disk_stats stats;
+  char* bufp = buf;
+  uint ratio;
+
+  memset(buf, 0, sizeof(buf));
+  obj_devices_get_stats(&stats);
+
+  copy_and_move_buffer(&bufp, OBJDISK_DEDUP, sizeof(OBJDISK_DEDUP));
+  if (obj_devices_get_dedup()) {
+    copy_and_move_buffer(&bufp, OBJDISK_ON, sizeof(OBJDISK_ON));
   } else {
-    strncpy(buf, CACHE_DISABLED, sizeof(CACHE_DISABLED));
+    copy_and_move_buffer(&bufp, OBJDISK_OFF, sizeof(OBJDISK_OFF));
+  }
+
+  copy_and_move_buffer(&bufp, OBJDISK_COMPACTIONS,
+                       sizeof(OBJDISK_COMPACTIONS));
+  bufp += utoa(bufp, stats.compactions);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, OBJDISK_BYTES_MOVED,
+                       sizeof(OBJDISK_BYTES_MOVED));
+  bufp += utoa(bufp, stats.bytes_moved);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, OBJDISK_BLOCKS_WRITTEN,
+                       sizeof(OBJDISK_BLOCKS_WRITTEN));
+  bufp += utoa(bufp, stats.blocks_written);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, OBJDISK_DEDUP_HITS, sizeof(OBJDISK_DEDUP_HITS));
+  bufp += utoa(bufp, stats.dedup_hits);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, OBJDISK_DEDUP_LOGICAL_BYTES,
+                       sizeof(OBJDISK_DEDUP_LOGICAL_BYTES));
+  bufp += utoa(bufp, stats.dedup_logical_bytes);
+  *bufp++ = '\n';
+
+  copy_and_move_buffer(&bufp, OBJDISK_DEDUP_STORED_BYTES,
+                       sizeof(OBJDISK_DEDUP_STORED_BYTES));
+  bufp += utoa(bufp, stats.dedup_stored_bytes);
+  *bufp++ = '\n';
+
+  ratio = 100;
+  if (stats.dedup_stored_bytes) {
+    ratio = stats.dedup_logical_bytes / stats.dedup_stored_bytes * 100 +
+            stats.dedup_logical_bytes % stats.dedup_stored_bytes * 100 /
+                stats.dedup_stored_bytes;
+  }
+  copy_and_move_buffer(&bufp, OBJDISK_DEDUP_RATIO,
+                       sizeof(OBJDISK_DEDUP_RATIO));
+  bufp += utoa(bufp, ratio / 100);
+  *bufp++ = '.';
+  *bufp++ = '0' + ratio % 100 / 10;
+  *bufp++ = '0' + ratio % 10;
+  *bufp++ = '\n';
+
+  return bufp - buf;
+}
+
+static int read_file_proc_objdisk(struct vfs_file* f, char* addr, int n) {
+  format_proc_objdisk();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+// Formats /proc/objcache into buf: the objects cache statistics of each
+// object device in use, following a line with its id.
+static int format_proc_objcache(void) {
+  struct obj_cache_stats stats;
+  struct device* dev;
+  char* bufp = buf;
+  int i = 0;
+
+  memset(buf, 0, sizeof(buf));
+  while ((dev = next_obj_device(&i)) != NULL) {
+    obj_cache_get_stats(dev, &stats);
+
+    copy_and_move_buffer(&bufp, OBJCACHE_DEVICE, sizeof(OBJCACHE_DEVICE));
+    bufp += utoa(bufp, dev->id);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, OBJCACHE_HITS, sizeof(OBJCACHE_HITS));
+    bufp += utoa(bufp, stats.hits);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, OBJCACHE_MISSES, sizeof(OBJCACHE_MISSES));
+    bufp += utoa(bufp, stats.misses);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, OBJCACHE_BYTES_READ,
+                         sizeof(OBJCACHE_BYTES_READ));
+    bufp += utoa(bufp, stats.bytes_read);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, OBJCACHE_BLOCKS_PREFETCHED,
+                         sizeof(OBJCACHE_BLOCKS_PREFETCHED));
+    bufp += utoa(bufp, stats.blocks_prefetched);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, OBJCACHE_BLOCKS_EVICTED,
+                         sizeof(OBJCACHE_BLOCKS_EVICTED));
+    bufp += utoa(bufp, stats.blocks_evicted);
+    *bufp++ = '\n';
+
+    deviceput(dev);
   }
 
+  return bufp - buf;
+}
+
+static int read_file_proc_objcache(struct vfs_file* f, char* addr, int n) {
+  format_proc_objcache();
+
   return copy_buffer(addr, f->off, n);
 }
 
+// Formats /proc/icache into buf: the statistics of the inode cache of each
+// file system type.
+static int format_proc_icache(void) {
+  struct vfs_icache_stats stats;
+  struct vfs_icache* cache;
+  char* bufp = buf;
+  int i = 0;
+
+  memset(buf, 0, sizeof(buf));
+  while ((cache = vfs_icache_next(&i)) != NULL) {
+    vfs_icache_get_stats(cache, &stats);
+
+    copy_and_move_buffer(&bufp, ICACHE_CACHE, sizeof(ICACHE_CACHE));
+    copy_and_move_buffer(&bufp, cache->name, strlen(cache->name));
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, ICACHE_HITS, sizeof(ICACHE_HITS));
+    bufp += utoa(bufp, stats.hits);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, ICACHE_MISSES, sizeof(ICACHE_MISSES));
+    bufp += utoa(bufp, stats.misses);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, ICACHE_EVICTIONS, sizeof(ICACHE_EVICTIONS));
+    bufp += utoa(bufp, stats.evictions);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, ICACHE_INODES, sizeof(ICACHE_INODES));
+    bufp += utoa(bufp, stats.ninodes);
+    *bufp++ = '\n';
+
+    copy_and_move_buffer(&bufp, ICACHE_UNUSED, sizeof(ICACHE_UNUSED));
+    bufp += utoa(bufp, stats.nunused);
+    *bufp++ = '\n';
+  }
+
+  return bufp - buf;
+}
+
+static int read_file_proc_icache(struct vfs_file* f, char* addr, int n) {
+  format_proc_icache();
+
+  return copy_buffer(addr, f->off, n);
+}
+
+static int write_file_proc_objdisk(struct vfs_file* f, char* addr, int n) {
+  if ((n == (sizeof(OBJDISK_COMPACT) - 1)) &&
+      (0 == memcmp(addr, OBJDISK_COMPACT, n))) {
+    compact_obj_devices();
+    return sizeof(OBJDISK_COMPACT) - 1;
+  } else if ((n == (sizeof(OBJDISK_DEDUP_ON) - 1)) &&
+             (0 == memcmp(addr, OBJDISK_DEDUP_ON, n))) {
+    obj_devices_set_dedup(1);
+    return sizeof(OBJDISK_DEDUP_ON) - 1;
+  } else if ((n == (sizeof(OBJDISK_DEDUP_OFF) - 1)) &&
+             (0 == memcmp(addr, OBJDISK_DEDUP_OFF, n))) {
+    obj_devices_set_dedup(0);
+    return sizeof(OBJDISK_DEDUP_OFF) - 1;
+  }
+
+  return RESULT_ERROR;
+}
+
 static int write_file_proc_cache(struct vfs_file* f, char* addr, int n) {
   if ((n == (sizeof(CACHE_ENABLED) - 1)) &&
       (0 == memcmp(addr, CACHE_ENABLED, n))) {
@@ -313,6 +725,14 @@ static int write_file_proc_cache(struct vfs_file* f, char* addr, int n) {
              (0 == memcmp(addr, CACHE_DISABLED, n))) {
     buf_cache_disable_cache();
     return sizeof(CACHE_DISABLED) - 1;
+  } else if ((n == (sizeof(CACHE_POLICY_LRU) - 1)) &&
+             (0 == memcmp(addr, CACHE_POLICY_LRU, n))) {
+    buf_cache_set_policy(BUF_CACHE_POLICY_LRU);
+    return sizeof(CACHE_POLICY_LRU) - 1;
+  } else if ((n == (sizeof(CACHE_POLICY_ARC) - 1)) &&
+             (0 == memcmp(addr, CACHE_POLICY_ARC, n))) {
+    buf_cache_set_policy(BUF_CACHE_POLICY_ARC);
+    return sizeof(CACHE_POLICY_ARC) - 1;
   }
 
   return RESULT_ERROR;
@@ -343,6 +763,34 @@ int unsafe_proc_read(struct vfs_file* f, char* addr, int n) {
         result = read_file_proc_cache(f, addr, n);
         break;
 
+      case PROC_READAHEAD:
+        result = read_file_proc_readahead(f, addr, n);
+        break;
+
+      case PROC_LOG:
+        result = read_file_proc_log(f, addr, n);
+        break;
+
+      case PROC_OBJDISK:
+        result = read_file_proc_objdisk(f, addr, n);
+        break;
+
+      case PROC_OBJCACHE:
+        result = read_file_proc_objcache(f, addr, n);
+        break;
+
+      case PROC_ICACHE:
+        result = read_file_proc_icache(f, addr, n);
+        break;
+
+      case PROC_KVECTOR:
+        result = read_file_proc_kvector(f, addr, n);
+        break;
+
+      case PROC_KMEM:
+        result = read_file_proc_kmem(f, addr, n);
+        break;
+
       default:
         return RESULT_ERROR;
     }
@@ -357,6 +805,13 @@ int unsafe_proc_read(struct vfs_file* f, char* addr, int n) {
       copy_and_move_buffer_max_len(&bufp, PROCFS_MOUNTS);
       copy_and_move_buffer_max_len(&bufp, PROCFS_DEVICES);
       copy_and_move_buffer_max_len(&bufp, PROCFS_CACHE);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_READAHEAD);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_LOG);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_OBJDISK);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_OBJCACHE);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_ICACHE);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_KVECTOR);
+      copy_and_move_buffer_max_len(&bufp, PROCFS_KMEM);
 
       *bufp++ = '\0';
 
@@ -385,6 +840,14 @@ int unsafe_proc_write(struct vfs_file* f, char* addr, int n) {
         result = write_file_proc_cache(f, addr, n);
         break;
 
+      case PROC_LOG:
+        result = write_file_proc_log(f, addr, n);
+        break;
+
+      case PROC_OBJDISK:
+        result = write_file_proc_objdisk(f, addr, n);
+        break;
+
       default:
         return RESULT_ERROR;
     }
@@ -431,7 +894,36 @@ static int proc_file_size(struct vfs_file* f) {
       break;
 
     case PROC_CACHE:
-      size = CACHE_STATUS_LEN;
+      size = format_proc_cache();
+      break;
+
+    case PROC_READAHEAD:
+      size = format_proc_readahead();
+      break;
+
+    case PROC_LOG:
+      size = format_proc_log();
+      break;
+
+    case PROC_OBJDISK:
+      size = format_proc_objdisk();
+      break;
+
+    case PROC_OBJCACHE:
+      size = format_proc_objcache();
+      break;
+
+    case PROC_ICACHE:
+      size = format_proc_icache();
+      break;
+
+    case PROC_KVECTOR:
+      size = format_proc_kvector();
+      break;
+
+    case PROC_KMEM:
+      size = format_proc_kmem();
+      break;
 
     default:
       break;
@@ -12,6 +12,13 @@
 #define PROCFS_MOUNTS "mounts"
 #define PROCFS_DEVICES "devices"
 #define PROCFS_CACHE "cache"
+#define PROCFS_READAHEAD "readahead"
+#define PROCFS_LOG "log"
+#define PROCFS_OBJDISK "objdisk"
+#define PROCFS_OBJCACHE "objcache"
+#define PROCFS_ICACHE "icache"
+#define PROCFS_KVECTOR "kvector"
+#define PROCFS_KMEM "kmem"
 
 /* /proc/mounts strings. */
 #define MOUNTS_TITLE "Mounts:"
@@ -28,7 +35,75 @@
 /* /proc/cache strings. */
 #define CACHE_ENABLED "1\n"
 #define CACHE_DISABLED "0\n"
-#define CACHE_STATUS_LEN (2)
+#define CACHE_POLICY_LRU "lru\n"
+#define CACHE_POLICY_ARC "arc\n"
+#define CACHE_POLICY "policy "
+#define CACHE_LIST_RECENT "recent"
+#define CACHE_LIST_FREQUENT "frequent"
+#define CACHE_LIST_SIZE " size "
+#define CACHE_LIST_HITS " hits "
+#define CACHE_LIST_GHOST_HITS " ghost_hits "
+#define CACHE_MISSES "misses "
+#define CACHE_RECENT_TARGET "recent_target "
+
+/* /proc/readahead strings. */
+#define READAHEAD_ISSUED "issued "
+#define READAHEAD_HITS "hits "
+#define READAHEAD_WASTE "waste "
+#define READAHEAD_DROPPED "dropped "
+
+/* /proc/log strings. */
+#define LOG_COMMIT "commit "
+#define LOG_COMMIT_SYNC "sync\n"
+#define LOG_COMMIT_ASYNC "async\n"
+#define LOG_TRANSACTIONS "transactions "
+#define LOG_COMMITS "commits "
+#define LOG_AVG_COMMIT_US "avg_commit_us "
+#define LOG_SIZE "size "
+#define LOG_USED "used "
+#define LOG_COMMITTED "committed "
+
+/* /proc/objdisk strings. */
+#define OBJDISK_COMPACT "compact\n"
+#define OBJDISK_DEDUP_ON "dedup\n"
+#define OBJDISK_DEDUP_OFF "nodedup\n"
+#define OBJDISK_DEDUP "dedup "
+#define OBJDISK_ON "on\n"
+#define OBJDISK_OFF "off\n"
+#define OBJDISK_DEDUP_HITS "dedup_hits "
+#define OBJDISK_DEDUP_LOGICAL_BYTES "dedup_logical_bytes "
+#define OBJDISK_DEDUP_STORED_BYTES "dedup_stored_bytes "
+#define OBJDISK_DEDUP_RATIO "dedup_ratio "
+#define OBJDISK_COMPACTIONS "compactions "
+#define OBJDISK_BYTES_MOVED "bytes_moved "
+#define OBJDISK_BLOCKS_WRITTEN "blocks_written "
+
+/* /proc/objcache strings. */
+#define OBJCACHE_DEVICE "device "
+#define OBJCACHE_HITS "hits "
+#define OBJCACHE_MISSES "misses "
+#define OBJCACHE_BYTES_READ "bytes_read "
+#define OBJCACHE_BLOCKS_PREFETCHED "blocks_prefetched "
+#define OBJCACHE_BLOCKS_EVICTED "blocks_evicted "
+
+/* /proc/icache strings. */
+#define ICACHE_CACHE "cache "
+#define ICACHE_HITS "hits "
+#define ICACHE_MISSES "misses "
+#define ICACHE_EVICTIONS "evictions "
+#define ICACHE_INODES "inodes "
+#define ICACHE_UNUSED "unused "
+
+/* /proc/kvector strings. */
+#define KVECTOR_PAGES "pages "
+#define KVECTOR_COPIED "copied "
+
+/* /proc/kmem strings. */
+#define KMEM_FREE "free "
+#define KMEM_CACHED "cached "
+#define KMEM_ALLOCS "allocs "
+#define KMEM_REFILLS "refills "
+#define KMEM_DRAINS "drains "
 
 typedef enum proc_file_name_e {
   NONE = -1,
@@ -38,6 +113,13 @@ typedef enum proc_file_name_e {
   PROC_MOUNTS,
   PROC_DEVICES,
   PROC_CACHE,
+  PROC_READAHEAD,
+  PROC_LOG,
+  PROC_OBJDISK,
+  PROC_OBJCACHE,
+  PROC_ICACHE,
+  PROC_KVECTOR,
+  PROC_KMEM,
 
   PROC_FILE_NAME_END,
   NON_WRITABLE,
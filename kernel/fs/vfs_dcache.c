@@ -0,0 +1,189 @@
+#include "vfs_dcache.h"
+
+#include "defs.h"
+#include "mount_ns.h"
+#include "namespace.h"
+#include "param.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "vfs_fs.h"
+
+// The cache is set associative: an entry lives in one of the
+// VFS_DCACHE_WAYS entries of the set selected by the hash of its directory
+// and name, and replaces the least recently used one.
+#define VFS_DCACHE_SETS 64
+#define VFS_DCACHE_WAYS 4
+
+struct vfs_dentry {
+  uint used;  // vfs_dcache.clock at the last use, 0 if the entry is free.
+
+  // Key: the name in the directory (sb, inum), looked up in mount mnt.
+  struct mount *mnt;
+  struct vfs_superblock *sb;
+  uint inum;
+  char name[DIRSIZ];
+
+  // The inode the name leads to and its mount, or no inode if the name
+  // doesn't exist.
+  struct mount *ipmnt;
+  struct vfs_superblock *ipsb;
+  uint ipinum;
+};
+
+static struct {
+  struct spinlock lock;
+  struct vfs_dentry sets[VFS_DCACHE_SETS][VFS_DCACHE_WAYS];
+  uint clock;
+  // Incremented by every invalidation. A lookup that read a directory
+  // inserts its result only if no invalidation happened meanwhile.
+  uint generation;
+} vfs_dcache;
+
+void vfs_dcache_init(void) { initlock(&vfs_dcache.lock, "vfs_dcache"); }
+
+// FNV-1a over the directory and the name.
+static struct vfs_dentry *vfs_dcache_set(const struct vfs_superblock *sb,
+                                         uint inum, const char *name) {
+  const uchar *p = (const uchar *)&sb;
+  uint hash = 2166136261U;
+
+  for (uint i = 0; i < sizeof(sb); i++) {
+    hash = (hash ^ p[i]) * 16777619U;
+  }
+  for (uint i = 0; i < sizeof(inum); i++, inum >>= 8) {
+    hash = (hash ^ (inum & 0xff)) * 16777619U;
+  }
+  for (uint i = 0; i < DIRSIZ && name[i] != 0; i++) {
+    hash = (hash ^ (uchar)name[i]) * 16777619U;
+  }
+  return vfs_dcache.sets[hash % VFS_DCACHE_SETS];
+}
+
+static int vfs_dentry_matches(const struct vfs_dentry *d,
+                              const struct vfs_superblock *sb, uint inum,
+                              const char *name) {
+  return d->used != 0 && d->sb == sb && d->inum == inum &&
+         vfs_namecmp(d->name, name) == 0;
+}
+
+// Returns the generation to pass to vfs_dcache_insert(). Must be taken
+// before reading the directory.
+uint vfs_dcache_generation(void) {
+  uint generation;
+
+  acquire(&vfs_dcache.lock);
+  generation = vfs_dcache.generation;
+  release(&vfs_dcache.lock);
+  return generation;
+}
+
+// Look up name in the directory dp of mount mnt. Returns 0 on a miss.
+// On a hit returns 1 and sets *ip to a referenced inode and *ipmnt to its
+// mount, taking a reference if it isn't mnt, or *ip to 0 if the name doesn't
+// exist.
+int vfs_dcache_lookup(struct vfs_inode *dp, struct mount *mnt, char *name,
+                      struct vfs_inode **ip, struct mount **ipmnt) {
+  struct vfs_dentry *set = vfs_dcache_set(dp->sb, dp->inum, name);
+  struct mount_ns *ns = myproc()->nsproxy->mount_ns;
+  struct vfs_superblock *ipsb = 0;
+  uint ipinum = 0;
+  int hit = 0;
+
+  // umount() flushes the cache under the lock of the mount namespace, so
+  // holding it keeps the mount of the entry alive until it is referenced.
+  acquire(&ns->lock);
+  acquire(&vfs_dcache.lock);
+  for (int i = 0; i < VFS_DCACHE_WAYS; i++) {
+    if (set[i].mnt == mnt && vfs_dentry_matches(&set[i], dp->sb, dp->inum,
+                                                name)) {
+      set[i].used = ++vfs_dcache.clock;
+      ipsb = set[i].ipsb;
+      ipinum = set[i].ipinum;
+      *ipmnt = set[i].ipmnt;
+      hit = 1;
+      break;
+    }
+  }
+  release(&vfs_dcache.lock);
+  if (hit && ipsb && *ipmnt != mnt) mntdup(*ipmnt);
+  release(&ns->lock);
+  if (!hit) return 0;
+
+  *ip = ipsb ? ipsb->ops->iget(ipsb, ipinum) : 0;
+  // No inode for the name: fail the lookup.
+  if (ipsb && *ip == 0 && *ipmnt != mnt) mntput(*ipmnt);
+  return 1;
+}
+
+// Remember that name in the directory dp of mount mnt leads to ip in mount
+// ipmnt, or nowhere if ip is 0. Ignored if the cache was invalidated since
+// generation.
+void vfs_dcache_insert(uint generation, struct vfs_inode *dp,
+                       struct mount *mnt, char *name, struct vfs_inode *ip,
+                       struct mount *ipmnt) {
+  struct vfs_dentry *set = vfs_dcache_set(dp->sb, dp->inum, name);
+  struct vfs_dentry *d = &set[0];
+
+  acquire(&vfs_dcache.lock);
+  if (generation != vfs_dcache.generation) goto end;
+  for (int i = 0; i < VFS_DCACHE_WAYS; i++) {
+    if (set[i].mnt == mnt &&
+        vfs_dentry_matches(&set[i], dp->sb, dp->inum, name)) {
+      d = &set[i];
+      break;
+    }
+    if (set[i].used < d->used) d = &set[i];
+  }
+  d->used = ++vfs_dcache.clock;
+  d->mnt = mnt;
+  d->sb = dp->sb;
+  d->inum = dp->inum;
+  strncpy(d->name, name, DIRSIZ);
+  d->ipmnt = ipmnt;
+  d->ipsb = ip ? ip->sb : 0;
+  d->ipinum = ip ? ip->inum : 0;
+
+end:
+  release(&vfs_dcache.lock);
+}
+
+// Drop what the cache knows about name in the directory dp, in every mount.
+// Called with dp locked, after changing the entry.
+void vfs_dcache_invalidate(struct vfs_inode *dp, char *name) {
+  struct vfs_dentry *set = vfs_dcache_set(dp->sb, dp->inum, name);
+
+  acquire(&vfs_dcache.lock);
+  vfs_dcache.generation++;
+  for (int i = 0; i < VFS_DCACHE_WAYS; i++) {
+    if (vfs_dentry_matches(&set[i], dp->sb, dp->inum, name)) {
+      set[i].used = 0;
+    }
+  }
+  release(&vfs_dcache.lock);
+}
+
+// Drop every entry of the directory dp, which is being removed, so that an
+// inode that reuses its number doesn't find them.
+void vfs_dcache_invalidate_dir(struct vfs_inode *dp) {
+  acquire(&vfs_dcache.lock);
+  vfs_dcache.generation++;
+  for (int s = 0; s < VFS_DCACHE_SETS; s++) {
+    for (int i = 0; i < VFS_DCACHE_WAYS; i++) {
+      struct vfs_dentry *d = &vfs_dcache.sets[s][i];
+      if (d->sb == dp->sb && d->inum == dp->inum) d->used = 0;
+    }
+  }
+  release(&vfs_dcache.lock);
+}
+
+// Drop all the entries. Called when mounts change.
+void vfs_dcache_flush(void) {
+  acquire(&vfs_dcache.lock);
+  vfs_dcache.generation++;
+  for (int s = 0; s < VFS_DCACHE_SETS; s++) {
+    for (int i = 0; i < VFS_DCACHE_WAYS; i++) {
+      vfs_dcache.sets[s][i].used = 0;
+    }
+  }
+  release(&vfs_dcache.lock);
+}
@@ -0,0 +1,29 @@
+#ifndef XV6_FS_VFS_DCACHE_H
+#define XV6_FS_VFS_DCACHE_H
+
+#include "mount.h"
+#include "types.h"
+#include "vfs_file.h"
+
+// The dentry cache remembers what vfs_namex() found for a path element: the
+// inode a name leads to from a directory in a mount, after crossing into or
+// out of mounts, or that the name doesn't exist. A lookup that hits doesn't
+// read the directory.
+//
+// Entries name inodes by (sb, inum) and hold no references; a hit gets the
+// inode through the inode cache. They are invalidated by whoever changes a
+// directory, and all of them when mounts change. Lock order: the lock of a
+// mount namespace, then the cache lock.
+
+void vfs_dcache_init(void);
+uint vfs_dcache_generation(void);
+int vfs_dcache_lookup(struct vfs_inode *dp, struct mount *mnt, char *name,
+                      struct vfs_inode **ip, struct mount **ipmnt);
+void vfs_dcache_insert(uint generation, struct vfs_inode *dp,
+                       struct mount *mnt, char *name, struct vfs_inode *ip,
+                       struct mount *ipmnt);
+void vfs_dcache_invalidate(struct vfs_inode *dp, char *name);
+void vfs_dcache_invalidate_dir(struct vfs_inode *dp);
+void vfs_dcache_flush(void);
+
+#endif /* XV6_FS_VFS_DCACHE_H */
@@ -6,12 +6,17 @@
 
 #include "defs.h"
 #include "device/device.h"
+#include "kvector.h"
+#include "mmu.h"
 #include "mount.h"
 #include "param.h"
 #include "sleeplock.h"
 #include "spinlock.h"
 #include "types.h"
 
+#define READAHEAD_MIN_WINDOW 2   // blocks, on the first sequential read
+#define READAHEAD_MAX_WINDOW 16  // blocks
+
 struct devsw devsw[NDEV];
 struct ftable_s ftable;
 
@@ -78,6 +83,40 @@ int vfs_filestat(struct vfs_file *f, struct stat *st) {
   return -1;
 }
 
+// Prefetch the blocks following a read of n bytes at off from f.
+// Each sequential read doubles the window of blocks kept prefetched
+// ahead of the reader, up to READAHEAD_MAX_WINDOW; a read elsewhere
+// closes it. Caller must hold f->ip->lock.
+static void vfs_file_readahead(struct vfs_file *f, uint off, uint n) {
+  struct file_readahead *ra = &f->ra;
+  uint next, end;
+
+  if (f->ip->i_op->readahead == 0) return;
+
+  if (off != ra->next_off) {
+    ra->next_off = off + n;
+    ra->ahead = 0;
+    ra->window = 0;
+    return;
+  }
+  ra->next_off = off + n;
+
+  if (ra->window == 0) {
+    ra->window = READAHEAD_MIN_WINDOW;
+  } else if (ra->window < READAHEAD_MAX_WINDOW) {
+    ra->window *= 2;
+  }
+
+  // The block holding the end of the read is cached already.
+  next = (off + n + BSIZE - 1) / BSIZE;
+  end = next + ra->window;
+  if (ra->ahead < next) ra->ahead = next;
+  if (ra->ahead < end) {
+    f->ip->i_op->readahead(f->ip, ra->ahead, end - ra->ahead);
+    ra->ahead = end;
+  }
+}
+
 // Read from file f.
 int vfs_fileread(struct vfs_file *f, int n, vector *dstvector) {
   int r;
@@ -90,6 +129,7 @@ int vfs_fileread(struct vfs_file *f, int n, vector *dstvector) {
   if (f->type == FD_INODE) {
     f->ip->i_op->ilock(f->ip);
     if ((r = f->ip->i_op->readi(f->ip, f->off, n, dstvector)) > 0) {
+      vfs_file_readahead(f, f->off, r);
       f->off += r;
     }
     f->ip->i_op->iunlock(f->ip);
@@ -113,18 +153,19 @@ int vfs_filewrite(struct vfs_file *f, char *addr, int n) {
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS - 1 - 1 - 2) / 2) * 512;
+    int opblocks = log_op_blocks();
+    int max = ((opblocks - 1 - 1 - 2) / 2) * BSIZE;
     int i = 0;
     while (i < n) {
       int n1 = n - i;
       if (n1 > max) n1 = max;
 
-      begin_op();
+      begin_op_blocks(opblocks);
       f->ip->i_op->ilock(f->ip);
       if ((r = f->ip->i_op->writei(f->ip, addr + i, f->off, n1)) > 0)
         f->off += r;
       f->ip->i_op->iunlock(f->ip);
-      end_op();
+      end_op_blocks(opblocks);
 
       if (r < 0) break;
       if (r != n1) panic("short vfs_filewrite");
@@ -134,3 +175,28 @@ int vfs_filewrite(struct vfs_file *f, char *addr, int n) {
   }
   panic("vfs_filewrite");
 }
+
+// Copy up to n bytes from in to out, a page at a time through a kernel
+// buffer, stopping early at the end of in. Returns the bytes copied, or -1
+// if an error stopped the copy before it copied anything.
+int vfs_filecopy(struct vfs_file *in, struct vfs_file *out, int n) {
+  char *page;
+  vector pagev;
+  int r = 0, tot = 0;
+
+  if (in->readable == 0 || out->writable == 0 || n < 0) return -1;
+  if ((in->type != FD_PIPE && in->type != FD_INODE) ||
+      (out->type != FD_PIPE && out->type != FD_INODE))
+    return -1;
+  if ((page = kalloc()) == 0) return -1;
+
+  while (tot < n) {
+    pagev = buffervector(page, min(n - tot, PGSIZE), 1);
+    if ((r = vfs_fileread(in, pagev.vectorsize, &pagev)) <= 0) break;
+    if ((r = vfs_filewrite(out, page, r)) < 0) break;
+    tot += r;
+  }
+
+  kfree(page);
+  return tot == 0 && r < 0 ? -1 : tot;
+}
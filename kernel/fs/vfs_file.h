@@ -2,6 +2,7 @@
 #define XV6_VFS_FILE_H
 
 #include "defs.h"
+#include "dev_stat.h"
 #include "device/device.h"
 #include "kvector.h"
 #include "param.h"
@@ -11,6 +12,13 @@
 
 struct vfs_file;
 
+// Sequential readahead state of an open file.
+struct file_readahead {
+  uint next_off;  // offset a sequential read starts at
+  uint ahead;     // first block not prefetched yet
+  uint window;    // blocks to prefetch past the read, 0 if not sequential
+};
+
 struct vfs_file {
   enum { FD_NONE, FD_PIPE, FD_INODE, FD_CG, FD_PROC } type;
   int ref;  // reference count
@@ -25,6 +33,7 @@ struct vfs_file {
     struct {
       struct vfs_inode *ip;
       struct mount *mnt;
+      struct file_readahead ra;
     };
 
     // FD_CG
@@ -132,6 +141,8 @@ struct inode_operations {
   void (*stati)(struct vfs_inode *, struct stat *);
   int (*writei)(struct vfs_inode *, char *, uint, uint);
   int (*isdirempty)(struct vfs_inode *);
+  // Optional, prefetch blocks [bn, bn + n) of the inode in the background.
+  void (*readahead)(struct vfs_inode *, uint bn, uint n);
 };
 
 // in-memory copy of an inode
@@ -139,6 +150,9 @@ struct vfs_inode {
   struct vfs_superblock *sb;  // The vfs_superblock that this inode belongs to
   uint inum;                  // Inode number
   int ref;                    // Reference count
+  // Links of the inode cache (see vfs_icache.h), protected by its lock.
+  struct vfs_inode *hnext, **hprev;  // hash chain, hprev is 0 if unhashed.
+  struct vfs_inode *next, *prev;     // LRU or free list while ref is 0.
   struct sleeplock lock;      // protects everything below here
   int valid;                  // inode has been read from disk?
   short type;                 // copy of disk inode
@@ -155,20 +169,7 @@ struct devsw {
   int (*read)(struct vfs_inode *, int, vector *dstvector);
   int (*write)(struct vfs_inode *, char *, int);
   int (*stat)(int, struct dev_stat *);
-};
-
-/* device statistics structure which defines what info every device
-   should supply.
-*/
-struct dev_stat {
-  /* number of read IO operation made on the device */
-  uint rios;
-  /* number of write IO operation made on the device */
-  uint wios;
-  /* Total bytes read from device */
-  uint rbytes;
-  /* Total bytes written to device */
-  uint wbytes;
+  int (*ioctl)(int, int, int);
 };
 
 extern struct devsw devsw[];
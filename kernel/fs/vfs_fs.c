@@ -5,6 +5,7 @@
 #include "mount.h"
 #include "obj_fs.h"
 #include "proc.h"
+#include "vfs_dcache.h"
 
 // Copy the next path element from path into name.
 // Return a pointer to the element following the copied one.
@@ -46,7 +47,8 @@ static struct vfs_inode *vfs_namex(char *path, int nameiparent, char *name,
                                    struct vfs_inode *startip,
                                    struct mount *startmnt) {
   struct vfs_inode *ip, *next;
-  struct mount *curmount = NULL;
+  struct mount *curmount = NULL, *nextmount;
+  uint generation;
 
   XV6_ASSERT(path != NULL && name != NULL);
   XV6_ASSERT((startip == NULL) ==
@@ -65,6 +67,22 @@ static struct vfs_inode *vfs_namex(char *path, int nameiparent, char *name,
   }
 
   while ((path = vfs_skipelem(path, name)) != 0) {
+    // A cached lookup skips the directory, and the crossing of mounts.
+    if (!(nameiparent && *path == '\0') &&
+        vfs_dcache_lookup(ip, curmount, name, &next, &nextmount)) {
+      ip->i_op->iput(ip);
+      if (next == 0) {
+        mntput(curmount);
+        return 0;
+      }
+      if (nextmount != curmount) {
+        mntput(curmount);
+        curmount = nextmount;
+      }
+      ip = next;
+      continue;
+    }
+
     ip->i_op->ilock(ip);
     if (ip->type != T_DIR) {
       ip->i_op->iunlockput(ip);
@@ -78,36 +96,42 @@ static struct vfs_inode *vfs_namex(char *path, int nameiparent, char *name,
       return ip;
     }
 
+    generation = vfs_dcache_generation();
     if ((next = ip->i_op->dirlookup(ip, name, 0)) == 0) {
+      vfs_dcache_insert(generation, ip, curmount, name, 0, 0);
       ip->i_op->iunlockput(ip);
       mntput(curmount);
       return 0;
     }
 
-    ip->i_op->iunlockput(ip);
+    ip->i_op->iunlock(ip);
+    nextmount = curmount;
 
     if ((!vfs_namencmp(name, "..", 3)) && curmount != 0 &&
         (curmount != getrootmount()) && (ip == curmount->sb->root_ip) &&
         curmount->mountpoint != 0 &&
         curmount->mountpoint->i_op->dirlookup != NULL) {
       // valid ".." path component lookup
-      struct mount *nextmount = mntdup(curmount->parent);
+      nextmount = mntdup(curmount->parent);
       next->i_op->iput(next);
       next =
           curmount->mountpoint->i_op->dirlookup(curmount->mountpoint, "..", 0);
-      mntput(curmount);
-      curmount = nextmount;
     } else {
       // check if next is a mountpoint, and if so, switch to that mountpoint
-      struct mount *nextmount = mntlookup(next, curmount);
-      if (nextmount != NULL) {
+      struct mount *mountedmount = mntlookup(next, curmount);
+      if (mountedmount != NULL) {
         next->i_op->iput(next);
-        next = get_mount_root_ip(nextmount);
-        mntput(curmount);
-        curmount = nextmount;
+        next = get_mount_root_ip(mountedmount);
+        nextmount = mountedmount;
       }
     }
 
+    vfs_dcache_insert(generation, ip, curmount, name, next, nextmount);
+    ip->i_op->iput(ip);
+    if (nextmount != curmount) {
+      mntput(curmount);
+      curmount = nextmount;
+    }
     ip = next;
   }
 
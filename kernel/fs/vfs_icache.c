@@ -0,0 +1,227 @@
+#include "vfs_icache.h"
+
+#include "defs.h"
+#include "mmu.h"
+#include "param.h"
+#include "vfs_dcache.h"
+
+// Inode caches that vfs_icache_next() iterates, one per file system type.
+// They are all set up by fsinit() and never go away, so the array needs no
+// lock.
+#define VFS_ICACHES 4
+
+static struct {
+  struct vfs_icache *caches[VFS_ICACHES];
+  int ncaches;
+} icaches;
+
+static uint vfs_icache_hash(const struct vfs_superblock *const sb,
+                            const uint inum) {
+  return ((uint)sb / sizeof(*sb) + inum * 2654435761U) % VFS_ICACHE_BUCKETS;
+}
+
+static void list_remove(struct vfs_inode *const ip) {
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+static void list_insert_first(struct vfs_inode *const head,
+                              struct vfs_inode *const ip) {
+  ip->next = head->next;
+  ip->prev = head;
+  head->next->prev = ip;
+  head->next = ip;
+}
+
+static int list_empty(const struct vfs_inode *const head) {
+  return head->next == head;
+}
+
+static void hash_insert(struct vfs_inode **const bucket,
+                        struct vfs_inode *const ip) {
+  ip->hnext = *bucket;
+  ip->hprev = bucket;
+  if (*bucket) {
+    (*bucket)->hprev = &ip->hnext;
+  }
+  *bucket = ip;
+}
+
+static void hash_remove(struct vfs_inode *const ip) {
+  *ip->hprev = ip->hnext;
+  if (ip->hnext) {
+    ip->hnext->hprev = ip->hprev;
+  }
+  ip->hnext = 0;
+  ip->hprev = 0;
+}
+
+void vfs_icache_init(struct vfs_icache *const cache, char *const name,
+                     const uint inode_size, const uint vfs_offset) {
+  memset(cache, 0, sizeof(*cache));
+  initlock(&cache->lock, name);
+  cache->name = name;
+  cache->inode_size = inode_size;
+  cache->vfs_offset = vfs_offset;
+  cache->lru.next = cache->lru.prev = &cache->lru;
+  cache->free.next = cache->free.prev = &cache->free;
+
+  if (icaches.ncaches == VFS_ICACHES) panic("vfs_icache_init: too many");
+  icaches.caches[icaches.ncaches++] = cache;
+}
+
+// Add a page of inodes to the free list, if there is a page.
+// Caller must hold cache->lock.
+static void vfs_icache_grow(struct vfs_icache *const cache) {
+  struct vfs_inode *ip;
+  char *page;
+
+  if ((page = kalloc()) == 0) return;
+  memset(page, 0, PGSIZE);
+  for (uint off = 0; off + cache->inode_size <= PGSIZE;
+       off += cache->inode_size) {
+    ip = (struct vfs_inode *)(page + off + cache->vfs_offset);
+    initsleeplock(&ip->lock, cache->name);
+    list_insert_first(&cache->free, ip);
+    cache->stats.ninodes++;
+  }
+}
+
+// Find the inode (sb, inum), setting up a new one if it isn't cached, and
+// take a reference to it. A new inode is not valid. *first_ref is set if the
+// inode had no references, in which case the caller sets up whatever the
+// file system keeps for a referenced inode. Returns NULL if there is no
+// inode to set up.
+struct vfs_inode *vfs_icache_get(struct vfs_icache *const cache,
+                                 struct vfs_superblock *const sb,
+                                 const uint inum, int *const first_ref) {
+  struct vfs_inode **const bucket = &cache->hash[vfs_icache_hash(sb, inum)];
+  struct vfs_inode *ip;
+
+  acquire(&cache->lock);
+  for (ip = *bucket; ip; ip = ip->hnext) {
+    if (ip->sb == sb && ip->inum == inum) {
+      *first_ref = ip->ref == 0;
+      if (ip->ref == 0) {
+        list_remove(ip);
+        cache->stats.nunused--;
+      }
+      ip->ref++;
+      cache->stats.hits++;
+      release(&cache->lock);
+      return ip;
+    }
+  }
+
+  cache->stats.misses++;
+  if (list_empty(&cache->free) &&
+      (cache->stats.ninodes < NINODE || list_empty(&cache->lru)) &&
+      cache->stats.ninodes < VFS_ICACHE_MAX) {
+    vfs_icache_grow(cache);
+  }
+  if (list_empty(&cache->free)) {
+    if (list_empty(&cache->lru)) {
+      release(&cache->lock);
+      // Don't let the lookup that failed be remembered as a missing name.
+      vfs_dcache_flush();
+      return NULL;
+    }
+    ip = cache->lru.prev;
+    list_remove(ip);
+    hash_remove(ip);
+    list_insert_first(&cache->free, ip);
+    cache->stats.nunused--;
+    cache->stats.evictions++;
+  }
+
+  ip = cache->free.next;
+  list_remove(ip);
+  ip->sb = sb;
+  ip->inum = inum;
+  ip->ref = 1;
+  ip->valid = 0;
+  hash_insert(bucket, ip);
+  *first_ref = 1;
+  release(&cache->lock);
+  return ip;
+}
+
+// Take another reference to ip, which the caller holds one to.
+struct vfs_inode *vfs_icache_dup(struct vfs_icache *const cache,
+                                 struct vfs_inode *const ip) {
+  acquire(&cache->lock);
+  if (ip->ref < 1) panic("vfs_icache_dup");
+  ip->ref++;
+  release(&cache->lock);
+  return ip;
+}
+
+// Whether the caller holds the only reference to ip.
+int vfs_icache_last_ref(struct vfs_icache *const cache,
+                        struct vfs_inode *const ip) {
+  int last;
+
+  acquire(&cache->lock);
+  last = ip->ref == 1;
+  release(&cache->lock);
+  return last;
+}
+
+// Drop a reference to ip. Return 1 if it was the last one.
+// A valid inode stays cached, an invalid one is freed.
+int vfs_icache_put(struct vfs_icache *const cache,
+                   struct vfs_inode *const ip) {
+  int last;
+
+  acquire(&cache->lock);
+  if (ip->ref < 1) panic("vfs_icache_put");
+  last = --ip->ref == 0;
+  if (last) {
+    if (ip->valid && ip->hprev) {
+      list_insert_first(&cache->lru, ip);
+      cache->stats.nunused++;
+    } else {
+      if (ip->hprev) hash_remove(ip);
+      list_insert_first(&cache->free, ip);
+    }
+  }
+  release(&cache->lock);
+  return last;
+}
+
+// Drop the inodes of sb from the cache, so a later superblock at the same
+// address doesn't find them. Called when sb is destroyed. An inode that is
+// still referenced is freed by its last put.
+void vfs_icache_purge(struct vfs_icache *const cache,
+                      struct vfs_superblock *const sb) {
+  struct vfs_inode *ip, *next;
+
+  acquire(&cache->lock);
+  for (uint i = 0; i < VFS_ICACHE_BUCKETS; i++) {
+    for (ip = cache->hash[i]; ip; ip = next) {
+      next = ip->hnext;
+      if (ip->sb != sb) continue;
+      hash_remove(ip);
+      if (ip->ref == 0) {
+        list_remove(ip);
+        list_insert_first(&cache->free, ip);
+        cache->stats.nunused--;
+      }
+    }
+  }
+  release(&cache->lock);
+}
+
+// Iterate the inode caches: returns the cache after *i and advances *i, or
+// NULL after the last one.
+struct vfs_icache *vfs_icache_next(int *const i) {
+  if (*i >= icaches.ncaches) return NULL;
+  return icaches.caches[(*i)++];
+}
+
+void vfs_icache_get_stats(struct vfs_icache *const cache,
+                          struct vfs_icache_stats *const stats) {
+  acquire(&cache->lock);
+  *stats = cache->stats;
+  release(&cache->lock);
+}
@@ -0,0 +1,55 @@
+#ifndef XV6_FS_VFS_ICACHE_H
+#define XV6_FS_VFS_ICACHE_H
+
+#include "param.h"
+#include "spinlock.h"
+#include "types.h"
+#include "vfs_file.h"
+
+// Number of hash buckets of an inode cache.
+// A prime number in the order of NINODE keeps chains short.
+#define VFS_ICACHE_BUCKETS 127
+// Most inodes an inode cache allocates.
+#define VFS_ICACHE_MAX (4 * NINODE)
+
+struct vfs_icache_stats {
+  uint hits;       // gets that found the inode cached.
+  uint misses;     // gets that had to set up an inode.
+  uint evictions;  // unreferenced inodes recycled by a miss.
+  uint ninodes;    // inodes allocated by the cache.
+  uint nunused;    // cached inodes without references.
+};
+
+// The inode cache of a file system type.
+//
+// Inodes are found by (sb, inum) through a hash table. When the last
+// reference to a valid inode is dropped, it stays cached on an LRU list, so
+// getting it again doesn't read the disk. A miss takes a free inode, or
+// recycles the least recently used one once the cache holds NINODE inodes,
+// or else grows the cache by a page of inodes, up to VFS_ICACHE_MAX. A get
+// fails when all of them are referenced or no page is left.
+//
+// The lock protects ip->sb, ip->inum, ip->ref and the links of the inodes.
+struct vfs_icache {
+  struct spinlock lock;
+  char *name;
+  uint inode_size;  // size of the inode of the file system.
+  uint vfs_offset;  // offset of its vfs_inode.
+  struct vfs_inode *hash[VFS_ICACHE_BUCKETS];
+  struct vfs_inode lru;   // unreferenced cached inodes, lru.next is newest.
+  struct vfs_inode free;  // inodes holding nothing.
+  struct vfs_icache_stats stats;
+};
+
+void vfs_icache_init(struct vfs_icache *, char *name, uint inode_size,
+                     uint vfs_offset);
+struct vfs_inode *vfs_icache_get(struct vfs_icache *, struct vfs_superblock *,
+                                 uint inum, int *first_ref);
+struct vfs_inode *vfs_icache_dup(struct vfs_icache *, struct vfs_inode *);
+int vfs_icache_last_ref(struct vfs_icache *, struct vfs_inode *);
+int vfs_icache_put(struct vfs_icache *, struct vfs_inode *);
+void vfs_icache_purge(struct vfs_icache *, struct vfs_superblock *);
+struct vfs_icache *vfs_icache_next(int *i);
+void vfs_icache_get_stats(struct vfs_icache *, struct vfs_icache_stats *);
+
+#endif /* XV6_FS_VFS_ICACHE_H */
@@ -2,6 +2,8 @@
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
 
+#include "kalloc.h"
+
 #include "defs.h"
 #include "memlayout.h"
 #include "mmu.h"
@@ -9,6 +11,11 @@
 #include "spinlock.h"
 #include "types.h"
 
+// Each CPU keeps a cache of up to KMEM_CACHE_MAX free pages, and moves
+// KMEM_BATCH pages at a time between it and the global list.
+#define KMEM_CACHE_MAX 64
+#define KMEM_BATCH 32
+
 void freerange(void *vstart, void *vend);
 extern char end[];  // first address after kernel loaded from ELF file
                     // defined by the kernel linker script in kernel.ld
@@ -17,12 +24,22 @@ struct run {
   struct run *next;
 };
 
+struct kmem_cache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;         // pages on freelist
+  uint allocs;   // pages allocated on this cpu
+  uint refills;  // batches taken from the global list
+  uint drains;   // batches given back to the global list
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
-  int page_cnt;
+  int page_cnt;      // free pages, cached by the cpus or not
   int page_protect;  // protected memory for cgroup that declerat mem_min
   struct run *freelist;
+  struct kmem_cache caches[NCPU];
 } kmem;
 
 // Initialization happens in two phases.
@@ -32,6 +49,7 @@ struct {
 // after installing a full page table that maps them on all cores.
 void kinit1(void *vstart, void *vend) {
   initlock(&kmem.lock, "kmem");
+  for (int i = 0; i < NCPU; i++) initlock(&kmem.caches[i].lock, "kmemcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -47,6 +65,33 @@ void freerange(void *vstart, void *vend) {
   p = (char *)PGROUNDUP((uint)vstart);
   for (; p + PGSIZE <= (char *)vend; p += PGSIZE) kfree(p);
 }
+
+// Move up to n pages from the list *from to the list *to.
+// Returns the number of pages moved.
+static int movepages(struct run **from, struct run **to, int n) {
+  struct run *r;
+  int moved;
+
+  for (moved = 0; moved < n && *from; moved++) {
+    r = *from;
+    *from = r->next;
+    r->next = *to;
+    *to = r;
+  }
+  return moved;
+}
+
+// Returns the cache of this cpu, locked.
+static struct kmem_cache *lockcache(void) {
+  struct kmem_cache *c;
+
+  pushcli();
+  c = &kmem.caches[cpuid()];
+  acquire(&c->lock);
+  popcli();
+  return c;
+}
+
 // PAGEBREAK: 21
 //  Free the page of physical memory pointed at by v,
 //  which normally should have been returned by a
@@ -54,18 +99,35 @@ void freerange(void *vstart, void *vend) {
 //  initializing the allocator; see kinit above.)
 void kfree(char *v) {
   struct run *r;
+  struct kmem_cache *c;
 
   if ((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP) panic("kfree");
 
+#if XV6_KALLOC_JUNK
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if (kmem.use_lock) acquire(&kmem.lock);
   r = (struct run *)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  kmem.page_cnt++;
-  if (kmem.use_lock) release(&kmem.lock);
+  if (!kmem.use_lock) {
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.page_cnt++;
+    return;
+  }
+
+  c = lockcache();
+  r->next = c->freelist;
+  c->freelist = r;
+  c->n++;
+  if (c->n >= KMEM_CACHE_MAX) {
+    acquire(&kmem.lock);
+    c->n -= movepages(&c->freelist, &kmem.freelist, KMEM_BATCH);
+    release(&kmem.lock);
+    c->drains++;
+  }
+  __sync_add_and_fetch(&kmem.page_cnt, 1);
+  release(&c->lock);
 }
 
 int increse_protect_counter(int num) {
@@ -98,49 +160,117 @@ int decrese_protect_counter(int num) {
 // Returns the number of available memory in the kernel
 uint get_total_memory() { return kmem.page_cnt; }
 
+// Take a page from the cache of another cpu, for when this cpu and the
+// global list ran out.
+static struct run *stealpage(void) {
+  struct kmem_cache *c;
+  struct run *r = 0;
+
+  for (c = kmem.caches; c < &kmem.caches[NCPU] && !r; c++) {
+    acquire(&c->lock);
+    if ((r = c->freelist) != 0) {
+      c->freelist = r->next;
+      c->n--;
+      c->allocs++;
+      __sync_sub_and_fetch(&kmem.page_cnt, 1);
+    }
+    release(&c->lock);
+  }
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 char *kalloc(void) {
   struct run *r;
+  struct kmem_cache *c;
   if (kmem.page_cnt <= kmem.page_protect) return 0;
 
-  if (kmem.use_lock) acquire(&kmem.lock);
-  r = kmem.freelist;
-  if (r) {
-    kmem.freelist = r->next;
-    kmem.page_cnt--;
+  if (!kmem.use_lock) {
+    if ((r = kmem.freelist) != 0) {
+      kmem.freelist = r->next;
+      kmem.page_cnt--;
+    }
+    return (char *)r;
   }
-  if (kmem.use_lock) release(&kmem.lock);
+
+  c = lockcache();
+  if (c->freelist == 0) {
+    acquire(&kmem.lock);
+    c->n += movepages(&kmem.freelist, &c->freelist, KMEM_BATCH);
+    release(&kmem.lock);
+    c->refills++;
+  }
+  if ((r = c->freelist) != 0) {
+    c->freelist = r->next;
+    c->n--;
+    c->allocs++;
+    __sync_sub_and_fetch(&kmem.page_cnt, 1);
+  }
+  release(&c->lock);
+
+  if (!r) r = stealpage();
   return (char *)r;
 }
 
+void kmem_get_stats(struct kmem_stats *stats) {
+  struct kmem_cache *c;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->free = kmem.page_cnt;
+  for (c = kmem.caches; c < &kmem.caches[NCPU]; c++) {
+    acquire(&c->lock);
+    stats->cached += c->n;
+    stats->allocs += c->allocs;
+    stats->refills += c->refills;
+    stats->drains += c->drains;
+    release(&c->lock);
+  }
+}
+
+// Count the free pages on list and, if they were filled with junk, those
+// of them not filled with 1's.
+static void checkpages(struct run *list, int *list_cnt, int *err_cnt) {
+  struct run *r;
+
+  for (r = list; r; r = r->next) {
+    (*list_cnt)++;
+#if XV6_KALLOC_JUNK
+    char *c = (char *)r;
+    for (int i = sizeof(void *); i < PGSIZE; i++) {
+      if (c[i] != 1) {
+        (*err_cnt)++;
+        break;
+      }
+    }
+#endif
+  }
+}
+
 // Sanity check for free memory. Tests:
-// 1. Whether the free page list contains all the
-//    free memory the system should have;
-// 2. The free pages are filled with 1's, as they
-//    were when freed.
+// 1. Whether the free page lists of the cpus and the global
+//    one contain all the free memory the system should have;
+// 2. If built with XV6_KALLOC_JUNK, the free pages are filled
+//    with 1's, as they were when freed.
 // Mismatched counters or errors indicate memory
 // corruption!
 int kmemtest(void) {
   int page_cnt, list_cnt;
-  int page_err, err_cnt;
-  struct run *r;
-  char *c;
+  int err_cnt;
+  struct kmem_cache *c;
 
-  if (kmem.use_lock) acquire(&kmem.lock);
+  // Lock the caches before the global list, as kalloc() and kfree() do.
+  for (c = kmem.caches; c < &kmem.caches[NCPU]; c++) acquire(&c->lock);
+  acquire(&kmem.lock);
   page_cnt = kmem.page_cnt;  // free pages by counter
-  list_cnt = 0;              // free pages on linked list
+  list_cnt = 0;              // free pages on linked lists
   err_cnt = 0;               // corrupted free pages
-  for (r = kmem.freelist; r; r = r->next) {
-    list_cnt++;
-    c = (char *)r;
-    page_err = 0;
-    for (int i = sizeof(void *); i < PGSIZE; i++)
-      if (c[i] != 1) page_err = 1;
-    err_cnt += page_err;
-  }
-  if (kmem.use_lock) release(&kmem.lock);
+  checkpages(kmem.freelist, &list_cnt, &err_cnt);
+  for (c = kmem.caches; c < &kmem.caches[NCPU]; c++)
+    checkpages(c->freelist, &list_cnt, &err_cnt);
+  release(&kmem.lock);
+  for (c = kmem.caches; c < &kmem.caches[NCPU]; c++) release(&c->lock);
 
   cprintf(
       "Free Memory Pages:\n"
@@ -0,0 +1,16 @@
+#ifndef XV6_KALLOC_H
+#define XV6_KALLOC_H
+
+#include "types.h"
+
+struct kmem_stats {
+  uint free;     // free pages.
+  uint cached;   // free pages held by the per-cpu caches.
+  uint allocs;   // pages allocated since boot.
+  uint refills;  // batches the cpus took from the global list.
+  uint drains;   // batches the cpus gave back to the global list.
+};
+
+void kmem_get_stats(struct kmem_stats*);
+
+#endif /* XV6_KALLOC_H */
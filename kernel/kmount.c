@@ -4,6 +4,7 @@
 #include "device/obj_device.h"
 #include "fs/native_fs.h"
 #include "fs/obj_fs.h"
+#include "fs/vfs_dcache.h"
 #include "mmu.h"
 #include "mount.h"
 #include "mount_ns.h"
@@ -169,6 +170,7 @@ int mount(struct vfs_inode *mountpoint, struct device *target_dev,
     goto end;
   }
 
+  vfs_dcache_flush();
   release(&myproc()->nsproxy->mount_ns->lock);
 
   if (!newmount->isbind && newmount->sb->ops->start != NULL) {
@@ -219,6 +221,7 @@ int umount(struct mount *mnt) {
 
   // remove from linked list
   *previous = current->next;
+  vfs_dcache_flush();
   release(&myproc()->nsproxy->mount_ns->lock);
 
   struct vfs_inode *oldmountpoint = current->mnt.mountpoint;
@@ -481,5 +484,6 @@ int pivot_root(struct vfs_inode *new_root, struct mount *new_root_mount,
   status = 0;
 
   release(&mount_holder.mnt_list_lock);
+  vfs_dcache_flush();
   return status;
 }
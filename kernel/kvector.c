@@ -3,6 +3,14 @@
  * the vector data structure.
  * It is basically a linked list of
  * arrays.
+ *
+ * A page directory indexes the links, so any index is reached in O(1):
+ * a vector of one link has none, a vector of up to KVEC_DIR_ENTRIES links
+ * has one page of link pointers, and a bigger vector has a page of pointers
+ * to such pages.
+ *
+ * A vector made by buffervector() has no links: its elements are the
+ * caller's buffer, so reading into it copies straight to the destination.
  **************/
 #include "kvector.h"
 
@@ -17,11 +25,17 @@
 
 #define KVEC_ERR 0
 
+#define KVEC_POINTERS_SPACE (2 * sizeof(char*))
+#define KVEC_BYTES_PER_PAGE (PGSIZE - KVEC_POINTERS_SPACE)
+#define KVEC_DIR_ENTRIES (PGSIZE / sizeof(char*))
+
+static struct kvec_stats stats;
+
 // TODO(unknown):
 //  int addelement(vector v, char* data)
 //  int foreach(int (f*)(vector *, char*))
 //  int foreachinrange(unsigned int from, unsigned int to, int (f*)(vector *,
-//  char*)) add small onepage cache just to enhance sequential access
+//  char*))
 
 // Segment Operations
 // segment structure [prev | next | elements...]
@@ -39,14 +53,22 @@ char* getprev(char* sgmnt) { return ((char**)sgmnt)[0]; }
 
 char* getnext(char* sgmnt) { return ((char**)sgmnt)[1]; }
 
+unsigned int elementsperpage(vector v) {
+  return KVEC_BYTES_PER_PAGE / v.typesize;
+}
+
 void getpageforindex(vector v, unsigned int index, unsigned int* page,
                      unsigned int* offset) {
-  unsigned int pointersspace = 2 * sizeof(char*);
-  unsigned int elementsperpage = (PGSIZE - pointersspace) / v.typesize;
-  unsigned int pagenumber = index / elementsperpage;
-  unsigned int pageoffset = index % elementsperpage;
-  *page = pagenumber;
-  *offset = pageoffset;
+  *page = index / elementsperpage(v);
+  *offset = index % elementsperpage(v);
+}
+
+// Returns the link number pagenumber of v.
+char* getpage(const vector v, unsigned int pagenumber) {
+  if (v.pages == NULL) return v.head;
+  if (v.npages <= KVEC_DIR_ENTRIES) return v.pages[pagenumber];
+  return ((char**)v.pages[pagenumber / KVEC_DIR_ENTRIES])
+      [pagenumber % KVEC_DIR_ENTRIES];
 }
 
 unsigned int countpages(vector v) {
@@ -68,15 +90,11 @@ unsigned int countactualpages(vector v) {
 // vector operations
 char* getelementpointer(const vector v, unsigned int index) {
   if (v.valid == 1 && v.vectorsize > index) {
+    if (v.buffer != NULL) return v.buffer + index * v.typesize;
     unsigned int pageindex, pageoffset;
     getpageforindex(v, index, &pageindex, &pageoffset);
-    int currentpageindex;
-    char* currentpage = v.head;
-    for (currentpageindex = 0; currentpageindex < pageindex;
-         currentpageindex++) {
-      currentpage = getnext(currentpage);
-    }
-    return &(currentpage[2 * sizeof(char**) + pageoffset * v.typesize]);
+    char* currentpage = getpage(v, pageindex);
+    return &(currentpage[KVEC_POINTERS_SPACE + pageoffset * v.typesize]);
   } else {
     // cprintf("RETURNED NULL WHEN: size: %d, actualsize : %d, valid: %d, index:
     // %d\n", v.vectorsize,countactualpages(v),v.valid, index);
@@ -92,20 +110,8 @@ char* getelementpointer(const vector v, unsigned int index) {
 
 unsigned int setelement(vector v, unsigned int index, char* data) {
   if (v.valid && v.vectorsize && v.vectorsize > index) {
-    unsigned int pageindex, pageoffset;
-    getpageforindex(v, index, &pageindex, &pageoffset);
-    int currentpageindex;
-    char* currentpage = v.head;
-    for (currentpageindex = 0; currentpageindex < pageindex;
-         currentpageindex++) {
-      currentpage = getnext(currentpage);
-    }
-    int currentbyteindex;
-    for (currentbyteindex = 0; currentbyteindex < v.typesize;
-         currentbyteindex++) {
-      currentpage[2 * sizeof(char**) + pageoffset * v.typesize +
-                  currentbyteindex] = data[currentbyteindex];
-    }
+    memmove(getelementpointer(v, index), data, v.typesize);
+    if (v.buffer == NULL) __sync_add_and_fetch(&stats.copied, v.typesize);
     return 1;
   } else {
     return 0;
@@ -114,24 +120,14 @@ unsigned int setelement(vector v, unsigned int index, char* data) {
 
 unsigned int setbyte(vector v, unsigned int index, char* databyte) {
   if (v.valid && (v.vectorsize * v.typesize) > index) {
-    unsigned int pageindex, pageoffset;
-
-    unsigned int pointersspace = 2 * sizeof(char*);
-    unsigned int bytesperpage = (PGSIZE - pointersspace);
-    pageindex = index / bytesperpage;
-    pageoffset = index % bytesperpage;
-
-    int currentpageindex;
-    char* currentpage = v.head;
-    for (currentpageindex = 0; currentpageindex < pageindex;
-         currentpageindex++) {
-      currentpage = getnext(currentpage);
+    if (v.buffer != NULL) {
+      v.buffer[index] = *databyte;
+      return 1;
     }
-    // cprintf("current byte before: %c\n", currentpage[2*sizeof(char**) +
-    // pageoffset]);
-    currentpage[2 * sizeof(char**) + pageoffset] = *databyte;
-    // cprintf("current byte after: %c\n", currentpage[2*sizeof(char**) +
-    // pageoffset]);
+    unsigned int pageindex = index / KVEC_BYTES_PER_PAGE;
+    unsigned int pageoffset = index % KVEC_BYTES_PER_PAGE;
+    char* currentpage = getpage(v, pageindex);
+    currentpage[KVEC_POINTERS_SPACE + pageoffset] = *databyte;
     return 1;
   } else {
     return 0;
@@ -140,15 +136,13 @@ unsigned int setbyte(vector v, unsigned int index, char* databyte) {
 
 void constructarray(char** head, char** tail, unsigned int numberofelements,
                     unsigned int elementsize, int* error) {
-  unsigned int pointersspace = 2 * sizeof(char*);
-  if (elementsize > (PGSIZE - pointersspace)) {
+  if (elementsize > KVEC_BYTES_PER_PAGE) {
     panic("kvector element size is too big");
   }
 
-  unsigned int elementsperpage = (PGSIZE - pointersspace) / elementsize;
+  unsigned int perpage = KVEC_BYTES_PER_PAGE / elementsize;
   unsigned int requiredpages =
-      numberofelements / elementsperpage +
-      (numberofelements % elementsperpage != 0 ? 1 : 0);
+      numberofelements / perpage + (numberofelements % perpage != 0 ? 1 : 0);
 
   int currentpageindex;
   for (currentpageindex = 0; currentpageindex < requiredpages;
@@ -168,6 +162,7 @@ void constructarray(char** head, char** tail, unsigned int numberofelements,
       }
       setnext(p, NULL);
       *tail = p;
+      __sync_add_and_fetch(&stats.pages, 1);
     } else {
       *error = 1;
       return;
@@ -175,20 +170,74 @@ void constructarray(char** head, char** tail, unsigned int numberofelements,
   }
 }
 
+// Build the page directory of the links of v.
+void constructdirectory(vector* v, int* error) {
+  char** directory = NULL;
+  char* currentpage = v->head;
+  unsigned int currentpageindex;
+
+  if (v->npages <= 1) return;
+  if (v->npages > KVEC_DIR_ENTRIES * KVEC_DIR_ENTRIES) {
+    panic("kvector is too big");
+  }
+
+  if ((v->pages = (char**)kalloc()) == NULL) {
+    *error = 1;
+    return;
+  }
+  memset(v->pages, 0, PGSIZE);
+  for (currentpageindex = 0; currentpageindex < v->npages;
+       currentpageindex++) {
+    if (v->npages <= KVEC_DIR_ENTRIES) {
+      directory = v->pages;
+    } else if (currentpageindex % KVEC_DIR_ENTRIES == 0) {
+      if ((directory = (char**)kalloc()) == NULL) {
+        *error = 1;
+        return;
+      }
+      v->pages[currentpageindex / KVEC_DIR_ENTRIES] = (char*)directory;
+    }
+    directory[currentpageindex % KVEC_DIR_ENTRIES] = currentpage;
+    currentpage = getnext(currentpage);
+  }
+}
+
 vector newvector(unsigned int size, unsigned int typesize) {
   vector v;
   v.vectorsize = size;
   v.typesize = typesize;
   v.valid = 0;
-
-  // caching
-  v.lastaccessed = NULL;
-  v.lastindexaccessed = -1;
+  v.head = NULL;
+  v.tail = NULL;
+  v.pages = NULL;
+  v.npages = 0;
+  v.buffer = NULL;
 
   int error = 0;
   constructarray(&(v.head), &(v.tail), v.vectorsize, v.typesize, &error);
+  v.npages = countactualpages(v);
+  if (!error) constructdirectory(&v, &error);
+
+  if (!error) {
+    v.valid = 1;
+  } else {
+    freevector(&v);
+  }
+  return v;
+}
 
-  if (!error) v.valid = 1;
+// Make a vector of the size elements in buffer. The vector does not own
+// buffer: freevector() leaves it alone.
+vector buffervector(char* buffer, unsigned int size, unsigned int typesize) {
+  vector v;
+  v.vectorsize = size;
+  v.typesize = typesize;
+  v.head = NULL;
+  v.tail = NULL;
+  v.pages = NULL;
+  v.npages = 0;
+  v.buffer = buffer;
+  v.valid = 1;
   return v;
 }
 
@@ -199,25 +248,138 @@ void freevector(vector* v) {
     kfree(currentpage);
     currentpage = nextpage;
   }
+  if (v->pages != NULL && v->npages > KVEC_DIR_ENTRIES) {
+    for (unsigned int i = 0; i < KVEC_DIR_ENTRIES && v->pages[i] != NULL;
+         i++) {
+      kfree(v->pages[i]);
+    }
+  }
+  if (v->pages != NULL) kfree((char*)v->pages);
   v->valid = 0;
   v->head = NULL;
   v->tail = NULL;
+  v->pages = NULL;
+  v->npages = 0;
+  v->buffer = NULL;
+}
+
+// Position c at byte byteoffset of v.
+void initvectorcursor(vector v, unsigned int byteoffset, vector_cursor* c) {
+  unsigned int capacity = v.valid ? v.vectorsize * v.typesize : 0;
+
+  c->pos = NULL;
+  c->room = 0;
+  c->left = byteoffset < capacity ? capacity - byteoffset : 0;
+  c->linked = v.buffer == NULL;
+  if (c->left == 0) return;
+  if (!c->linked) {
+    c->pos = v.buffer + byteoffset;
+    c->room = c->left;
+    return;
+  }
+  unsigned int offset = byteoffset % KVEC_BYTES_PER_PAGE;
+  c->pos = getpage(v, byteoffset / KVEC_BYTES_PER_PAGE) + KVEC_POINTERS_SPACE +
+           offset;
+  c->room = min(c->left, KVEC_BYTES_PER_PAGE - offset);
+}
+
+// Move c to the next link once it used up the room of its current one, and
+// return the bytes c can move before it has to move again.
+static unsigned int cursorroom(vector_cursor* c) {
+  if (c->room == 0 && c->left > 0) {
+    // A link is used up only at its last byte, PGSIZE past its start.
+    c->pos = getnext(c->pos - PGSIZE) + KVEC_POINTERS_SPACE;
+    c->room = min(c->left, KVEC_BYTES_PER_PAGE);
+  }
+  return c->room;
+}
+
+static void cursoradvance(vector_cursor* c, unsigned int bytes) {
+  c->pos += bytes;
+  c->room -= bytes;
+  c->left -= bytes;
+  if (c->linked) __sync_add_and_fetch(&stats.copied, bytes);
+}
+
+// Copy up to size bytes from src into the vector at c, and advance c past
+// them. Returns the number of bytes copied.
+unsigned int cursorwrite(vector_cursor* c, const char* src,
+                         unsigned int size) {
+  unsigned int done, chunk, room;
+
+  if (size > c->left) size = c->left;
+  for (done = 0; done < size; done += chunk) {
+    room = cursorroom(c);
+    chunk = min(size - done, room);
+    memmove(c->pos, src + done, chunk);
+    cursoradvance(c, chunk);
+  }
+  return size;
+}
+
+// Copy up to size bytes from the vector at c into dst, and advance c past
+// them. Returns the number of bytes copied.
+unsigned int cursorread(vector_cursor* c, char* dst, unsigned int size) {
+  unsigned int done, chunk, room;
+
+  if (size > c->left) size = c->left;
+  for (done = 0; done < size; done += chunk) {
+    room = cursorroom(c);
+    chunk = min(size - done, room);
+    memmove(dst + done, c->pos, chunk);
+    cursoradvance(c, chunk);
+  }
+  return size;
 }
 
 void memmove_into_vector_bytes(vector dstvec, unsigned int dstbyteoffset,
                                char* src, unsigned int size) {
-  int i;
-  for (i = 0; i < size; i++) {
-    setbyte(dstvec, i + dstbyteoffset, &(src[i]));
+  vector_cursor c;
+  initvectorcursor(dstvec, dstbyteoffset, &c);
+  cursorwrite(&c, src, size);
+}
+
+// Copy elementcount elements between the vector, starting at elementoffset,
+// and buf, a link at a time. Elements past the end of the vector are skipped.
+static void memmove_elements(vector vec, unsigned int elementoffset,
+                             char* buf, unsigned int elementcount,
+                             int intovector) {
+  unsigned int pageindex, pageoffset, chunk;
+  char* element;
+
+  if (!vec.valid || elementoffset >= vec.vectorsize) return;
+  if (elementcount > vec.vectorsize - elementoffset) {
+    elementcount = vec.vectorsize - elementoffset;
+  }
+  if (vec.buffer != NULL) {
+    element = vec.buffer + elementoffset * vec.typesize;
+    if (intovector) {
+      memmove(element, buf, elementcount * vec.typesize);
+    } else {
+      memmove(buf, element, elementcount * vec.typesize);
+    }
+    return;
+  }
+  __sync_add_and_fetch(&stats.copied, elementcount * vec.typesize);
+  getpageforindex(vec, elementoffset, &pageindex, &pageoffset);
+  for (; elementcount > 0; elementcount -= chunk) {
+    chunk = min(elementcount, elementsperpage(vec) - pageoffset);
+    element = getpage(vec, pageindex) + KVEC_POINTERS_SPACE +
+              pageoffset * vec.typesize;
+    if (intovector) {
+      memmove(element, buf, chunk * vec.typesize);
+    } else {
+      memmove(buf, element, chunk * vec.typesize);
+    }
+    buf += chunk * vec.typesize;
+    pageindex++;
+    pageoffset = 0;
   }
 }
 
 void memmove_into_vector_elements(vector dstvec, unsigned int dstelementoffset,
                                   char* src, unsigned int size) {
-  int i;
-  for (i = 0; i < size; i++) {
-    setelement(dstvec, i + dstelementoffset, &(src[i * dstvec.typesize]));
-  }
+  memmove_elements(dstvec, dstelementoffset, src, size, 1);
 }
 
 /* Usually used with freevector(&vec) afterwards.
@@ -225,11 +387,7 @@ void memmove_into_vector_elements(vector dstvec, unsigned int dstelementoffset,
  * This comment was written as result of a bug that was hard to debug. */
 void memmove_from_vector(char* dst, vector vec, unsigned int elementoffset,
                          unsigned int elementcount) {
-  int counter;
-  for (counter = 0; counter < elementcount; counter++) {
-    memmove(dst + counter * vec.typesize,
-            getelementpointer(vec, elementoffset + counter), vec.typesize);
-  }
+  memmove_elements(vec, elementoffset, dst, elementcount, 0);
 }
 
 vector slicevector(vector original, unsigned int startfrom,
@@ -241,7 +399,7 @@ vector slicevector(vector original, unsigned int startfrom,
     setelement(result, curindex,
                getelementpointer(original, startfrom + curindex));
   }
-  return original;
+  return result;
 }
 
 uint vectormemcmp(const vector v, void* m, uint bytes) {
@@ -274,3 +432,5 @@ unsigned int copysubvector(vector* dstvector, vector* srcvector,
   dstvector->vectorsize = count;
   return 1;  // SUCCESS
 }
+
+void getvectorstats(struct kvec_stats* out) { *out = stats; }
@@ -8,10 +8,25 @@ typedef struct kvec {
   unsigned int typesize;    // The size of each element measured in bytes
   char* head;               // A pointer to the first link(array) of the vector
   char* tail;               // A pointer to the last link of the vector
-  char* lastaccessed;       // A pointer to the last link accessed
-  unsigned int lastindexaccessed;  // The index of the first link accessed
-                                   // (counting from 0)
+  char** pages;  // The page directory, giving the link of any index. NULL if
+                 // the vector has at most one link (see kvector.c).
+  unsigned int npages;  // Number of links
+  char* buffer;  // The elements of a vector made by buffervector(), else NULL
   int valid;  // 1 if the initialization function succeeds. 0 if it fails.
 } vector;
 
+// A position in the bytes of a vector, for filling or draining it in order.
+// The bytes are addressed as by memmove_into_vector_bytes.
+typedef struct kvec_cursor {
+  char* pos;          // The byte at the position
+  unsigned int room;  // Bytes from the position to the end of its link
+  unsigned int left;  // Bytes from the position to the end of the vector
+  int linked;         // 0 if the vector is a buffervector()
+} vector_cursor;
+
+struct kvec_stats {
+  unsigned int pages;   // links allocated
+  unsigned int copied;  // bytes copied into or out of links
+};
+
 #endif /* XV6_KVEC_H */
@@ -0,0 +1,52 @@
+// PCI configuration space access through the legacy 0xCF8/0xCFC ports.
+// Only bus 0 is scanned, which holds every device QEMU's PIIX machine has.
+
+#include "pci.h"
+
+#include "defs.h"
+#include "types.h"
+#include "x86.h"
+
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+#define PCI_SLOTS 32
+#define PCI_FUNCS 8
+
+static uint pciaddr(const uint bdf, const uint off) {
+  return 0x80000000 | (bdf << 8) | (off & 0xfc);
+}
+
+uint pciconfread(const uint bdf, const uint off) {
+  outl(PCI_CONFIG_ADDRESS, pciaddr(bdf, off));
+  return inl(PCI_CONFIG_DATA);
+}
+
+void pciconfwrite(const uint bdf, const uint off, const uint value) {
+  outl(PCI_CONFIG_ADDRESS, pciaddr(bdf, off));
+  outl(PCI_CONFIG_DATA, value);
+}
+
+// Find the first function of class and subclass on bus 0 and store its
+// bus/device/function number in *bdf. Return 0 on success, -1 if none.
+int pcifind(const uint class, const uint subclass, uint *const bdf) {
+  uint slot, func, b, reg;
+
+  for (slot = 0; slot < PCI_SLOTS; slot++) {
+    for (func = 0; func < PCI_FUNCS; func++) {
+      b = (slot << 3) | func;
+      if ((pciconfread(b, PCI_REG_ID) & 0xffff) == 0xffff) {
+        if (func == 0) break;
+        continue;
+      }
+      reg = pciconfread(b, PCI_REG_CLASS);
+      if ((reg >> 24) == class && ((reg >> 16) & 0xff) == subclass) {
+        *bdf = b;
+        return 0;
+      }
+      // Single function device.
+      if (func == 0 && !(pciconfread(b, PCI_REG_HEADER) & 0x800000)) break;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,19 @@
+#ifndef XV6_PCI_H
+#define XV6_PCI_H
+
+// Configuration space registers, as offsets of their dword.
+#define PCI_REG_ID 0x00
+#define PCI_REG_COMMAND 0x04
+#define PCI_REG_CLASS 0x08  // class, subclass, prog if, revision
+#define PCI_REG_HEADER 0x0c
+#define PCI_REG_BAR4 0x20
+
+#define PCI_COMMAND_IO 0x1      // respond to I/O space accesses
+#define PCI_COMMAND_MASTER 0x4  // allow bus mastering
+
+#define PCI_BAR_IO 0x1  // BAR maps I/O space
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+#endif /* XV6_PCI_H */
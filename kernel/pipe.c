@@ -6,17 +6,52 @@
 #include "spinlock.h"
 #include "types.h"
 
-#define PIPESIZE 512
+// The data of a pipe is a ring of pages. Its size is a power of two pages,
+// so the byte counters can wrap around.
+#define PIPE_DEFAULT_PAGES 1
+#define PIPE_MAX_PAGES 16
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
-  uint nread;     // number of bytes read
-  uint nwrite;    // number of bytes written
-  int readopen;   // read fd is still open
-  int writeopen;  // write fd is still open
+  char *pages[PIPE_MAX_PAGES];
+  uint size;          // bytes in the ring
+  uint nread;         // number of bytes read
+  uint nwrite;        // number of bytes written
+  int readopen;       // read fd is still open
+  int writeopen;      // write fd is still open
+  int readwaiting;    // readers sleeping on nread
+  int writewaiting;   // writers sleeping on nwrite
 };
 
+static void freepages(char **pages, uint npages) {
+  uint i;
+
+  for (i = 0; i < npages; i++) {
+    if (pages[i]) kfree(pages[i]);
+  }
+}
+
+static int allocpages(char **pages, uint npages) {
+  uint i;
+
+  memset(pages, 0, sizeof(char *) * PIPE_MAX_PAGES);
+  for (i = 0; i < npages; i++) {
+    if ((pages[i] = kalloc()) == 0) {
+      freepages(pages, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// The bytes of the ring from its byte n to the end of the page holding it.
+static uint pipechunk(struct pipe *p, uint n, char **data) {
+  uint off = n % p->size;
+
+  *data = p->pages[off / PGSIZE] + off % PGSIZE;
+  return PGSIZE - off % PGSIZE;
+}
+
 int pipealloc(struct vfs_file **f0, struct vfs_file **f1) {
   struct pipe *p;
 
@@ -24,10 +59,18 @@ int pipealloc(struct vfs_file **f0, struct vfs_file **f1) {
   *f0 = *f1 = 0;
   if ((*f0 = vfs_filealloc()) == 0 || (*f1 = vfs_filealloc()) == 0) goto bad;
   if ((p = (struct pipe *)kalloc()) == 0) goto bad;
+  if (allocpages(p->pages, PIPE_DEFAULT_PAGES) < 0) {
+    kfree((char *)p);
+    p = 0;
+    goto bad;
+  }
+  p->size = PIPE_DEFAULT_PAGES * PGSIZE;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->readwaiting = 0;
+  p->writewaiting = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -41,7 +84,10 @@ int pipealloc(struct vfs_file **f0, struct vfs_file **f1) {
 
   // PAGEBREAK: 20
 bad:
-  if (p) kfree((char *)p);
+  if (p) {
+    freepages(p->pages, PIPE_DEFAULT_PAGES);
+    kfree((char *)p);
+  }
   if (*f0) vfs_fileclose(*f0);
   if (*f1) vfs_fileclose(*f1);
   return -1;
@@ -58,34 +104,83 @@ void pipeclose(struct pipe *p, int writable) {
   }
   if (p->readopen == 0 && p->writeopen == 0) {
     release(&p->lock);
+    freepages(p->pages, p->size / PGSIZE);
     kfree((char *)p);
   } else
     release(&p->lock);
 }
 
+int pipesize(struct pipe *p) { return p->size; }
+
+// Resize the ring of p to hold at least size bytes, rounded up to a power of
+// two pages. Returns the new size, or -1 if size is too big or smaller than
+// the bytes in the pipe.
+int pipesetsize(struct pipe *p, int size) {
+  char *pages[PIPE_MAX_PAGES], *oldpages[PIPE_MAX_PAGES], *data;
+  uint npages = 1, noldpages, n, done, chunk;
+
+  if (size <= 0 || size > PIPE_MAX_PAGES * PGSIZE) return -1;
+  while (npages * PGSIZE < size) npages *= 2;
+  if (allocpages(pages, npages) < 0) return -1;
+
+  acquire(&p->lock);
+  n = p->nwrite - p->nread;
+  if (n > npages * PGSIZE) {
+    release(&p->lock);
+    freepages(pages, npages);
+    return -1;
+  }
+  // Move the unread bytes to the start of the new ring.
+  for (done = 0; done < n; done += chunk) {
+    chunk = min(n - done, pipechunk(p, p->nread + done, &data));
+    chunk = min(chunk, PGSIZE - done % PGSIZE);
+    memmove(pages[done / PGSIZE] + done % PGSIZE, data, chunk);
+  }
+  noldpages = p->size / PGSIZE;
+  memmove(oldpages, p->pages, sizeof(oldpages));
+  memmove(p->pages, pages, sizeof(pages));
+  p->size = npages * PGSIZE;
+  p->nread = 0;
+  p->nwrite = n;
+  if (p->writewaiting) wakeup(&p->nwrite);
+  release(&p->lock);
+
+  freepages(oldpages, noldpages);
+  return npages * PGSIZE;
+}
+
 // PAGEBREAK: 40
 int pipewrite(struct pipe *p, char *addr, int n) {
-  int i;
+  uint i, chunk, room;
+  char *data;
 
   acquire(&p->lock);
-  for (i = 0; i < n; i++) {
-    while (p->nwrite == p->nread + PIPESIZE) {  // DOC: pipewrite-full
+  for (i = 0; i < n; i += chunk) {
+    while (p->nwrite == p->nread + p->size) {  // DOC: pipewrite-full
       if (p->readopen == 0 || myproc()->killed) {
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if (p->readwaiting) wakeup(&p->nread);
+      p->writewaiting++;
       sleep(&p->nwrite, &p->lock);  // DOC: pipewrite-sleep
+      p->writewaiting--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    room = pipechunk(p, p->nwrite, &data);
+    chunk = min(n - i, p->nread + p->size - p->nwrite);
+    chunk = min(chunk, room);
+    memmove(data, addr + i, chunk);
+    p->nwrite += chunk;
   }
-  wakeup(&p->nread);  // DOC: pipewrite-wakeup1
+  if (p->readwaiting) wakeup(&p->nread);  // DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
 int piperead(struct pipe *p, int n, vector *outputvector) {
-  int i;
+  vector_cursor out;
+  uint i, chunk, room;
+  char *data;
 
   acquire(&p->lock);
   while (p->nread == p->nwrite && p->writeopen) {  // DOC: pipe-empty
@@ -93,14 +188,19 @@ int piperead(struct pipe *p, int n, vector *outputvector) {
       release(&p->lock);
       return -1;
     }
+    p->readwaiting++;
     sleep(&p->nread, &p->lock);  // DOC: piperead-sleep
+    p->readwaiting--;
   }
-  for (i = 0; i < n; i++) {  // DOC: piperead-copy
-    if (p->nread == p->nwrite) break;
-    char current_read = p->data[p->nread++ % PIPESIZE];
-    memmove_into_vector_bytes(*outputvector, i, (char *)&current_read, 1);
+  initvectorcursor(*outputvector, 0, &out);
+  for (i = 0; i < n && p->nread != p->nwrite; i += chunk) {
+    room = pipechunk(p, p->nread, &data);  // DOC: piperead-copy
+    chunk = min(n - i, p->nwrite - p->nread);
+    chunk = min(chunk, room);
+    cursorwrite(&out, data, chunk);
+    p->nread += chunk;
   }
-  wakeup(&p->nwrite);  // DOC: piperead-wakeup
+  if (p->writewaiting) wakeup(&p->nwrite);  // DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
@@ -188,6 +188,34 @@ void userinit(void) {
   release(&ptable.lock);
 }
 
+// Create a kernel thread running fn, which must never return.
+// The thread has no user memory and lives in the root cgroup and
+// in the namespaces of initproc. Returns 0 if out of processes.
+struct proc *kthread_create(char *name, void (*fn)(void)) {
+  struct proc *p;
+
+  if ((p = allocproc()) == 0) return 0;
+
+  if ((p->pgdir = setupkvm()) == 0) panic("kthread_create: out of memory?");
+  p->sz = 0;
+
+  // forkret "returns" into fn instead of trapret.
+  *(uint *)(p->context + 1) = (uint)fn;
+
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->nsproxy = namespacedup(initproc->nsproxy);
+  p->ns_pid = pid_ns_next_pid(p->nsproxy->pid_ns);
+  p->pids[0].pid = p->ns_pid;
+  p->pids[0].pid_ns = p->nsproxy->pid_ns;
+
+  acquire(&ptable.lock);
+  cgroup_insert(cgroup_root(), p);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+
+  return p;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int growproc(int n) {
@@ -98,6 +98,8 @@ extern int sys_getppid(void);
 extern int sys_getcpu(void);
 extern int sys_kmemtest(void);
 extern int sys_pivot_root(void);
+extern int sys_fsync(void);
+extern int sys_copyfd(void);
 
 static int (*syscalls[])(void) = {
     [SYS_fork] sys_fork,         [SYS_exit] sys_exit,
@@ -115,6 +117,7 @@ static int (*syscalls[])(void) = {
     [SYS_usleep] sys_usleep,     [SYS_ioctl] sys_ioctl,
     [SYS_getppid] sys_getppid,   [SYS_getcpu] sys_getcpu,
     [SYS_kmemtest] sys_kmemtest, [SYS_pivot_root] sys_pivot_root,
+    [SYS_fsync] sys_fsync,       [SYS_copyfd] sys_copyfd,
 };
 
 void syscall(void) {
@@ -8,6 +8,8 @@
 #include "defs.h"
 #include "device/device.h"
 #include "fcntl.h"
+#include "fs/native_log.h"
+#include "fs/vfs_dcache.h"
 #include "fs/vfs_fs.h"
 #include "kvector.h"
 #include "mmu.h"
@@ -59,8 +61,7 @@ int sys_dup(void) {
 int sys_read(void) {
   struct vfs_file *f;
   int n;
-  char *p;  // is it a contiuous space? of what size? should we make it a vector
-            // too?
+  char *p;
 
   if (argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
     return -1;
@@ -73,12 +74,9 @@ int sys_read(void) {
   } else if (f->type == FD_PROC) {
     return proc_read(f, p, n);
   } else {
-    vector pv;
-    pv = newvector(n, 1);
-    int vfs_read_result = vfs_fileread(f, n, &pv);
-    memmove_from_vector(p, pv, 0, n);
-    freevector(&pv);
-    return vfs_read_result;
+    // Read straight into the user memory at p.
+    vector pv = buffervector(p, n, 1);
+    return vfs_fileread(f, n, &pv);
   }
 }
 
@@ -111,6 +109,26 @@ int sys_close(void) {
   return 0;
 }
 
+// Wait until the file system calls that already returned are on disk.
+// The log holds the updates of every file, so fd only has to be valid.
+int sys_fsync(void) {
+  if (argfd(0, 0, 0) < 0) return -1;
+
+  log_sync();
+  return 0;
+}
+
+// Copy up to n bytes from fd in to fd out inside the kernel.
+int sys_copyfd(void) {
+  struct vfs_file *in, *out;
+  int n;
+
+  if (argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+
+  return vfs_filecopy(in, out, n);
+}
+
 int sys_fstat(void) {
   struct vfs_file *f;
   struct stat *st;
@@ -155,6 +173,7 @@ int sys_link(void) {
     dp->i_op->iunlockput(dp);
     goto bad;
   }
+  vfs_dcache_invalidate(dp, name);
   dp->i_op->iunlockput(dp);
   ip->i_op->iput(ip);
 
@@ -215,7 +234,9 @@ int sys_unlink(void) {
     memset(&de, 0, sizeof(de));
     if (dp->i_op->writei(dp, (char *)&de, off, sizeof(de)) != sizeof(de))
       panic("unlink: writei");
+    vfs_dcache_invalidate(dp, name);
     if (ip->type == T_DIR) {
+      vfs_dcache_invalidate_dir(ip);
       dp->nlink--;
       dp->i_op->iupdate(dp);
     }
@@ -263,7 +284,11 @@ static struct vfs_inode *createmount(char *path, short type, short major,
     return 0;
   }
 
-  if ((ip = dp->sb->ops->ialloc(dp->sb, type)) == 0) panic("create: ialloc");
+  if ((ip = dp->sb->ops->ialloc(dp->sb, type)) == 0) {
+    dp->i_op->iunlockput(dp);
+    mntput(*mnt);
+    return 0;
+  }
 
   ip->i_op->ilock(ip);
   ip->major = major;
@@ -281,6 +306,7 @@ static struct vfs_inode *createmount(char *path, short type, short major,
   }
 
   if (dp->i_op->dirlink(dp, name, ip->inum) < 0) panic("create: dirlink");
+  vfs_dcache_invalidate(dp, name);
 
   dp->i_op->iunlockput(dp);
 
@@ -351,6 +377,7 @@ int sys_open(void) {
   f->ip = ip;
   f->off = 0;
   f->mnt = mnt;
+  memset(&f->ra, 0, sizeof(f->ra));
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 
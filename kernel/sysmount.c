@@ -6,6 +6,7 @@
 
 #include "cgroup.h"
 #include "defs.h"
+#include "device/ide.h"
 #include "device/ide_device.h"
 #include "device/loop_device.h"
 #include "device/obj_device.h"
@@ -95,27 +96,46 @@ end:
   return res;
 }
 
+// A device path names a disk whose object store is mounted, with no device
+// path the objects are kept in RAM.
 int handle_objfs_mounts() {
+  char *device_path = NULL;
   char *mount_path = NULL;
   struct mount *parent = NULL;
-  struct vfs_inode *mount_dir = NULL;
-  struct device *objdev = NULL;
+  struct vfs_inode *mount_dir = NULL, *disk_inode = NULL;
+  struct device *objdev = NULL, *disk = NULL;
   int res = -1;
 
-  if (argstr(1, &mount_path) < 0) {
+  if (argstr(0, &device_path) < 0 || argstr(1, &mount_path) < 0) {
     cprintf("badargs\n");
     return -1;
   }
 
   begin_op();
 
+  if (device_path != 0) {
+    if ((disk_inode = vfs_namei(device_path)) == 0) {
+      cprintf("bad device_path\n");
+      goto end;
+    }
+    disk_inode->i_op->ilock(disk_inode);
+    if (disk_inode->type == T_DEV && disk_inode->major == IDE_MAJOR) {
+      disk = get_ide_device(disk_inode->minor);
+    }
+    disk_inode->i_op->iunlock(disk_inode);
+    if (disk == NULL) {
+      cprintf("%s is not a disk\n", device_path);
+      goto end;
+    }
+  }
+
   if ((mount_dir = vfs_nameimount(mount_path, &parent)) == 0) {
     goto end;
   }
 
   mount_dir->i_op->ilock(mount_dir);
 
-  objdev = create_obj_device();
+  objdev = disk ? get_disk_obj_device(disk) : create_obj_device();
   if (objdev == NULL) {
     cprintf("failed to create ObjFS device\n");
     goto end_locked;
@@ -130,9 +150,15 @@ end:
   if (mount_dir) {
     mount_dir->i_op->iput(mount_dir);
   }
+  if (disk_inode) {
+    disk_inode->i_op->iput(disk_inode);
+  }
   if (objdev) {
     deviceput(objdev);
   }
+  if (disk) {
+    deviceput(disk);
+  }
   if (parent) {
     mntput(parent);
   }
@@ -96,6 +96,59 @@ int sys_usleep(void) {
   return 0;
 }
 
+// Copy the statistics of the device file f to the struct dev_stat
+// pointed by the third ioctl argument.
+static int ioctl_get_dev_stat(struct vfs_file *f) {
+  struct dev_stat *device_stats;
+  struct vfs_inode *ip;
+  int result = -1;
+
+  if (f->type != FD_INODE ||
+      argptr(2, (char **)&device_stats, sizeof(*device_stats)) < 0)
+    return -1;
+
+  ip = f->ip;
+  ip->i_op->ilock(ip);
+  if (ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV &&
+      devsw[ip->major].stat) {
+    memset(device_stats, 0, sizeof(*device_stats));
+    result = devsw[ip->major].stat(ip->minor, device_stats);
+  }
+  ip->i_op->iunlock(ip);
+
+  return result;
+}
+
+// Pass a device request with an integer third argument to the driver of the
+// device file f.
+static int ioctl_dev(struct vfs_file *f, int request) {
+  struct vfs_inode *ip;
+  int arg;
+  int result = -1;
+
+  if (f->type != FD_INODE || argint(2, &arg) < 0) return -1;
+
+  ip = f->ip;
+  ip->i_op->ilock(ip);
+  if (ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV &&
+      devsw[ip->major].ioctl) {
+    result = devsw[ip->major].ioctl(ip->minor, request, arg);
+  }
+  ip->i_op->iunlock(ip);
+
+  return result;
+}
+
+// Get or set the buffer size of the pipe f.
+static int ioctl_pipe(struct vfs_file *f, int request) {
+  int size;
+
+  if (f->type != FD_PIPE) return -1;
+  if (request == IOCTL_GET_PIPE_SIZE) return pipesize(f->pipe);
+  if (argint(2, &size) < 0) return -1;
+  return pipesetsize(f->pipe, size);
+}
+
 int sys_ioctl(void) {
   int fd = -1;
   int request = -1;
@@ -105,9 +158,14 @@ int sys_ioctl(void) {
   struct vfs_file *f;
   struct vfs_inode *ip;
 
-  if (argfd(0, &fd, &f) < 0 || argint(1, &request) < 0 ||
-      argint(2, &command) < 0)
-    return -1;
+  if (argfd(0, &fd, &f) < 0 || argint(1, &request) < 0) return -1;
+
+  if (request == IOCTL_GET_DEV_STAT) return ioctl_get_dev_stat(f);
+  if (request == IOCTL_SET_DEV_DMA) return ioctl_dev(f, request);
+  if (request == IOCTL_GET_PIPE_SIZE || request == IOCTL_SET_PIPE_SIZE)
+    return ioctl_pipe(f, request);
+
+  if (argint(2, &command) < 0) return -1;
 
   if (!(command & DEV_CONNECT) && !(command & DEV_DISCONNECT) &&
       !(command & DEV_DETACH) && !(command & DEV_ATTACH)) {
@@ -23,10 +23,11 @@
 #define NINODES 600
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | free bit map | data blocks |
+//   object store ]
 
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -64,7 +65,8 @@ uint xint(uint x) {
 }
 
 void printusageexit(void) {
-  fprintf(stderr, "Usage: mkfs fs.img <is_internal (0/1)> files...\n");
+  fprintf(stderr,
+          "Usage: mkfs [-l log_blocks] fs.img <is_internal (0/1)> files...\n");
   exit(1);
 }
 
@@ -76,6 +78,21 @@ int main(int argc, char *argv[]) {
   struct native_dinode din;
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
+  static_assert(LOGSIZE - 1 <= MAXLOGSIZE, "Default log is too big!");
+
+  if (argc >= 3 && strcmp(argv[1], "-l") == 0) {
+    nlog = atoi(argv[2]);
+    // The header and at least one full transaction, and no more than
+    // the header and the kernel can hold.
+    int maxlog = MAXLOGSIZE < MAXLOGBLOCKS ? MAXLOGSIZE : MAXLOGBLOCKS;
+    if (nlog < 1 + MAXOPBLOCKS || nlog > 1 + maxlog) {
+      fprintf(stderr, "mkfs: log blocks must be in [%d, %d]\n",
+              1 + MAXOPBLOCKS, 1 + maxlog);
+      exit(1);
+    }
+    argc -= 2;
+    argv += 2;
+  }
 
   if (argc < 3) {
     printusageexit();
@@ -88,6 +105,9 @@ int main(int argc, char *argv[]) {
   int is_internal = argv[2][0] == '1';
 
   int fssize = is_internal ? INT_FSSIZE : FSSIZE;
+  // The object store is left zeroed, objfs formats it on first mount.
+  int nobjblocks = is_internal ? 0 : OBJSIZE;
+  if (nlog == 0) nlog = is_internal ? INT_LOGSIZE : LOGSIZE;
   int nbitmap = fssize / (BSIZE * 8) + 1;
 
   assert((BSIZE % sizeof(struct native_dinode)) == 0);
@@ -110,15 +130,17 @@ int main(int argc, char *argv[]) {
   sb.logstart = xint(2);
   sb.inodestart = xint(2 + nlog);
   sb.bmapstart = xint(2 + nlog + ninodeblocks);
+  sb.objstart = xint(fssize);
+  sb.nobjblocks = xint(nobjblocks);
 
   printf(
       "nmeta %d (boot, super, log blocks %d inode blocks %d, bitmap blocks %d) "
-      "blocks %d total %d\n",
-      nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize);
+      "blocks %d total %d object store %d\n",
+      nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize, nobjblocks);
 
   freeblock = nmeta;  // the first free block that we can allocate
 
-  for (i = 0; i < fssize; i++) wsect(i, zeroes);
+  for (i = 0; i < fssize + nobjblocks; i++) wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "common_mocks.h"
 #include "framework/test.h"
@@ -60,6 +61,78 @@ TEST(no_dirty_allocated) {
   EXPECT_PANIC(id.blockno = NBUF + 1; buf_cache_get(&tested_dev, &id, 0););
 }
 
+/* Verify a single shard can hold more buffers than its share by stealing
+ * buffers from the other shards. */
+TEST(hot_shard_steals_buffers) {
+  struct device tested_dev = {0};
+  union buf_id id = {.blockno = 0};
+  struct buf* held[NBUF / 2];
+  uint held_count = 0;
+
+  held[held_count++] = buf_cache_get(&tested_dev, &id, 0);
+  while (held_count < ARRAY_LEN(held)) {
+    id.blockno++;
+    struct buf* b = buf_cache_get(&tested_dev, &id, 0);
+    if (b->shard == held[0]->shard) {
+      held[held_count++] = b;
+    } else {
+      buf_cache_release(b);
+    }
+  }
+
+  for (uint i = 0; i < held_count; i++) {
+    EXPECT_TRUE(held[i]->shard == held[0]->shard);
+  }
+}
+
+/* Verify a log of MAXLOGSIZE pinned blocks leaves room for its write and
+ * install batches, kreadahead, and a full op of blocks held on every CPU
+ * by readers that go through more blocks than the cache holds. */
+TEST(max_log_leaves_room_for_readers) {
+  struct device tested_dev = {0};
+  union buf_id id;
+  struct buf* batches[2 * BIO_BATCH_MAX + 1];
+  struct buf* readers[NCPU][MAXOPBLOCKS];
+  uint block = 0;
+
+  /* Committed blocks stay dirty in the cache until installed. */
+  for (uint i = 0; i < MAXLOGSIZE; i++) {
+    id.blockno = block++;
+    struct buf* b = buf_cache_get(&tested_dev, &id, 0);
+    b->flags |= B_VALID | B_DIRTY;
+    buf_cache_release(b);
+  }
+
+  /* A log write batch, an install batch and the readahead block. */
+  for (uint i = 0; i < ARRAY_LEN(batches); i++) {
+    id.blockno = block++;
+    batches[i] = buf_cache_get(&tested_dev, &id, 0);
+  }
+
+  for (uint round = 0; round < 2 * NBUF / (NCPU * MAXOPBLOCKS); round++) {
+    for (uint cpu = 0; cpu < NCPU; cpu++) {
+      for (uint i = 0; i < MAXOPBLOCKS; i++) {
+        id.blockno = block++;
+        readers[cpu][i] = buf_cache_get(&tested_dev, &id, 0);
+        readers[cpu][i]->flags |= B_VALID;
+      }
+    }
+    for (uint cpu = 0; cpu < NCPU; cpu++) {
+      for (uint i = 0; i < MAXOPBLOCKS; i++) {
+        buf_cache_release(readers[cpu][i]);
+      }
+    }
+  }
+
+  /* The committed blocks were never evicted. */
+  for (uint i = 0; i < MAXLOGSIZE; i++) {
+    id.blockno = i;
+    struct buf* b = buf_cache_get(&tested_dev, &id, 0);
+    EXPECT_TRUE(b->flags & B_DIRTY);
+    buf_cache_release(b);
+  }
+}
+
 TEST(lru_mechanism) {
   struct device tested_dev = {0};
   struct device tested_dev2 = {0};
@@ -138,6 +211,191 @@ TEST(allocation_hint) {
   EXPECT_UINT_EQ(1, is_not_cached_buf);
 }
 
+/* Use a working set twice, scan many blocks once, and return how many blocks
+ * of the working set are still cached. */
+static uint working_set_survives_scan(struct device* dev) {
+  union buf_id id;
+  struct buf* b;
+  struct buf_cache_stats before, after;
+  const uint working_set = NBUF / 4;
+
+  for (uint round = 0; round < 2; round++) {
+    for (uint i = 0; i < working_set; i++) {
+      id.blockno = i;
+      b = buf_cache_get(dev, &id, 0);
+      b->flags |= B_VALID;
+      buf_cache_release(b);
+    }
+  }
+
+  for (uint i = 0; i < 2 * NBUF; i++) {
+    id.blockno = working_set + i;
+    b = buf_cache_get(dev, &id, 0);
+    b->flags |= B_VALID;
+    buf_cache_release(b);
+  }
+
+  buf_cache_get_stats(&before);
+  for (uint i = 0; i < working_set; i++) {
+    id.blockno = i;
+    buf_cache_release(buf_cache_get(dev, &id, 0));
+  }
+  buf_cache_get_stats(&after);
+
+  return (after.lists[BUF_CACHE_RECENT].hits -
+          before.lists[BUF_CACHE_RECENT].hits) +
+         (after.lists[BUF_CACHE_FREQUENT].hits -
+          before.lists[BUF_CACHE_FREQUENT].hits);
+}
+
+/* A sequential scan flushes the working set out of an LRU cache. */
+TEST(lru_scan_flushes_working_set) {
+  struct device tested_dev = {0};
+
+  EXPECT_UINT_EQ(0, working_set_survives_scan(&tested_dev));
+}
+
+/* With ARC the working set is kept in the frequent list and survives. */
+TEST(arc_scan_resistance) {
+  struct device tested_dev = {0};
+  struct buf_cache_stats stats;
+
+  buf_cache_set_policy(BUF_CACHE_POLICY_ARC);
+  EXPECT_UINT_EQ(NBUF / 4, working_set_survives_scan(&tested_dev));
+
+  buf_cache_get_stats(&stats);
+  EXPECT_UINT_EQ(NBUF / 4, stats.lists[BUF_CACHE_FREQUENT].size);
+  EXPECT_UINT_EQ(NBUF / 4, stats.lists[BUF_CACHE_RECENT].hits);
+  EXPECT_UINT_EQ(NBUF / 4, stats.lists[BUF_CACHE_FREQUENT].hits);
+  EXPECT_UINT_EQ(NBUF / 4 + 2 * NBUF, stats.misses);
+}
+
+/* Blocks evicted from the recent list too early are counted as ghost hits
+ * and come back to the frequent list. */
+TEST(arc_ghost_hits) {
+  struct device tested_dev = {0};
+  struct buf_cache_stats stats;
+  union buf_id id;
+
+  buf_cache_set_policy(BUF_CACHE_POLICY_ARC);
+  for (uint round = 0; round < 2; round++) {
+    for (uint i = 0; i < NBUF + NBUF / 8; i++) {
+      id.blockno = i;
+      buf_cache_release(buf_cache_get(&tested_dev, &id, 0));
+    }
+  }
+
+  buf_cache_get_stats(&stats);
+  EXPECT_TRUE(stats.lists[BUF_CACHE_RECENT].ghost_hits > 0);
+  EXPECT_TRUE(stats.lists[BUF_CACHE_FREQUENT].size > 0);
+  EXPECT_TRUE(stats.recent_target > NBUF / 2);
+}
+
+/* Switching back to LRU merges the frequent list into the recent list. */
+TEST(policy_switch_back_to_lru) {
+  struct device tested_dev = {0};
+  struct buf_cache_stats stats;
+  union buf_id id;
+
+  buf_cache_set_policy(BUF_CACHE_POLICY_ARC);
+  for (uint round = 0; round < 2; round++) {
+    for (uint i = 0; i < NBUF / 2; i++) {
+      id.blockno = i;
+      buf_cache_release(buf_cache_get(&tested_dev, &id, 0));
+    }
+  }
+  buf_cache_set_policy(BUF_CACHE_POLICY_LRU);
+  EXPECT_UINT_EQ(BUF_CACHE_POLICY_LRU, buf_cache_get_policy());
+
+  buf_cache_get_stats(&stats);
+  EXPECT_UINT_EQ(0, stats.lists[BUF_CACHE_FREQUENT].size);
+  EXPECT_UINT_EQ(NBUF / 2, stats.lists[BUF_CACHE_RECENT].size);
+}
+
+/* Reading a prefetched block does not promote it, and prefetched blocks
+ * evicted before being read are counted as readahead waste. */
+TEST(readahead_waste) {
+  struct device tested_dev = {0};
+  struct buf_cache_stats stats;
+  union buf_id id = {.blockno = 0};
+  struct buf* b;
+
+  buf_cache_set_policy(BUF_CACHE_POLICY_ARC);
+  for (uint i = 0; i < NBUF / 4; i++) {
+    id.blockno = i;
+    b = buf_cache_get(&tested_dev, &id, 0);
+    b->flags |= B_VALID | B_READAHEAD;
+    buf_cache_release(b);
+  }
+
+  // Read half of the prefetched blocks, as bread does.
+  for (uint i = 0; i < NBUF / 8; i++) {
+    id.blockno = i;
+    b = buf_cache_get(&tested_dev, &id, 0);
+    b->flags &= ~B_READAHEAD;
+    buf_cache_release(b);
+  }
+  buf_cache_get_stats(&stats);
+  EXPECT_UINT_EQ(0, stats.lists[BUF_CACHE_FREQUENT].size);
+
+  // Flush the cache.
+  for (uint i = 0; i < NBUF; i++) {
+    id.blockno = NBUF + i;
+    buf_cache_release(buf_cache_get(&tested_dev, &id, 0));
+  }
+
+  buf_cache_get_stats(&stats);
+  EXPECT_UINT_EQ(NBUF / 4 - NBUF / 8, stats.readahead_waste);
+}
+
+#define LOOKUP_BENCHMARK_ITERATIONS (200000)
+
+static void fill_obj_id(union buf_id* id, uint index) {
+  memset(id, 0, sizeof(*id));
+  snprintf(id->obj_id.object_name, sizeof(id->obj_id.object_name),
+           "inode_%u", index);
+  id->obj_id.blockno = index % 4;
+}
+
+static ulong elapsed_ns(const struct timespec* start,
+                        const struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1000000000UL +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+/* Measure the cost of a cache hit as the number of cached buffers grows.
+ * Buffers are named like objfs blocks, so a linear scan would pay a full
+ * buf_id comparison per cached buffer. */
+TEST(lookup_benchmark) {
+  struct device tested_dev = {0};
+  const uint cached_counts[] = {NBUF / 8, NBUF / 4, NBUF / 2, NBUF};
+  uint seed = 0x1337;
+  union buf_id id;
+
+  for (uint c = 0; c < ARRAY_LEN(cached_counts); c++) {
+    const uint count = cached_counts[c];
+    struct timespec start, end;
+
+    buf_cache_init();
+    for (uint i = 0; i < count; i++) {
+      fill_obj_id(&id, i);
+      buf_cache_release(buf_cache_get(&tested_dev, &id, 0));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint i = 0; i < LOOKUP_BENCHMARK_ITERATIONS; i++) {
+      fill_obj_id(&id, rand_r(&seed) % count);
+      struct buf* b = buf_cache_get(&tested_dev, &id, 0);
+      ASSERT_TRUE(0 == memcmp(&b->id, &id, sizeof(id)));
+      buf_cache_release(b);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    PRINT("  %u cached buffers: %lu ns per lookup\n", count,
+          elapsed_ns(&start, &end) / LOOKUP_BENCHMARK_ITERATIONS);
+  }
+}
+
 INIT_TESTS_PLATFORM();
 
 // Should be called before each test
@@ -152,8 +410,18 @@ int main() {
   run_test(buffer_validity);
   run_test(no_used_allocated);
   run_test(no_dirty_allocated);
+  run_test(hot_shard_steals_buffers);
+  run_test(max_log_leaves_room_for_readers);
   run_test(lru_mechanism);
   run_test(allocation_hint);
+  run_test(lru_scan_flushes_working_set);
+  run_test(arc_scan_resistance);
+  run_test(arc_ghost_hits);
+  run_test(policy_switch_back_to_lru);
+  run_test(readahead_waste);
+
+  init_test();
+  run_test_break_msg(lookup_benchmark);
 
   PRINT_TESTS_RESULT("BUF_CACHE_TESTS");
   return CURRENT_TESTS_RESULT();
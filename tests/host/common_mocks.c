@@ -120,6 +120,12 @@ int holding(struct spinlock *lk) {
 
 void release(struct spinlock *lk) { lk->locked = 0; }
 
+void pushcli(void) {}
+
+void popcli(void) {}
+
+int cpuid(void) { return 0; }
+
 struct cgroup *proc_get_cgroup(void) { return 0; }
 
 void cgroup_mem_stat_pgfault_incr(struct cgroup *cgroup) {}
@@ -139,7 +145,7 @@ char *kalloc() {
 void kfree(char *ptr) {
   for (int i = 0; i < NUMBER_OF_PAGES; i++) {
     if (ptr == &g_memory[i][0]) {
-      g_availability_index[i] = 0;
+      g_availability_index[i] = 1;
     }
   }
 }
@@ -1,10 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "common_mocks.h"
 #include "framework/test.h"
 #include "kernel/defs.h"
 #include "kernel/kvector.h"
+#include "kernel/mmu.h"
 
 #define isInfoEqual(info1, info2)                                    \
   ((info1).age == (info2).age && (info1).height == (info2).height && \
@@ -20,6 +23,12 @@ void memmove_into_vector_elements(vector dstvec, unsigned int dstelementoffset,
 void memmove_from_vector(char* dst, vector vec, unsigned int elementoffset,
                          unsigned int elementcount);
 char* getelementpointer(vector v, unsigned int index);
+unsigned int setelement(vector v, unsigned int index, char* data);
+
+// Bytes of data in one link of a vector.
+#define LINK_BYTES (PGSIZE - 2 * sizeof(char*))
+// Links of a vector whose directory takes two levels.
+#define BIG_VECTOR_LINKS (PGSIZE / sizeof(char*) + 10)
 
 TEST(test_initialize_vector) {
   vector v;
@@ -106,6 +115,158 @@ TEST(test_move_elements_with_offset) {
   }
 }
 
+TEST(test_random_access_many_links) {
+  const unsigned int sizes[] = {LINK_BYTES / sizeof(int) * 3,
+                                LINK_BYTES / sizeof(int) * BIG_VECTOR_LINKS};
+
+  for (int s = 0; s < 2; s++) {
+    vector v = newvector(sizes[s], sizeof(int));
+    ASSERT_TRUE(v.valid);
+    for (int i = 0; i < sizes[s]; i++) {
+      ASSERT_TRUE(setelement(v, i, (char*)&i));
+    }
+    unsigned int seed = 0x1337;
+    for (int n = 0; n < 10000; n++) {
+      int i = rand_r(&seed) % sizes[s];
+      ASSERT_TRUE(*(int*)getelementpointer(v, i) == i);
+    }
+    ASSERT_TRUE(getelementpointer(v, sizes[s]) == NULL);
+    freevector(&v);
+  }
+}
+
+TEST(test_move_elements_across_links) {
+  const unsigned int size = LINK_BYTES / sizeof(int) * 4;
+  static int numbers[LINK_BYTES * 4 / sizeof(int)];
+  static int result[LINK_BYTES * 4 / sizeof(int)];
+  vector v = newvector(size, sizeof(int));
+
+  for (int i = 0; i < size; i++) numbers[i] = i * 3;
+  memmove_into_vector_elements(v, 7, (char*)numbers, size - 7);
+  memmove_from_vector((char*)result, v, 7, size - 7);
+  ASSERT_TRUE(!memcmp(numbers, result, (size - 7) * sizeof(int)));
+  for (int i = 7; i < size; i++) {
+    ASSERT_TRUE(*(int*)getelementpointer(v, i) == numbers[i - 7]);
+  }
+  freevector(&v);
+}
+
+TEST(test_cursor_read_and_write) {
+  const unsigned int size = LINK_BYTES * 3 + 100;
+  static char data[LINK_BYTES * 3 + 100];
+  static char result[LINK_BYTES * 3 + 100];
+  vector v = newvector(size, 1);
+  vector_cursor c;
+
+  for (int i = 0; i < size; i++) data[i] = i % 251;
+
+  // Fill in uneven chunks that straddle the links.
+  initvectorcursor(v, 0, &c);
+  for (unsigned int done = 0, chunk = 1; done < size; chunk = chunk * 2 + 1) {
+    done += cursorwrite(&c, data + done, min(chunk, size - done));
+  }
+  ASSERT_UINT_EQ(0, cursorwrite(&c, data, 1));
+
+  initvectorcursor(v, 0, &c);
+  ASSERT_UINT_EQ(size, cursorread(&c, result, size + 10));
+  ASSERT_TRUE(!memcmp(data, result, size));
+
+  // Start from the first byte of the second link.
+  memset(result, 0, size);
+  initvectorcursor(v, LINK_BYTES, &c);
+  ASSERT_UINT_EQ(size - LINK_BYTES, cursorread(&c, result, size));
+  ASSERT_TRUE(!memcmp(data + LINK_BYTES, result, size - LINK_BYTES));
+
+  initvectorcursor(v, size, &c);
+  ASSERT_UINT_EQ(0, cursorread(&c, result, 1));
+  freevector(&v);
+}
+
+TEST(test_buffer_vector) {
+  int numbers[] = {10, 20, 40, 80};
+  int buffer[4] = {0};
+  int result[4] = {0};
+  int value = 30;
+  struct kvec_stats before, after;
+  vector_cursor c;
+
+  getvectorstats(&before);
+  vector v = buffervector((char*)buffer, 4, sizeof(int));
+  ASSERT_TRUE(v.valid);
+
+  memmove_into_vector_elements(v, 0, (char*)numbers, 4);
+  ASSERT_TRUE(!memcmp(buffer, numbers, sizeof(numbers)));
+  ASSERT_TRUE(getelementpointer(v, 2) == (char*)&buffer[2]);
+  ASSERT_TRUE(setelement(v, 2, (char*)&value));
+  ASSERT_TRUE(buffer[2] == value);
+
+  initvectorcursor(v, sizeof(int), &c);
+  ASSERT_UINT_EQ(3 * sizeof(int),
+                 cursorwrite(&c, (char*)numbers, sizeof(numbers)));
+  ASSERT_TRUE(!memcmp(&buffer[1], numbers, 3 * sizeof(int)));
+
+  memmove_from_vector((char*)result, v, 0, 4);
+  ASSERT_TRUE(!memcmp(result, buffer, sizeof(buffer)));
+
+  // Nothing went through vector links.
+  getvectorstats(&after);
+  ASSERT_UINT_EQ(before.pages, after.pages);
+  ASSERT_UINT_EQ(before.copied, after.copied);
+
+  freevector(&v);
+  ASSERT_TRUE(buffer[0] == numbers[0]);
+}
+
+#define BENCHMARK_LINKS (64)
+#define BENCHMARK_ITERATIONS (1000000)
+
+static unsigned long elapsed_ns(const struct timespec* start,
+                                const struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1000000000UL +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+/* Measure accesses at random indices of a vector of BENCHMARK_LINKS links.
+ * Walking the list would make these cost about BENCHMARK_LINKS / 2 links. */
+TEST(random_access_benchmark) {
+  const unsigned int size = LINK_BYTES / sizeof(int) * BENCHMARK_LINKS;
+  vector v = newvector(size, sizeof(int));
+  unsigned int seed = 0x1337, sum = 0;
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    sum += *(int*)getelementpointer(v, rand_r(&seed) % size);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ASSERT_UINT_EQ(0, sum);
+
+  PRINT("  %u links: %lu ns per access\n", BENCHMARK_LINKS,
+        elapsed_ns(&start, &end) / BENCHMARK_ITERATIONS);
+  freevector(&v);
+}
+
+/* Measure filling and draining a vector of BENCHMARK_LINKS links in order,
+ * as the file systems move file contents. */
+TEST(sequential_copy_benchmark) {
+  const unsigned int size = LINK_BYTES * BENCHMARK_LINKS;
+  static char buf[LINK_BYTES * BENCHMARK_LINKS];
+  vector v = newvector(size, 1);
+  struct timespec start, end;
+  const int rounds = 100;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < rounds; r++) {
+    memmove_into_vector_bytes(v, 0, buf, size);
+    memmove_from_vector(buf, v, 0, size);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  PRINT("  %u KB in and out: %lu ns per KB\n", size / 1024,
+        elapsed_ns(&start, &end) / (rounds * 2 * (size / 1024)));
+  freevector(&v);
+}
+
 // Should be called before each test
 void init_test() { init_mocks_environment(); }
 
@@ -120,6 +281,13 @@ int main() {
   run_test(test_move_bytes_with_offset);
   run_test(test_move_elements);
   run_test(test_move_elements_with_offset);
+  run_test(test_random_access_many_links);
+  run_test(test_move_elements_across_links);
+  run_test(test_cursor_read_and_write);
+  run_test(test_buffer_vector);
+
+  run_test_break_msg(random_access_benchmark);
+  run_test_break_msg(sequential_copy_benchmark);
 
   PRINT_TESTS_RESULT("KVECTOR_TESTS");
   return CURRENT_TESTS_RESULT();
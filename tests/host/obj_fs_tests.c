@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "common_mocks.h"
 #include "framework/test.h"
@@ -23,6 +24,42 @@ struct device mock_device = {
 #define TESTED_DEVICE (&mock_device)
 
 void deviceput(struct device* dev) {}
+void deviceget(struct device* dev) {}
+
+/**
+ * A disk to keep the object store on, read and written through the buffer
+ * cache like the IDE disk.
+ */
+#define MOCK_DISK_BLOCKS 1024
+// The store begins past the blocks of a file system.
+#define MOCK_DISK_STORE_START 24
+
+static uchar mock_disk[MOCK_DISK_BLOCKS][BSIZE];
+static uint mock_disk_reads;
+
+struct device mock_disk_device = {
+    .id = 2,
+    .type = DEVICE_TYPE_IDE,
+    .private = NULL,
+    .ref = 1,
+    .ops = NULL,
+};
+
+struct buf* bread(const struct device* const dev, uint blockno) {
+  union buf_id id = {.blockno = blockno};
+  struct buf* b = buf_cache_get(dev, &id, 0);
+
+  if (!(b->flags & B_VALID)) {
+    mock_disk_reads++;
+    memmove(b->data, mock_disk[blockno], BSIZE);
+    b->flags |= B_VALID;
+  }
+  return b;
+}
+
+void bwrite(struct buf* b) {
+  memmove(mock_disk[b->id.blockno], b->data, BSIZE);
+}
 
 /**
  * Utility test functions
@@ -429,12 +466,598 @@ TEST(add_when_there_is_no_more_disk_left) {
                             STORAGE_DEVICE_SIZE + 1));
 }
 
+#define FRAGMENTS_COUNT 100
+#define FRAGMENT_SIZE 1000
+
+/* Add FRAGMENTS_COUNT pairs of objects and delete the second of each pair
+ * but the last, leaving FRAGMENT_SIZE holes between the objects. The
+ * objects are filled with their index. Compacting the store moves
+ * FRAGMENTS_COUNT objects. */
+static void fragment_store(const char* name) {
+  char object_id[OBJECT_ID_LENGTH] = {};
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(FRAGMENT_SIZE)];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+
+  for (uint i = 0; i < FRAGMENTS_COUNT; i++) {
+    vector_bufs_memset(bufs_vec, i, FRAGMENT_SIZE);
+    snprintf(object_id, sizeof(object_id), "kept_%u", i);
+    ASSERT_NO_ERR(
+        add_object(TESTED_DEVICE, object_id, bufs_vec, FRAGMENT_SIZE));
+    snprintf(object_id, sizeof(object_id), "hole_%u", i);
+    ASSERT_NO_ERR(
+        add_object(TESTED_DEVICE, object_id, bufs_vec, FRAGMENT_SIZE));
+  }
+  for (uint i = 0; i < FRAGMENTS_COUNT - 1; i++) {
+    snprintf(object_id, sizeof(object_id), "hole_%u", i);
+    ASSERT_NO_ERR(delete_object(TESTED_DEVICE, object_id));
+  }
+  freevector(&bufs_vec);
+}
+
+static void expect_fragmented_objects_kept(const char* name) {
+  char object_id[OBJECT_ID_LENGTH] = {};
+  char data[FRAGMENT_SIZE], expected[FRAGMENT_SIZE];
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(FRAGMENT_SIZE)];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+
+  for (uint i = 0; i < FRAGMENTS_COUNT; i++) {
+    snprintf(object_id, sizeof(object_id), "kept_%u", i);
+    ASSERT_NO_ERR(get_object(TESTED_DEVICE, object_id, bufs_vec));
+    copy_bufs_vector_to_buffer(data, bufs_vec, FRAGMENT_SIZE);
+    memset(expected, i, FRAGMENT_SIZE);
+    ASSERT_TRUE(0 == memcmp(data, expected, FRAGMENT_SIZE));
+  }
+  freevector(&bufs_vec);
+}
+
+/* An object larger than any hole, but not than the free bytes, is added
+ * by compacting the store. */
+TEST(compaction_on_allocation_failure) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  struct obj_disk_stats stats;
+
+  fragment_store(name);
+  uint free_bytes = device_size(device) - occupied_bytes(device);
+  uint largest_hole = free_bytes - (FRAGMENTS_COUNT - 1) * FRAGMENT_SIZE;
+  uint big_size = largest_hole + 1;
+  struct buf* big_bufs =
+      malloc(SIZE_TO_NUM_OF_BUFS(big_size) * sizeof(struct buf));
+  ASSERT_NE(big_bufs, 0);
+  vector big_vec = new_bufs_vector(big_bufs, SIZE_TO_NUM_OF_BUFS(big_size));
+
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "big object", big_vec, big_size));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(1, stats.compactions);
+  EXPECT_UINT_EQ(FRAGMENTS_COUNT * FRAGMENT_SIZE, stats.bytes_moved);
+  expect_fragmented_objects_kept(name);
+
+  freevector(&big_vec);
+  free(big_bufs);
+}
+
+/* Compaction on demand reports the moved bytes, and moves nothing once the
+ * store is compact. */
+TEST(compaction_on_demand) {
+  struct obj_disk_stats stats;
+
+  fragment_store(name);
+  EXPECT_UINT_EQ(FRAGMENTS_COUNT * FRAGMENT_SIZE,
+                 compact_obj_device(TESTED_DEVICE));
+  EXPECT_UINT_EQ(0, compact_obj_device(TESTED_DEVICE));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(2, stats.compactions);
+  expect_fragmented_objects_kept(name);
+}
+
+#define DEDUP_OBJECT_SIZE 3000
+
+static void add_filled_object(const char* name, const char* object_id,
+                              char c, uint size) {
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(DEDUP_OBJECT_SIZE)];
+  vector bufs_vec = new_bufs_vector(bufs, SIZE_TO_NUM_OF_BUFS(size));
+
+  vector_bufs_memset(bufs_vec, c, size);
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, object_id, bufs_vec, size));
+  freevector(&bufs_vec);
+}
+
+static void write_filled_object(const char* name, const char* object_id,
+                                char c, uint size) {
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(DEDUP_OBJECT_SIZE)];
+  vector bufs_vec = new_bufs_vector(bufs, SIZE_TO_NUM_OF_BUFS(size));
+
+  vector_bufs_memset(bufs_vec, c, size);
+  ASSERT_NO_ERR(write_object(TESTED_DEVICE, object_id, bufs_vec, size));
+  freevector(&bufs_vec);
+}
+
+static void expect_filled_object(const char* name, const char* object_id,
+                                 char c, uint size) {
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(DEDUP_OBJECT_SIZE)];
+  vector bufs_vec = new_bufs_vector(bufs, SIZE_TO_NUM_OF_BUFS(size));
+  char data[DEDUP_OBJECT_SIZE], expected[DEDUP_OBJECT_SIZE];
+
+  ASSERT_NO_ERR(get_object(TESTED_DEVICE, object_id, bufs_vec));
+  copy_bufs_vector_to_buffer(data, bufs_vec, size);
+  memset(expected, c, size);
+  EXPECT_TRUE(0 == memcmp(data, expected, size));
+  freevector(&bufs_vec);
+}
+
+/* Objects of equal content share the storage until the last is deleted. */
+TEST(dedup_equal_objects_share_storage) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  struct obj_disk_stats stats;
+  uint initial_bytes = occupied_bytes(device);
+
+  set_obj_device_dedup(TESTED_DEVICE, 1);
+  add_filled_object(name, "copy 1", 'a', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "other", 'b', DEDUP_OBJECT_SIZE);
+  ASSERT_UINT_EQ(initial_bytes + 2 * DEDUP_OBJECT_SIZE,
+                 occupied_bytes(device));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(1, stats.dedup_hits);
+  EXPECT_UINT_EQ(3 * DEDUP_OBJECT_SIZE, stats.dedup_logical_bytes);
+  EXPECT_UINT_EQ(2 * DEDUP_OBJECT_SIZE, stats.dedup_stored_bytes);
+
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "copy 1"));
+  ASSERT_UINT_EQ(initial_bytes + 2 * DEDUP_OBJECT_SIZE,
+                 occupied_bytes(device));
+  expect_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "copy 2"));
+  ASSERT_UINT_EQ(initial_bytes + DEDUP_OBJECT_SIZE, occupied_bytes(device));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(DEDUP_OBJECT_SIZE, stats.dedup_logical_bytes);
+  EXPECT_UINT_EQ(DEDUP_OBJECT_SIZE, stats.dedup_stored_bytes);
+}
+
+/* Rewriting a shared object leaves the other copies intact, and rewriting
+ * it back to their content shares the storage again. */
+TEST(dedup_rewrite_shared_object) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  struct obj_disk_stats stats;
+  uint initial_bytes = occupied_bytes(device);
+
+  set_obj_device_dedup(TESTED_DEVICE, 1);
+  add_filled_object(name, "copy 1", 'a', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  write_filled_object(name, "copy 1", 'b', DEDUP_OBJECT_SIZE / 2);
+  expect_filled_object(name, "copy 1", 'b', DEDUP_OBJECT_SIZE / 2);
+  expect_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  ASSERT_UINT_EQ(initial_bytes + DEDUP_OBJECT_SIZE + DEDUP_OBJECT_SIZE / 2,
+                 occupied_bytes(device));
+
+  write_filled_object(name, "copy 1", 'a', DEDUP_OBJECT_SIZE);
+  expect_filled_object(name, "copy 1", 'a', DEDUP_OBJECT_SIZE);
+  ASSERT_UINT_EQ(initial_bytes + DEDUP_OBJECT_SIZE, occupied_bytes(device));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(2, stats.dedup_hits);
+  EXPECT_UINT_EQ(2 * DEDUP_OBJECT_SIZE, stats.dedup_logical_bytes);
+  EXPECT_UINT_EQ(DEDUP_OBJECT_SIZE, stats.dedup_stored_bytes);
+}
+
+/* Compaction moves shared storage once and keeps it shared. */
+TEST(dedup_compaction) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  char object_id[OBJECT_ID_LENGTH] = {};
+  uint initial_bytes = occupied_bytes(device);
+  const uint count = 20, size = 1000;
+
+  set_obj_device_dedup(TESTED_DEVICE, 1);
+  for (uint i = 0; i < count; i++) {
+    snprintf(object_id, sizeof(object_id), "x_%u", i);
+    add_filled_object(name, object_id, i, size);
+    snprintf(object_id, sizeof(object_id), "gap_%u", i);
+    add_filled_object(name, object_id, 100 + i, size);
+    snprintf(object_id, sizeof(object_id), "y_%u", i);
+    add_filled_object(name, object_id, i, size);
+  }
+  for (uint i = 0; i < count - 1; i++) {
+    snprintf(object_id, sizeof(object_id), "gap_%u", i);
+    ASSERT_NO_ERR(delete_object(TESTED_DEVICE, object_id));
+  }
+
+  EXPECT_UINT_EQ(count * size, compact_obj_device(TESTED_DEVICE));
+  for (uint i = 0; i < count; i++) {
+    snprintf(object_id, sizeof(object_id), "x_%u", i);
+    expect_filled_object(name, object_id, i, size);
+    ASSERT_NO_ERR(delete_object(TESTED_DEVICE, object_id));
+    snprintf(object_id, sizeof(object_id), "y_%u", i);
+    expect_filled_object(name, object_id, i, size);
+    ASSERT_NO_ERR(delete_object(TESTED_DEVICE, object_id));
+  }
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "gap_19"));
+  ASSERT_UINT_EQ(initial_bytes, occupied_bytes(device));
+}
+
+// Replace the RAM store of the tested device with the store of the mock
+// disk, formatting it if `format`.
+static void use_disk_store(const char* name, int format) {
+  if (format) {
+    memset(mock_disk, 0, sizeof(mock_disk));
+  }
+  mock_device.ops->destroy(&mock_device);
+  ASSERT_NO_ERR(init_block_obj_device(
+      &mock_device, &mock_disk_device, MOCK_DISK_STORE_START,
+      MOCK_DISK_BLOCKS - MOCK_DISK_STORE_START));
+}
+
+/* Objects written to a disk store are found again when it is loaded. */
+TEST(disk_store_persists_objects) {
+  struct obj_device_private* device;
+  struct buf empty_buf;
+  vector empty_vec = new_bufs_vector(&empty_buf, 1);
+  uint objects, bytes, free_bytes, size;
+
+  use_disk_store(name, 1);
+  device = dev_private(&mock_device);
+  EXPECT_UINT_EQ((MOCK_DISK_BLOCKS - MOCK_DISK_STORE_START) * BSIZE,
+                 device_size(device));
+  add_filled_object(name, "kept", 'a', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "deleted", 'b', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "moved", 'c', DEDUP_OBJECT_SIZE / 2);
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "empty", empty_vec, 0));
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "deleted"));
+  write_filled_object(name, "moved", 'd', DEDUP_OBJECT_SIZE);
+  objects = occupied_objects(device);
+  bytes = occupied_bytes(device);
+  free_bytes = device->extents->bytes;
+
+  use_disk_store(name, 0);
+  device = dev_private(&mock_device);
+  EXPECT_UINT_EQ(objects, occupied_objects(device));
+  EXPECT_UINT_EQ(bytes, occupied_bytes(device));
+  expect_filled_object(name, "kept", 'a', DEDUP_OBJECT_SIZE);
+  expect_filled_object(name, "moved", 'd', DEDUP_OBJECT_SIZE);
+  ASSERT_NO_ERR(object_size(TESTED_DEVICE, "empty", &size));
+  EXPECT_UINT_EQ(0, size);
+  ASSERT_UINT_EQ(OBJECT_NOT_EXISTS,
+                 object_size(TESTED_DEVICE, "deleted", &size));
+  // The free space is rebuilt from the table.
+  EXPECT_UINT_EQ(free_bytes, device->extents->bytes);
+  freevector(&empty_vec);
+}
+
+/* Objects sharing content stay shared when the store is loaded. */
+TEST(disk_store_persists_dedup) {
+  struct obj_device_private* device;
+  struct obj_disk_stats stats;
+  uint bytes;
+
+  use_disk_store(name, 1);
+  set_obj_device_dedup(TESTED_DEVICE, 1);
+  add_filled_object(name, "copy 1", 'a', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  bytes = occupied_bytes(dev_private(&mock_device));
+
+  use_disk_store(name, 0);
+  device = dev_private(&mock_device);
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(2 * DEDUP_OBJECT_SIZE, stats.dedup_logical_bytes);
+  EXPECT_UINT_EQ(DEDUP_OBJECT_SIZE, stats.dedup_stored_bytes);
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "copy 1"));
+  EXPECT_UINT_EQ(bytes, occupied_bytes(device));
+  expect_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+}
+
+/* Rewriting an object writes only the blocks whose bytes change. */
+TEST(disk_store_writes_changed_blocks) {
+  const uint size = 8 * BSIZE;
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(size)];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+  struct obj_disk_stats before, after;
+
+  use_disk_store(name, 1);
+  vector_bufs_memset(bufs_vec, 'a', size);
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "object", bufs_vec, size));
+
+  bufs[ARRAY_LEN(bufs) / 2].data[7] = 'b';
+  obj_device_get_stats(TESTED_DEVICE, &before);
+  ASSERT_NO_ERR(write_object(TESTED_DEVICE, "object", bufs_vec, size));
+  obj_device_get_stats(TESTED_DEVICE, &after);
+  // The entry and the super block did not change either.
+  EXPECT_UINT_EQ(1, after.blocks_written - before.blocks_written);
+  freevector(&bufs_vec);
+}
+
+/* Compaction moves the objects on the disk and their table entries along. */
+TEST(disk_store_compaction) {
+  use_disk_store(name, 1);
+  fragment_store(name);
+  EXPECT_UINT_EQ(FRAGMENTS_COUNT * FRAGMENT_SIZE,
+                 compact_obj_device(TESTED_DEVICE));
+  expect_fragmented_objects_kept(name);
+
+  use_disk_store(name, 0);
+  expect_fragmented_objects_kept(name);
+}
+
+/* A disk store holds objects larger than the RAM kept for its table. */
+TEST(disk_store_big_object) {
+  const uint size = STORAGE_DEVICE_SIZE + 16 * BSIZE;
+  struct buf* bufs = malloc(SIZE_TO_NUM_OF_BUFS(size) * sizeof(struct buf));
+  vector bufs_vec = new_bufs_vector(bufs, SIZE_TO_NUM_OF_BUFS(size));
+  char* data = malloc(size);
+  char* read = malloc(size);
+
+  for (uint i = 0; i < size; i++) {
+    data[i] = i % 251;
+  }
+  use_disk_store(name, 1);
+  copy_buffer_to_bufs_vector(bufs_vec, data, size);
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "big", bufs_vec, size));
+
+  use_disk_store(name, 0);
+  memset(bufs, 0, SIZE_TO_NUM_OF_BUFS(size) * sizeof(struct buf));
+  ASSERT_NO_ERR(get_object(TESTED_DEVICE, "big", bufs_vec));
+  copy_bufs_vector_to_buffer(read, bufs_vec, size);
+  EXPECT_TRUE(0 == memcmp(data, read, size));
+
+  freevector(&bufs_vec);
+  free(bufs);
+  free(data);
+  free(read);
+}
+
+/* A range write changes only its blocks, and a range read fills only the
+ * buffers that are not valid yet. */
+TEST(object_range_read_and_write) {
+  const uint size = 3 * BUF_DATA_SIZE;
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(size)];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+  struct buf range_buf = {0};
+  vector range_vec = new_bufs_vector(&range_buf, 1);
+
+  add_filled_object(name, "object", 'a', size);
+  memset(range_buf.data, 'b', BUF_DATA_SIZE);
+  range_buf.flags = B_VALID | B_DIRTY;
+  ASSERT_NO_ERR(
+      write_object_range(TESTED_DEVICE, "object", range_vec, 1, size));
+  EXPECT_UINT_EQ(B_VALID, range_buf.flags);
+
+  memset(bufs, 0, sizeof(bufs));
+  bufs[1].flags = B_VALID;
+  ASSERT_NO_ERR(get_object_range(TESTED_DEVICE, "object", bufs_vec, 0));
+  EXPECT_UINT_EQ('a', bufs[0].data[BUF_DATA_SIZE - 1]);
+  EXPECT_UINT_EQ(0, bufs[1].data[0]);
+  EXPECT_UINT_EQ('a', bufs[2].data[0]);
+  ASSERT_NO_ERR(get_object(TESTED_DEVICE, "object", bufs_vec));
+  EXPECT_UINT_EQ('b', bufs[1].data[0]);
+  EXPECT_UINT_EQ('b', bufs[1].data[BUF_DATA_SIZE - 1]);
+
+  // Bytes past the end of the object read as zeros.
+  range_buf.flags = 0;
+  ASSERT_NO_ERR(get_object_range(TESTED_DEVICE, "object", range_vec, 3));
+  EXPECT_UINT_EQ(0, range_buf.data[0]);
+  ASSERT_UINT_EQ(OBJECT_NOT_EXISTS,
+                 get_object_range(TESTED_DEVICE, "missing", range_vec, 0));
+
+  freevector(&range_vec);
+  freevector(&bufs_vec);
+}
+
+/* An object growing by range writes moves to where it has room to grow
+ * further, and then grows in place. */
+TEST(object_range_growth) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  struct buf bufs[3];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+  struct buf range_buf = {0};
+  vector range_vec = new_bufs_vector(&range_buf, 1);
+  uint initial_bytes = occupied_bytes(device), offset;
+
+  add_filled_object(name, "neighbour", 'a', BUF_DATA_SIZE);
+  add_filled_object(name, "object", 'b', BUF_DATA_SIZE);
+  offset = find_object_offset("object");
+
+  // The neighbour is right after the object, so the object moves.
+  memset(range_buf.data, 'c', BUF_DATA_SIZE);
+  ASSERT_NO_ERR(write_object_range(TESTED_DEVICE, "object", range_vec, 1,
+                                   2 * BUF_DATA_SIZE));
+  ASSERT_NE(offset, find_object_offset("object"));
+  offset = find_object_offset("object");
+  ASSERT_NO_ERR(write_object_range(TESTED_DEVICE, "object", range_vec, 2,
+                                   3 * BUF_DATA_SIZE));
+  EXPECT_UINT_EQ(offset, find_object_offset("object"));
+  EXPECT_UINT_EQ(initial_bytes + 4 * BUF_DATA_SIZE, occupied_bytes(device));
+
+  memset(bufs, 0, sizeof(bufs));
+  ASSERT_NO_ERR(get_object(TESTED_DEVICE, "object", bufs_vec));
+  EXPECT_UINT_EQ('b', bufs[0].data[0]);
+  EXPECT_UINT_EQ('c', bufs[1].data[0]);
+  EXPECT_UINT_EQ('c', bufs[2].data[BUF_DATA_SIZE - 1]);
+  expect_filled_object(name, "neighbour", 'a', BUF_DATA_SIZE);
+
+  // Shrinking frees the tail.
+  ASSERT_NO_ERR(write_object_range(TESTED_DEVICE, "object", range_vec, 0,
+                                   BUF_DATA_SIZE / 2));
+  EXPECT_UINT_EQ(initial_bytes + BUF_DATA_SIZE + BUF_DATA_SIZE / 2,
+                 occupied_bytes(device));
+
+  freevector(&range_vec);
+  freevector(&bufs_vec);
+}
+
+/* A range write to a shared object leaves the other copies intact. */
+TEST(object_range_write_unshares) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  struct obj_disk_stats stats;
+  struct buf range_buf = {0};
+  vector range_vec = new_bufs_vector(&range_buf, 1);
+  uint initial_bytes = occupied_bytes(device);
+
+  set_obj_device_dedup(TESTED_DEVICE, 1);
+  add_filled_object(name, "copy 1", 'a', DEDUP_OBJECT_SIZE);
+  add_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  memset(range_buf.data, 'a', BUF_DATA_SIZE);
+  range_buf.data[0] = 'b';
+  ASSERT_NO_ERR(write_object_range(TESTED_DEVICE, "copy 1", range_vec, 0,
+                                   DEDUP_OBJECT_SIZE));
+  expect_filled_object(name, "copy 2", 'a', DEDUP_OBJECT_SIZE);
+  ASSERT_UINT_EQ(initial_bytes + 2 * DEDUP_OBJECT_SIZE,
+                 occupied_bytes(device));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(DEDUP_OBJECT_SIZE, stats.dedup_logical_bytes);
+  EXPECT_UINT_EQ(DEDUP_OBJECT_SIZE, stats.dedup_stored_bytes);
+
+  // The owner of a blob is changed in place.
+  range_buf.data[0] = 'a';
+  ASSERT_NO_ERR(write_object_range(TESTED_DEVICE, "copy 2", range_vec, 0,
+                                   DEDUP_OBJECT_SIZE));
+  ASSERT_UINT_EQ(initial_bytes + 2 * DEDUP_OBJECT_SIZE,
+                 occupied_bytes(device));
+  obj_device_get_stats(TESTED_DEVICE, &stats);
+  EXPECT_UINT_EQ(0, stats.dedup_logical_bytes);
+  freevector(&range_vec);
+}
+
+#define LOOKUP_BENCHMARK_ITERATIONS (200000)
+
+static ulong elapsed_ns(const struct timespec* start,
+                        const struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1000000000UL +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+/* Measure the cost of finding an object as the objects table fills up.
+ * The table grows past INITIAL_OBJECT_TABLE_SIZE, so a linear scan would
+ * pay for every entry ahead of the object. */
+TEST(lookup_benchmark) {
+  const uint object_counts[] = {INITIAL_OBJECT_TABLE_SIZE / 4,
+                                INITIAL_OBJECT_TABLE_SIZE, 1024, 2048};
+  char object_id[OBJECT_ID_LENGTH] = {};
+  uint data = 0, size, added = 0, seed = 0x1337;
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(sizeof(data))];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+
+  for (uint c = 0; c < ARRAY_LEN(object_counts); c++) {
+    const uint count = object_counts[c];
+    struct timespec start, end;
+
+    for (; added < count; added++) {
+      snprintf(object_id, sizeof(object_id), "objid_%u", added);
+      ASSERT_NO_ERR(
+          add_object(TESTED_DEVICE, object_id, bufs_vec, sizeof(data)));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint i = 0; i < LOOKUP_BENCHMARK_ITERATIONS; i++) {
+      snprintf(object_id, sizeof(object_id), "objid_%u",
+               rand_r(&seed) % count);
+      ASSERT_NO_ERR(object_size(TESTED_DEVICE, object_id, &size));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    PRINT("  %u objects: %lu ns per lookup\n", count,
+          elapsed_ns(&start, &end) / LOOKUP_BENCHMARK_ITERATIONS);
+  }
+  freevector(&bufs_vec);
+}
+
+/* A new object takes the end of the smallest hole it fits in. */
+TEST(best_fit_allocation) {
+  uint data[32] = {0};
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(sizeof(data))];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "large hole", bufs_vec, 100));
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "separator 1", bufs_vec, 4));
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "small hole", bufs_vec, 50));
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "separator 2", bufs_vec, 4));
+  uint small_hole_offset = find_object_offset("small hole");
+  ASSERT_NE(small_hole_offset, -1);
+
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "large hole"));
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "small hole"));
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "best fit", bufs_vec, 40));
+  ASSERT_UINT_EQ(small_hole_offset + 10, find_object_offset("best fit"));
+
+  freevector(&bufs_vec);
+}
+
+/* Freed neighbours merge, so an object of their total size fits. */
+TEST(freed_neighbours_coalesce) {
+  struct obj_device_private* device = dev_private(&mock_device);
+  const uint object_size = 2000;
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(object_size * 3)];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "left", bufs_vec, object_size));
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "middle", bufs_vec, object_size));
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "right", bufs_vec, object_size));
+  // Fill the rest of the disk.
+  ASSERT_NO_ERR(add_object(TESTED_DEVICE, "filler", bufs_vec, 0));
+  uint filler_size = device_size(device) - occupied_bytes(device);
+  struct buf* filler_bufs =
+      malloc(SIZE_TO_NUM_OF_BUFS(filler_size) * sizeof(struct buf));
+  ASSERT_NE(filler_bufs, 0);
+  vector filler_vec =
+      new_bufs_vector(filler_bufs, SIZE_TO_NUM_OF_BUFS(filler_size));
+  ASSERT_NO_ERR(
+      write_object(TESTED_DEVICE, "filler", filler_vec, filler_size));
+  freevector(&filler_vec);
+  free(filler_bufs);
+
+  ASSERT_UINT_EQ(NO_DISK_SPACE_FOUND,
+                 add_object(TESTED_DEVICE, "joined", bufs_vec, 1));
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "left"));
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "right"));
+  ASSERT_NO_ERR(delete_object(TESTED_DEVICE, "middle"));
+  ASSERT_NO_ERR(
+      add_object(TESTED_DEVICE, "joined", bufs_vec, object_size * 3));
+
+  freevector(&bufs_vec);
+}
+
+/* Measure the cost of creating an object as the objects table grows. Every
+ * other object is deleted before moving on, so the store is fragmented
+ * and allocations search among many free extents. */
+TEST(creation_benchmark) {
+  const uint object_counts[] = {INITIAL_OBJECT_TABLE_SIZE / 4,
+                                INITIAL_OBJECT_TABLE_SIZE, 1024, 2048};
+  char object_id[OBJECT_ID_LENGTH] = {};
+  uint data[2] = {0}, created = 0;
+  struct buf bufs[SIZE_TO_NUM_OF_BUFS(sizeof(data))];
+  vector bufs_vec = new_bufs_vector(bufs, ARRAY_LEN(bufs));
+
+  for (uint c = 0; c < ARRAY_LEN(object_counts); c++) {
+    const uint count = object_counts[c];
+    const uint first = created;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (; created < count; created++) {
+      snprintf(object_id, sizeof(object_id), "objid_%u", created);
+      ASSERT_NO_ERR(add_object(TESTED_DEVICE, object_id, bufs_vec,
+                               sizeof(uint) * (1 + created % 2)));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    PRINT("  %u objects: %lu ns per creation\n", count,
+          elapsed_ns(&start, &end) / (count - first));
+
+    for (uint i = first; i < count; i += 2) {
+      snprintf(object_id, sizeof(object_id), "objid_%u", i);
+      ASSERT_NO_ERR(delete_object(TESTED_DEVICE, object_id));
+    }
+  }
+  freevector(&bufs_vec);
+}
+
 /**
  * The following tests validate the correctness of the cache layer.
- * The tests use the `objects_cache_hits` and `objects_cache_misses` methods
- * to check the cache behavior vs the expected flow.
+ * The tests use the statistics of `obj_cache_get_stats` to check the cache
+ * behavior vs the expected flow.
  */
 
+static struct obj_cache_stats cache_stats(void) {
+  struct obj_cache_stats stats;
+
+  obj_cache_get_stats(TESTED_DEVICE, &stats);
+  return stats;
+}
+
 /* Add objects in different sizes to cache. */
 TEST(add_objects_to_cache) {
   char obj1_name[] = "obj1";
@@ -467,8 +1090,8 @@ TEST(get_object_in_cache) {
   ASSERT_NO_ERR(
       obj_cache_add(TESTED_DEVICE, obj_name, my_string, sizeof(my_string)));
 
-  uint misses_at_start = objects_cache_misses();
-  uint hits_at_start = objects_cache_hits();
+  uint misses_at_start = cache_stats().misses;
+  uint hits_at_start = cache_stats().hits;
 
   // validate correctness
   vector actual = newvector(1, sizeof(my_string));
@@ -477,8 +1100,8 @@ TEST(get_object_in_cache) {
   ASSERT_UINT_EQ(0, vectormemcmp(actual, my_string, sizeof(my_string)));
 
   // validate hits and misses
-  EXPECT_UINT_EQ(0, objects_cache_misses() - misses_at_start);
-  EXPECT_UINT_EQ(1, objects_cache_hits() - hits_at_start);
+  EXPECT_UINT_EQ(0, cache_stats().misses - misses_at_start);
+  EXPECT_UINT_EQ(1, cache_stats().hits - hits_at_start);
 
   freevector(&actual);
 }
@@ -574,7 +1197,7 @@ TEST(cache_write_big_object) {
   }
 
   /* Read some data of the big object */
-  uint misses_at_start = objects_cache_misses();
+  uint misses_at_start = cache_stats().misses;
 
   uint read_offset = obj_size / 2;
   uint read_blocks = 5;
@@ -584,7 +1207,7 @@ TEST(cache_write_big_object) {
                                read_offset, obj_size));
   ASSERT_UINT_EQ(0, vectormemcmp(read_data, obj_data + read_offset, read_size));
 
-  ASSERT_GT((objects_cache_misses() - misses_at_start), 0);
+  ASSERT_GT((cache_stats().misses - misses_at_start), 0);
 
   /* Remove some of the big object from cache by inserting other objects */
   for (uint i = 0; i < (NBUF - read_blocks - (2 * OBJ_CACHE_BLOCKS_PADDING));
@@ -599,14 +1222,14 @@ TEST(cache_write_big_object) {
   /* Try to read again the same region of the big object, and verify it's still
    * cached (because this region should get higher priority and shouldn't be
    * removed from cache). */
-  uint hits_at_start = objects_cache_hits();
+  uint hits_at_start = cache_stats().hits;
 
   read_data = newvector(read_size, 1);
   ASSERT_NO_ERR(obj_cache_read(TESTED_DEVICE, obj_name, &read_data, read_size,
                                read_offset, obj_size));
   ASSERT_UINT_EQ(0, vectormemcmp(read_data, obj_data + read_offset, read_size));
 
-  ASSERT_GT((objects_cache_hits() - hits_at_start), 0);
+  ASSERT_GT((cache_stats().hits - hits_at_start), 0);
 
   freevector(&read_data);
   free(obj_data);
@@ -628,6 +1251,143 @@ TEST(cache_delete_coherency) {
   freevector(&read_data);
 }
 
+/* A small write to a big object that is not cached reads and writes only
+ * the blocks it falls in. */
+TEST(cache_small_write_to_big_object) {
+  const char* obj_name = "small_writes";
+  uint obj_size = 64 * BUF_DATA_SIZE;
+  char* obj_data = malloc(obj_size);
+  char new_data[] = "across two blocks";
+  uint offset = 10 * BUF_DATA_SIZE - 4;
+  struct obj_disk_stats before, after;
+
+  use_disk_store(name, 1);
+  ASSERT_NE(0, obj_data);
+  memset(obj_data, 'c', obj_size);
+  ASSERT_NO_ERR(obj_cache_add(TESTED_DEVICE, obj_name, obj_data, obj_size));
+  buf_cache_init();
+
+  uint reads_at_start = mock_disk_reads;
+  obj_device_get_stats(TESTED_DEVICE, &before);
+  ASSERT_NO_ERR(obj_cache_write(TESTED_DEVICE, obj_name, new_data,
+                                sizeof(new_data), offset, obj_size));
+  obj_device_get_stats(TESTED_DEVICE, &after);
+  EXPECT_UINT_EQ(2, after.blocks_written - before.blocks_written);
+  EXPECT_UINT_EQ(2, mock_disk_reads - reads_at_start);
+  memmove(obj_data + offset, new_data, sizeof(new_data));
+
+  // An append grows the object by the bytes it writes.
+  uint bytes = occupied_bytes(dev_private(&mock_device));
+  ASSERT_NO_ERR(obj_cache_write(TESTED_DEVICE, obj_name, new_data,
+                                sizeof(new_data), obj_size, obj_size));
+  EXPECT_UINT_EQ(bytes + sizeof(new_data),
+                 occupied_bytes(dev_private(&mock_device)));
+
+  buf_cache_init();
+  vector read_data = newvector(obj_size + sizeof(new_data), 1);
+  ASSERT_NO_ERR(obj_cache_read(TESTED_DEVICE, obj_name, &read_data,
+                               obj_size + sizeof(new_data), 0,
+                               obj_size + sizeof(new_data)));
+  char* read = malloc(obj_size + sizeof(new_data));
+  memmove_from_vector(read, read_data, 0, obj_size + sizeof(new_data));
+  EXPECT_TRUE(0 == memcmp(read, obj_data, obj_size));
+  EXPECT_TRUE(0 == memcmp(read + obj_size, new_data, sizeof(new_data)));
+
+  freevector(&read_data);
+  free(read);
+  free(obj_data);
+}
+
+/* A missed read brings the padding blocks after it too, a partial write
+ * of a cached block is a hit and of another block a miss, and the blocks
+ * pushed out of the cache are counted. */
+TEST(cache_stats_counts) {
+  const char* obj_name = "cache_stats";
+  uint obj_size = 16 * BUF_DATA_SIZE;
+  char* obj_data = calloc(obj_size, 1);
+  char byte = 'x';
+  char tmp_obj_name[] = "tmp_obj_000";
+  char tmp_obj_data[BUF_DATA_SIZE] = {0};
+  vector read_data = newvector(BUF_DATA_SIZE, 1);
+
+  ASSERT_NE(0, obj_data);
+  ASSERT_NO_ERR(obj_cache_add(TESTED_DEVICE, obj_name, obj_data, obj_size));
+  buf_cache_init();
+
+  ASSERT_NO_ERR(obj_cache_read(TESTED_DEVICE, obj_name, &read_data,
+                               BUF_DATA_SIZE, 4 * BUF_DATA_SIZE, obj_size));
+  EXPECT_UINT_EQ(0, cache_stats().hits);
+  EXPECT_UINT_EQ(1, cache_stats().misses);
+  EXPECT_UINT_EQ(OBJ_CACHE_BLOCKS_PADDING, cache_stats().blocks_prefetched);
+  EXPECT_UINT_EQ((1 + OBJ_CACHE_BLOCKS_PADDING) * BUF_DATA_SIZE,
+                 cache_stats().bytes_read);
+
+  ASSERT_NO_ERR(obj_cache_read(TESTED_DEVICE, obj_name, &read_data,
+                               BUF_DATA_SIZE, 5 * BUF_DATA_SIZE, obj_size));
+  EXPECT_UINT_EQ(1, cache_stats().hits);
+
+  ASSERT_NO_ERR(obj_cache_write(TESTED_DEVICE, obj_name, &byte, 1,
+                                6 * BUF_DATA_SIZE + 1, obj_size));
+  EXPECT_UINT_EQ(2, cache_stats().hits);
+  EXPECT_UINT_EQ(1, cache_stats().misses);
+
+  ASSERT_NO_ERR(obj_cache_write(TESTED_DEVICE, obj_name, &byte, 1,
+                                12 * BUF_DATA_SIZE + 1, obj_size));
+  EXPECT_UINT_EQ(2, cache_stats().hits);
+  EXPECT_UINT_EQ(2, cache_stats().misses);
+  EXPECT_UINT_EQ((2 + OBJ_CACHE_BLOCKS_PADDING) * BUF_DATA_SIZE,
+                 cache_stats().bytes_read);
+
+  /* Push the object out of the cache by inserting other objects */
+  EXPECT_UINT_EQ(0, cache_stats().blocks_evicted);
+  for (uint i = 0; i < NBUF; i++) {
+    sprintf(tmp_obj_name, "tmp_obj_%d", i);
+    ASSERT_NO_ERR(obj_cache_add(TESTED_DEVICE, tmp_obj_name, tmp_obj_data,
+                                sizeof(tmp_obj_data)));
+  }
+  EXPECT_UINT_EQ(2 + OBJ_CACHE_BLOCKS_PADDING,
+                 cache_stats().blocks_evicted);
+
+  freevector(&read_data);
+  free(obj_data);
+}
+
+#define SMALL_WRITE_BENCHMARK_ITERATIONS (20000)
+
+/* Measure the cost of small writes at random offsets of objects of growing
+ * size. Each write touches one or two blocks, whatever the object size. */
+TEST(small_write_benchmark) {
+  const uint object_blocks[] = {4, 16, 64, NBUF};
+  char object_id[OBJECT_ID_LENGTH] = {};
+  char data[16];
+  uint seed = 0x1337;
+  char* obj_data = calloc(NBUF, BUF_DATA_SIZE);
+
+  ASSERT_NE(0, obj_data);
+  memset(data, 'w', sizeof(data));
+  for (uint c = 0; c < ARRAY_LEN(object_blocks); c++) {
+    const uint size = object_blocks[c] * BUF_DATA_SIZE;
+    struct timespec start, end;
+
+    snprintf(object_id, sizeof(object_id), "objid_%u", c);
+    ASSERT_NO_ERR(obj_cache_add(TESTED_DEVICE, object_id, obj_data, size));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint i = 0; i < SMALL_WRITE_BENCHMARK_ITERATIONS; i++) {
+      ASSERT_NO_ERR(obj_cache_write(TESTED_DEVICE, object_id, data,
+                                    sizeof(data),
+                                    rand_r(&seed) % (size - sizeof(data)),
+                                    size));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    PRINT("  %u KB object: %lu ns per write\n", size / 1024,
+          elapsed_ns(&start, &end) / SMALL_WRITE_BENCHMARK_ITERATIONS);
+    ASSERT_NO_ERR(obj_cache_delete(TESTED_DEVICE, object_id, size));
+  }
+  free(obj_data);
+}
+
 INIT_TESTS_PLATFORM();
 
 // Should be called before each test
@@ -659,6 +1419,21 @@ int main() {
   run_test(add_to_full_table);
   run_test(reusing_freed_space);
   run_test(add_when_there_is_no_more_disk_left);
+  run_test(best_fit_allocation);
+  run_test(freed_neighbours_coalesce);
+  run_test(compaction_on_allocation_failure);
+  run_test(compaction_on_demand);
+  run_test(dedup_equal_objects_share_storage);
+  run_test(dedup_rewrite_shared_object);
+  run_test(dedup_compaction);
+  run_test(disk_store_persists_objects);
+  run_test(disk_store_persists_dedup);
+  run_test(disk_store_writes_changed_blocks);
+  run_test(disk_store_compaction);
+  run_test(disk_store_big_object);
+  run_test(object_range_read_and_write);
+  run_test(object_range_growth);
+  run_test(object_range_write_unshares);
 
   // Cache layer
   run_test(add_objects_to_cache);
@@ -666,6 +1441,18 @@ int main() {
   run_test(write_cache_coherency);
   run_test(cache_write_big_object);
   run_test(cache_delete_coherency);
+  run_test(cache_small_write_to_big_object);
+  run_test(cache_stats_counts);
+
+  init_test();
+  run_test_break_msg(lookup_benchmark);
+  end_test();
+  init_test();
+  run_test_break_msg(creation_benchmark);
+  end_test();
+  init_test();
+  run_test_break_msg(small_write_benchmark);
+  end_test();
 
   PRINT_TESTS_RESULT("OBJ_FS_TESTS");
   return CURRENT_TESTS_RESULT();
@@ -0,0 +1,95 @@
+#include "fcntl.h"
+#include "types.h"
+#include "user/lib/user.h"
+#include "wstatus.h"
+
+// Measure how fast concurrent processes fork and reap children, and the
+// page allocations per second that takes, for 1 to BENCH_MAX_PROCS
+// processes. Boot with a different CPUS setting to compare CPU counts.
+
+#define BENCH_MAX_PROCS 8
+#define BENCH_FORKS 200
+#define TICKS_PER_SEC 100
+
+struct kmem_counters {
+  uint allocs;
+  uint refills;
+  uint drains;
+};
+
+static uint counter(char *text, char *name) {
+  char *value = strstr(text, name);
+  return value ? atoi(value + strlen(name)) : 0;
+}
+
+static int get_kmem_counters(struct kmem_counters *c) {
+  char text[128];
+  int fd, n;
+
+  if ((fd = open("/proc/kmem", O_RDONLY)) < 0) return -1;
+  n = read(fd, text, sizeof(text) - 1);
+  close(fd);
+  if (n <= 0) return -1;
+  text[n] = 0;
+  c->allocs = counter(text, "allocs ");
+  c->refills = counter(text, "refills ");
+  c->drains = counter(text, "drains ");
+  return 0;
+}
+
+// Fork and reap BENCH_FORKS children that exit right away.
+static void worker(void) {
+  int i, pid, wstatus;
+
+  for (i = 0; i < BENCH_FORKS; i++) {
+    if ((pid = fork()) < 0) {
+      printf(stderr, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) exit(0);
+    if (wait(&wstatus) != pid) {
+      printf(stderr, "forkbench: wait failed\n");
+      exit(1);
+    }
+  }
+  exit(0);
+}
+
+static int bench(int nprocs) {
+  struct kmem_counters before, after;
+  int i, pid, wstatus, start, ticks, result = 0;
+  int forks = nprocs * BENCH_FORKS;
+
+  if (get_kmem_counters(&before) < 0) return -1;
+  start = uptime();
+  for (i = 0; i < nprocs; i++) {
+    if ((pid = fork()) < 0) return -1;
+    if (pid == 0) worker();
+  }
+  for (i = 0; i < nprocs; i++) {
+    if (wait(&wstatus) < 0 || WEXITSTATUS(wstatus) != 0) result = -1;
+  }
+  ticks = uptime() - start;
+  if (ticks == 0) ticks = 1;
+  if (get_kmem_counters(&after) < 0) return -1;
+
+  printf(stdout,
+         "%d procs: %d forks in %d ticks, %d forks/sec, %d pages/sec, "
+         "%d refills, %d drains\n",
+         nprocs, forks, ticks, forks * TICKS_PER_SEC / ticks,
+         (after.allocs - before.allocs) * TICKS_PER_SEC / ticks,
+         after.refills - before.refills, after.drains - before.drains);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  int nprocs, result = 0;
+
+  for (nprocs = 1; nprocs <= BENCH_MAX_PROCS; nprocs *= 2) {
+    if (bench(nprocs) < 0) {
+      printf(stderr, "forkbench: run with %d procs failed\n", nprocs);
+      result = 1;
+    }
+  }
+  exit(result);
+}
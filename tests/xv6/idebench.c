@@ -0,0 +1,101 @@
+#include "dev_stat.h"
+#include "fcntl.h"
+#include "fsdefs.h"
+#include "types.h"
+#include "user/lib/user.h"
+
+// Compare the CPU time the IDE driver spends per MB moved by PIO and by
+// bus-master DMA. The buffer cache is disabled while measuring so that
+// reads go to the disk.
+
+#define BENCH_DISK DEV_DIR "ide1"
+#define BENCH_FILE "idebench"
+#define BENCH_BLOCKS 256
+
+static char buf[BSIZE];
+
+static int set_fs_cache_state(const char *state) {
+  int fd = open("/proc/cache", O_RDWR);
+  int result = -1;
+
+  if (fd < 0) return -1;
+  if (write(fd, state, 2) == 2) result = 0;
+  close(fd);
+  return result;
+}
+
+// Write and read back BENCH_FILE. Return 0 on success.
+static int move_data(void) {
+  int fd, i;
+
+  unlink(BENCH_FILE);
+  if ((fd = open(BENCH_FILE, O_CREATE | O_RDWR)) < 0) return -1;
+  for (i = 0; i < BENCH_BLOCKS; i++) {
+    memset(buf, i, BSIZE);
+    if (write(fd, buf, BSIZE) != BSIZE) goto fail;
+  }
+  close(fd);
+
+  if ((fd = open(BENCH_FILE, O_RDONLY)) < 0) return -1;
+  for (i = 0; i < BENCH_BLOCKS; i++) {
+    if (read(fd, buf, BSIZE) != BSIZE || buf[0] != (char)i) goto fail;
+  }
+  close(fd);
+  unlink(BENCH_FILE);
+  return 0;
+
+fail:
+  close(fd);
+  unlink(BENCH_FILE);
+  return -1;
+}
+
+static int bench(int disk, int dma) {
+  struct dev_stat before, after;
+  uint bytes, cpu_us;
+  int start, ticks;
+
+  if (ioctl(disk, IOCTL_SET_DEV_DMA, dma) < 0) {
+    printf(stdout, "%s: not available\n", dma ? "dma" : "pio");
+    return 0;
+  }
+
+  start = uptime();
+  if (ioctl(disk, IOCTL_GET_DEV_STAT, &before) < 0 || move_data() < 0 ||
+      ioctl(disk, IOCTL_GET_DEV_STAT, &after) < 0) {
+    printf(stderr, "idebench: %s run failed\n", dma ? "dma" : "pio");
+    return -1;
+  }
+  ticks = uptime() - start;
+
+  bytes = (after.rbytes - before.rbytes) + (after.wbytes - before.wbytes);
+  cpu_us = after.cpu_us - before.cpu_us;
+  if (bytes < 1024) bytes = 1024;
+  printf(stdout, "%s: %d KB in %d ticks, driver cpu %d us, %d us/MB\n",
+         dma ? "dma" : "pio", bytes / 1024, ticks, cpu_us,
+         cpu_us * 1024 / (bytes / 1024));
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct dev_stat stats;
+  int disk, result = 0;
+
+  if ((disk = open(BENCH_DISK, O_RDONLY)) < 0 ||
+      ioctl(disk, IOCTL_GET_DEV_STAT, &stats) < 0) {
+    printf(stderr, "idebench: no stats for " BENCH_DISK "\n");
+    exit(1);
+  }
+  if (set_fs_cache_state("0\n") < 0) {
+    printf(stderr, "idebench: failed to disable the fs cache\n");
+    exit(1);
+  }
+
+  if (bench(disk, 0) < 0 || bench(disk, 1) < 0) result = 1;
+
+  // Restore the mode the disk booted with.
+  ioctl(disk, IOCTL_SET_DEV_DMA, stats.dma);
+  set_fs_cache_state("1\n");
+  close(disk);
+  exit(result);
+}
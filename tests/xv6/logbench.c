@@ -0,0 +1,85 @@
+#include "fcntl.h"
+#include "types.h"
+#include "user/lib/user.h"
+#include "wstatus.h"
+
+// Measure create/unlink throughput of concurrent processes with the log
+// in sync and async commit mode. Each run ends with fsync, so both leave
+// everything on disk.
+
+#define BENCH_PROCS 4
+#define BENCH_FILES 50
+#define TICKS_PER_SEC 100
+
+static int set_log_mode(const char *mode) {
+  int fd = open("/proc/log", O_RDWR);
+  int result = -1;
+
+  if (fd < 0) return -1;
+  if (write(fd, mode, strlen(mode)) == strlen(mode)) result = 0;
+  close(fd);
+  return result;
+}
+
+// Create, write and unlink BENCH_FILES small files.
+static void worker(int id) {
+  char name[] = "logbenchXX";
+  int fd, i;
+
+  name[8] = 'a' + id;
+  for (i = 0; i < BENCH_FILES; i++) {
+    name[9] = 'a' + i % 26;
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0) {
+      printf(stderr, "logbench: create %s failed\n", name);
+      exit(1);
+    }
+    if (write(fd, name, sizeof(name)) != sizeof(name)) {
+      printf(stderr, "logbench: write %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+    if (unlink(name) < 0) {
+      printf(stderr, "logbench: unlink %s failed\n", name);
+      exit(1);
+    }
+  }
+  exit(0);
+}
+
+static int bench(const char *mode) {
+  int i, pid, wstatus, start, ticks, fd, result = 0;
+  int ops = BENCH_PROCS * BENCH_FILES * 2;
+
+  if (set_log_mode(mode) < 0) {
+    printf(stderr, "logbench: failed to set log mode %s", mode);
+    return -1;
+  }
+
+  start = uptime();
+  for (i = 0; i < BENCH_PROCS; i++) {
+    if ((pid = fork()) < 0) {
+      printf(stderr, "logbench: fork failed\n");
+      return -1;
+    }
+    if (pid == 0) worker(i);
+  }
+  for (i = 0; i < BENCH_PROCS; i++) {
+    if (wait(&wstatus) < 0 || WEXITSTATUS(wstatus) != 0) result = -1;
+  }
+  if ((fd = open(".", O_RDONLY)) < 0 || fsync(fd) < 0) result = -1;
+  close(fd);
+  ticks = uptime() - start;
+  if (ticks == 0) ticks = 1;
+
+  printf(stdout, "%d creates+unlinks in %d ticks, %d ops/sec, log %s", ops,
+         ticks, ops * TICKS_PER_SEC / ticks, mode);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  int result = 0;
+
+  if (bench("sync\n") < 0 || bench("async\n") < 0) result = 1;
+  set_log_mode("sync\n");
+  exit(result);
+}
@@ -0,0 +1,73 @@
+#include "fcntl.h"
+#include "types.h"
+#include "user/lib/user.h"
+#include "wstatus.h"
+
+// Measure pipe throughput between two processes at several pipe buffer
+// sizes and write sizes. Size 0 keeps the default buffer.
+
+#define BENCH_BYTES (4 * 1024 * 1024)
+#define TICKS_PER_SEC 100
+
+static char buf[16384];
+
+// Write BENCH_BYTES to fd, chunk bytes at a time.
+static void writer(int fd, int chunk) {
+  int left;
+
+  for (left = BENCH_BYTES; left > 0; left -= chunk) {
+    if (write(fd, buf, chunk) != chunk) {
+      printf(stderr, "pipebench: write failed\n");
+      exit(1);
+    }
+  }
+  exit(0);
+}
+
+static int bench(int pipesize, int chunk) {
+  int fds[2], pid, n, total = 0, wstatus, start, ticks, size;
+
+  if (pipe(fds) < 0) return -1;
+  if (pipesize && ioctl(fds[0], IOCTL_SET_PIPE_SIZE, pipesize) < 0) {
+    printf(stderr, "pipebench: failed to resize the pipe to %d\n", pipesize);
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  size = ioctl(fds[0], IOCTL_GET_PIPE_SIZE);
+
+  start = uptime();
+  if ((pid = fork()) < 0) return -1;
+  if (pid == 0) {
+    close(fds[0]);
+    writer(fds[1], chunk);
+  }
+  close(fds[1]);
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) total += n;
+  close(fds[0]);
+  if (wait(&wstatus) < 0 || WEXITSTATUS(wstatus) != 0 || total != BENCH_BYTES)
+    return -1;
+  ticks = uptime() - start;
+  if (ticks == 0) ticks = 1;
+
+  printf(stdout, "pipe %d, write %d: %d KB in %d ticks, %d KB/sec\n", size,
+         chunk, BENCH_BYTES / 1024, ticks,
+         BENCH_BYTES / 1024 * TICKS_PER_SEC / ticks);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int pipesizes[] = {0, 16384, 65536};
+  int chunks[] = {512, 4096, 16384};
+  int i, j, result = 0;
+
+  for (i = 0; i < sizeof(pipesizes) / sizeof(pipesizes[0]); i++) {
+    for (j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+      if (bench(pipesizes[i], chunks[j]) < 0) {
+        printf(stderr, "pipebench: run failed\n");
+        result = 1;
+      }
+    }
+  }
+  exit(result);
+}
@@ -0,0 +1,100 @@
+#include "fcntl.h"
+#include "fsdefs.h"
+#include "types.h"
+#include "user/lib/user.h"
+
+// Measure read() bandwidth of a file at several read sizes, and how much of
+// the data the kernel copies through kvector pages on the way. read() fills
+// the user buffer directly, so no pages should be allocated and no bytes
+// copied per KB read.
+
+#define BENCH_FILE "readbench"
+#define BENCH_BLOCKS 256
+#define BENCH_ROUNDS 8
+#define TICKS_PER_SEC 100
+
+static char buf[8 * BSIZE];
+
+struct kvector_counters {
+  uint pages;
+  uint copied;
+};
+
+static uint counter(char *text, char *name) {
+  char *value = strstr(text, name);
+  return value ? atoi(value + strlen(name)) : 0;
+}
+
+static int get_kvector_counters(struct kvector_counters *c) {
+  char text[128];
+  int fd, n;
+
+  if ((fd = open("/proc/kvector", O_RDONLY)) < 0) return -1;
+  n = read(fd, text, sizeof(text) - 1);
+  close(fd);
+  if (n <= 0) return -1;
+  text[n] = 0;
+  c->pages = counter(text, "pages ");
+  c->copied = counter(text, "copied ");
+  return 0;
+}
+
+static int create_file(void) {
+  int fd, i;
+
+  if ((fd = open(BENCH_FILE, O_CREATE | O_RDWR)) < 0) return -1;
+  for (i = 0; i < BENCH_BLOCKS; i++) {
+    memset(buf, i, BSIZE);
+    if (write(fd, buf, BSIZE) != BSIZE) {
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+static int bench(int size) {
+  struct kvector_counters before, after;
+  int fd, n, round, start, ticks;
+  uint kb = BENCH_ROUNDS * BENCH_BLOCKS * BSIZE / 1024;
+
+  start = uptime();
+  if (get_kvector_counters(&before) < 0) return -1;
+  for (round = 0; round < BENCH_ROUNDS; round++) {
+    if ((fd = open(BENCH_FILE, O_RDONLY)) < 0) return -1;
+    while ((n = read(fd, buf, size)) > 0) {
+    }
+    close(fd);
+    if (n < 0) return -1;
+  }
+  if (get_kvector_counters(&after) < 0) return -1;
+  ticks = uptime() - start;
+  if (ticks == 0) ticks = 1;
+
+  printf(stdout,
+         "read %d: %d KB in %d ticks, %d KB/sec, kvector pages %d, "
+         "copied %d bytes per KB\n",
+         size, kb, ticks, kb * TICKS_PER_SEC / ticks,
+         after.pages - before.pages, (after.copied - before.copied) / kb);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int sizes[] = {64, BSIZE, sizeof(buf)};
+  int i, result = 0;
+
+  unlink(BENCH_FILE);
+  if (create_file() < 0) {
+    printf(stderr, "readbench: failed to create " BENCH_FILE "\n");
+    exit(1);
+  }
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (bench(sizes[i]) < 0) {
+      printf(stderr, "readbench: read %d failed\n", sizes[i]);
+      result = 1;
+    }
+  }
+  unlink(BENCH_FILE);
+  exit(result);
+}
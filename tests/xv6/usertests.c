@@ -1,3 +1,4 @@
+#include "dev_stat.h"
 #include "fcntl.h"
 #include "fsdefs.h"
 #include "kernel/memlayout.h"
@@ -362,6 +363,165 @@ void pipe1(const char *fs_type) {
   printf(stdout, "%s pipe1 test ok\n", fs_type);
 }
 
+// Resize a pipe holding data and read the data back.
+void pipesizetest(void) {
+  int fds[2], i, n, total, seq = 0;
+
+  printf(stdout, "pipesize test\n");
+
+  if (pipe(fds) != 0) {
+    printf(stdout, "pipe() failed\n");
+    exit(1);
+  }
+  if (ioctl(fds[0], IOCTL_GET_PIPE_SIZE) != 4096) {
+    printf(stdout, "pipesize: default size %d\n",
+           ioctl(fds[0], IOCTL_GET_PIPE_SIZE));
+    exit(1);
+  }
+
+  for (i = 0; i < 3000; i++) buf[i] = seq++;
+  if (write(fds[1], buf, 3000) != 3000) {
+    printf(stdout, "pipesize: write failed\n");
+    exit(1);
+  }
+  if (ioctl(fds[1], IOCTL_SET_PIPE_SIZE, 20000) != 32768 ||
+      ioctl(fds[0], IOCTL_GET_PIPE_SIZE) != 32768) {
+    printf(stdout, "pipesize: grow failed\n");
+    exit(1);
+  }
+  for (i = 0; i < sizeof(buf); i++) buf[i] = seq++;
+  if (write(fds[1], buf, sizeof(buf)) != sizeof(buf)) {
+    printf(stdout, "pipesize: write after grow failed\n");
+    exit(1);
+  }
+  if (ioctl(fds[1], IOCTL_SET_PIPE_SIZE, 4096) != -1 ||
+      ioctl(fds[1], IOCTL_SET_PIPE_SIZE, 1 << 20) != -1) {
+    printf(stdout, "pipesize: bad resize succeeded\n");
+    exit(1);
+  }
+
+  close(fds[1]);
+  seq = 0;
+  total = 0;
+  while ((n = read(fds[0], buf, 1000)) > 0) {
+    for (i = 0; i < n; i++) {
+      if ((buf[i] & 0xff) != (seq++ & 0xff)) {
+        printf(stdout, "pipesize: wrong data at %d\n", total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  if (total != 3000 + sizeof(buf)) {
+    printf(stdout, "pipesize: read %d bytes\n", total);
+    exit(1);
+  }
+
+  // Resize a ring of several pages whose unread data starts inside a page
+  // and crosses into the next one.
+  if (pipe(fds) != 0) {
+    printf(stdout, "pipe() failed\n");
+    exit(1);
+  }
+  seq = 0;
+  for (i = 0; i < 5000; i++) buf[i] = seq++;
+  if (ioctl(fds[1], IOCTL_SET_PIPE_SIZE, 8192) != 8192 ||
+      write(fds[1], buf, 5000) != 5000 || read(fds[0], buf, 100) != 100 ||
+      ioctl(fds[1], IOCTL_SET_PIPE_SIZE, 16384) != 16384) {
+    printf(stdout, "pipesize: resize after a partial read failed\n");
+    exit(1);
+  }
+  close(fds[1]);
+  seq = 100;
+  total = 0;
+  while ((n = read(fds[0], buf, 1000)) > 0) {
+    for (i = 0; i < n; i++) {
+      if ((buf[i] & 0xff) != (seq++ & 0xff)) {
+        printf(stdout, "pipesize: wrong data at %d after resize\n",
+               100 + total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  if (total != 4900) {
+    printf(stdout, "pipesize: read %d bytes after resize\n", total);
+    exit(1);
+  }
+  printf(stdout, "pipesize test ok\n");
+}
+
+// Copy a file to a file and through a pipe with copyfd().
+void copyfdtest(void) {
+  int src, dst, fds[2], i, n, total;
+
+  printf(stdout, "copyfd test\n");
+
+  unlink("copyfd.src");
+  unlink("copyfd.dst");
+  if ((src = open("copyfd.src", O_CREATE | O_RDWR)) < 0) {
+    printf(stdout, "copyfd: create failed\n");
+    exit(1);
+  }
+  for (i = 0; i < sizeof(buf); i++) buf[i] = i % 251;
+  if (write(src, buf, sizeof(buf)) != sizeof(buf) ||
+      write(src, buf, 1000) != 1000) {
+    printf(stdout, "copyfd: write failed\n");
+    exit(1);
+  }
+  close(src);
+
+  // File to file, with a short last copy at the end of the source.
+  src = open("copyfd.src", O_RDONLY);
+  dst = open("copyfd.dst", O_CREATE | O_RDWR);
+  if (copyfd(src, dst, 5000) != 5000 ||
+      copyfd(src, dst, 100000) != sizeof(buf) + 1000 - 5000 ||
+      copyfd(src, dst, 100000) != 0) {
+    printf(stdout, "copyfd: file copy failed\n");
+    exit(1);
+  }
+  if (copyfd(dst, src, 1) != -1) {
+    printf(stdout, "copyfd: copy into a read-only fd succeeded\n");
+    exit(1);
+  }
+  close(src);
+  close(dst);
+
+  // File to pipe.
+  if (pipe(fds) != 0) {
+    printf(stdout, "pipe() failed\n");
+    exit(1);
+  }
+  src = open("copyfd.dst", O_RDONLY);
+  if (copyfd(src, fds[1], 3000) != 3000) {
+    printf(stdout, "copyfd: copy into a pipe failed\n");
+    exit(1);
+  }
+  close(fds[1]);
+  close(src);
+  total = 0;
+  while ((n = read(fds[0], buf, 1000)) > 0) {
+    for (i = 0; i < n; i++) {
+      if ((buf[i] & 0xff) != (total + i) % 251) {
+        printf(stdout, "copyfd: wrong data at %d\n", total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  if (total != 3000) {
+    printf(stdout, "copyfd: read %d bytes from the pipe\n", total);
+    exit(1);
+  }
+
+  unlink("copyfd.src");
+  unlink("copyfd.dst");
+  printf(stdout, "copyfd test ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void preempt(void) {
   int pid1, pid2, pid3;
@@ -1928,6 +2088,132 @@ void objfs_all_tests(void) {
   printf(stdout, "objfs all tests ok\n");
 }
 
+// Mount the object store of the root disk twice, the second time after it
+// was unmounted, and find what the first mount wrote.
+void objfs_disk_test(void) {
+  char data[] = "kept on the disk";
+  char read_data[sizeof(data)];
+  int fd;
+
+  printf(stdout, "objfs disk test\n");
+
+  if (mkdir("objfs_disk") < 0) {
+    printf(stdout, "mkdir objfs_disk failed\n");
+    exit(1);
+  }
+  if (mount(DEV_DIR "ide1", "objfs_disk", "objfs") != 0) {
+    printf(stdout, "failed to mount the disk objfs\n");
+    exit(1);
+  }
+  if ((fd = open("objfs_disk/kept", O_CREATE | O_RDWR)) < 0 ||
+      write(fd, data, sizeof(data)) != sizeof(data)) {
+    printf(stdout, "write to the disk objfs failed\n");
+    exit(1);
+  }
+  close(fd);
+  if (umount("objfs_disk") < 0 ||
+      mount(DEV_DIR "ide1", "objfs_disk", "objfs") != 0) {
+    printf(stdout, "remount of the disk objfs failed\n");
+    exit(1);
+  }
+  if ((fd = open("objfs_disk/kept", O_RDONLY)) < 0 ||
+      read(fd, read_data, sizeof(read_data)) != sizeof(read_data) ||
+      strcmp(data, read_data) != 0) {
+    printf(stdout, "disk objfs lost its file\n");
+    exit(1);
+  }
+  close(fd);
+  if (unlink("objfs_disk/kept") < 0 || umount("objfs_disk") < 0 ||
+      unlink("objfs_disk") < 0) {
+    printf(stdout, "disk objfs cleanup failed\n");
+    exit(1);
+  }
+  printf(stdout, "objfs disk test ok\n");
+}
+
+// Fill an objfs directory past its first index table, unlink every other
+// entry and link new names, which must reuse the freed entries.
+void objfs_dir_test(void) {
+  char name[] = "fXX";
+  struct stat st;
+  int fd, i, size;
+
+  printf(stdout, "objfs dir test\n");
+
+  if (mkdir("objfs_dir") < 0 || mount(0, "objfs_dir", "objfs") != 0 ||
+      chdir("objfs_dir") < 0) {
+    printf(stdout, "failed to mount objfs to objfs_dir\n");
+    exit(1);
+  }
+  for (i = 0; i < 100; i++) {
+    name[1] = 'a' + i / 10;
+    name[2] = '0' + i % 10;
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0) {
+      printf(stdout, "objfs dir create %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  for (i = 0; i < 100; i += 2) {
+    name[1] = 'a' + i / 10;
+    name[2] = '0' + i % 10;
+    if (unlink(name) < 0) {
+      printf(stdout, "objfs dir unlink %s failed\n", name);
+      exit(1);
+    }
+  }
+  if ((fd = open(".", O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+    printf(stdout, "objfs dir stat failed\n");
+    exit(1);
+  }
+  close(fd);
+  size = st.size;
+
+  name[0] = 'g';
+  for (i = 0; i < 100; i += 2) {
+    name[1] = 'a' + i / 10;
+    name[2] = '0' + i % 10;
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0) {
+      printf(stdout, "objfs dir create %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  if ((fd = open(".", O_RDONLY)) < 0 || fstat(fd, &st) < 0 ||
+      st.size != size) {
+    printf(stdout, "objfs dir did not reuse free entries\n");
+    exit(1);
+  }
+  close(fd);
+
+  for (i = 0; i < 100; i++) {
+    name[0] = i % 2 ? 'f' : 'g';
+    name[1] = 'a' + i / 10;
+    name[2] = '0' + i % 10;
+    if ((fd = open(name, O_RDONLY)) < 0) {
+      printf(stdout, "objfs dir lost %s\n", name);
+      exit(1);
+    }
+    close(fd);
+    name[0] = i % 2 ? 'g' : 'f';
+    if (open(name, O_RDONLY) >= 0) {
+      printf(stdout, "objfs dir found unlinked %s\n", name);
+      exit(1);
+    }
+    name[0] = i % 2 ? 'f' : 'g';
+    if (unlink(name) < 0) {
+      printf(stdout, "objfs dir unlink %s failed\n", name);
+      exit(1);
+    }
+  }
+
+  if (chdir("..") < 0 || umount("objfs_dir") < 0 || unlink("objfs_dir") < 0) {
+    printf(stdout, "objfs dir cleanup failed\n");
+    exit(1);
+  }
+  printf(stdout, "objfs dir test ok\n");
+}
+
 void set_fs_cache_state(int enable) {
   int fd = -1;
   char *state;
@@ -1955,6 +2241,31 @@ void set_fs_cache_state(int enable) {
   close(fd);
 }
 
+void set_fs_cache_policy(char *policy) {
+  char expected[16] = "policy ";
+  char proc_cache[512] = {0};
+  int fd = -1;
+
+  fd = open("/proc/cache", O_RDWR);
+  if (-1 == fd) {
+    printf(stdout, "failed to open /proc/cache\n");
+    exit(1);
+  }
+
+  if (strlen(policy) != write(fd, policy, strlen(policy))) {
+    printf(stdout, "failed to write cache policy %s", policy);
+    exit(1);
+  }
+  read(fd, proc_cache, sizeof(proc_cache) - 1);
+  strcpy(expected + strlen(expected), policy);
+  if (0 == strstr(proc_cache, expected)) {
+    printf(stdout, "failed to set cache policy %s", policy);
+    exit(1);
+  }
+
+  close(fd);
+}
+
 void fill_cache() {
   char buffer[1024];
 
@@ -2146,6 +2457,349 @@ void nativefs_performance_test() {
   printf(stdout, "end of objfs_performance_test\n");
 }
 
+// Writing a file shows up in the statistics of the IDE disk.
+void idestattest(void) {
+  struct dev_stat before, after;
+  uint queued = 0, completed = 0;
+  int fd, i;
+
+  printf(stdout, "ide stat test\n");
+
+  fd = open(DEV_DIR "ide1", O_RDONLY);
+  if (fd < 0 || ioctl(fd, IOCTL_GET_DEV_STAT, &before) < 0) {
+    printf(stdout, "ide stat test: no stats for " DEV_DIR "ide1\n");
+    exit(1);
+  }
+
+  unlink("idestat");
+  int file = open("idestat", O_CREATE | O_RDWR);
+  if (file < 0) {
+    printf(stdout, "ide stat test: create failed\n");
+    exit(1);
+  }
+  for (i = 0; i < 8; i++) {
+    memset(buf, i, BSIZE);
+    if (write(file, buf, BSIZE) != BSIZE) {
+      printf(stdout, "ide stat test: write failed\n");
+      exit(1);
+    }
+  }
+  close(file);
+  unlink("idestat");
+
+  if (ioctl(fd, IOCTL_GET_DEV_STAT, &after) < 0) {
+    printf(stdout, "ide stat test: ioctl failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  for (i = 0; i < DEV_STAT_BUCKETS; i++) {
+    queued += after.queue_depth[i] - before.queue_depth[i];
+    completed += after.latency[i] - before.latency[i];
+  }
+  if (after.wios <= before.wios || after.wbytes <= before.wbytes ||
+      queued == 0 || completed == 0) {
+    printf(stdout, "ide stat test: writes not counted\n");
+    exit(1);
+  }
+
+  printf(stdout, "ide stat test ok\n");
+}
+
+// One write() much larger than a log transaction is split across
+// transactions.
+void logsplittest(void) {
+  int fd, i, n = 64 * BSIZE;
+  char *big, logstat[16];
+
+  printf(stdout, "log split test\n");
+
+  big = malloc(n);
+  for (i = 0; i < n; i++) big[i] = i % 251;
+
+  unlink("logsplit");
+  fd = open("logsplit", O_CREATE | O_RDWR);
+  if (fd < 0 || write(fd, big, n) != n) {
+    printf(stdout, "log split test: write failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  memset(big, 0, n);
+  fd = open("logsplit", O_RDONLY);
+  if (fd < 0 || read(fd, big, n) != n) {
+    printf(stdout, "log split test: read failed\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("logsplit");
+  for (i = 0; i < n; i++) {
+    if (big[i] != (char)(i % 251)) {
+      printf(stdout, "log split test: wrong data at %d\n", i);
+      exit(1);
+    }
+  }
+  free(big);
+
+  fd = open("/proc/log", O_RDONLY);
+  if (fd < 0 || read(fd, logstat, sizeof(logstat)) <= 0 ||
+      strncmp(logstat, "commit ", 7) != 0) {
+    printf(stdout, "log split test: bad /proc/log\n");
+    exit(1);
+  }
+  close(fd);
+
+  printf(stdout, "log split test ok\n");
+}
+
+#define LOGREAD_READERS 4
+#define LOGREAD_BLOCKS 64
+#define LOGREAD_ROUNDS 8
+
+// Fill the log with committed blocks in async commit mode while other
+// processes read a file through the rest of the buffer cache. Build
+// fs.img with log_blocks=MAXLOGSIZE+1 to run it with the largest log.
+void logreadtest(void) {
+  char buf[BSIZE];
+  int i, j, k, fd, logfd, pid, wstatus;
+
+  printf(stdout, "log read test
+");
+
+  unlink("logread");
+  fd = open("logread", O_CREATE | O_RDWR);
+  for (i = 0; i < LOGREAD_BLOCKS; i++) {
+    memset(buf, i, BSIZE);
+    if (fd < 0 || write(fd, buf, BSIZE) != BSIZE) {
+      printf(stdout, "log read test: create failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  logfd = open("/proc/log", O_RDWR);
+  if (logfd < 0 || write(logfd, "async\n", 6) != 6) {
+    printf(stdout, "log read test: failed to set async commit\n");
+    exit(1);
+  }
+
+  for (i = 0; i < LOGREAD_READERS; i++) {
+    if ((pid = fork()) < 0) {
+      printf(stdout, "log read test: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      for (j = 0; j < LOGREAD_ROUNDS; j++) {
+        if ((fd = open("logread", O_RDONLY)) < 0) exit(1);
+        for (k = 0; k < LOGREAD_BLOCKS; k++) {
+          if (read(fd, buf, BSIZE) != BSIZE || buf[0] != (char)k ||
+              buf[BSIZE - 1] != (char)k)
+            exit(1);
+        }
+        close(fd);
+      }
+      exit(0);
+    }
+  }
+
+  unlink("logwrite");
+  for (j = 0; j < LOGREAD_ROUNDS; j++) {
+    fd = open("logwrite", O_CREATE | O_RDWR);
+    for (k = 0; k < LOGREAD_BLOCKS; k++) {
+      memset(buf, j + k, BSIZE);
+      if (fd < 0 || write(fd, buf, BSIZE) != BSIZE) {
+        printf(stdout, "log read test: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  unlink("logwrite");
+
+  for (i = 0; i < LOGREAD_READERS; i++) {
+    if (wait(&wstatus) < 0 || WEXITSTATUS(wstatus) != 0) {
+      printf(stdout, "log read test: a reader failed\n");
+      exit(1);
+    }
+  }
+  unlink("logread");
+
+  if (write(logfd, "sync\n", 5) != 5) {
+    printf(stdout, "log read test: failed to set sync commit\n");
+    exit(1);
+  }
+  close(logfd);
+
+  printf(stdout, "log read test ok\n");
+}
+
+// Write a file in async commit mode and make it durable with fsync.
+void fsynctest(void) {
+  int fd, logfd;
+
+  printf(stdout, "fsync test\n");
+
+  logfd = open("/proc/log", O_RDWR);
+  if (logfd < 0 || write(logfd, "async\n", 6) != 6) {
+    printf(stdout, "fsync test: failed to set async commit\n");
+    exit(1);
+  }
+
+  unlink("fsyncfile");
+  fd = open("fsyncfile", O_CREATE | O_RDWR);
+  if (fd < 0 || write(fd, "aaa", 3) != 3) {
+    printf(stdout, "fsync test: write failed\n");
+    exit(1);
+  }
+  if (fsync(fd) != 0 || fsync(-1) != -1) {
+    printf(stdout, "fsync test: fsync failed\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("fsyncfile");
+
+  if (write(logfd, "sync\n", 5) != 5) {
+    printf(stdout, "fsync test: failed to set sync commit\n");
+    exit(1);
+  }
+  close(logfd);
+
+  printf(stdout, "fsync test ok\n");
+}
+
+// Look up names before and after the changes that must invalidate cached
+// lookups: creating and unlinking a file, and mounting over a directory.
+void dcachetest(void) {
+  int fd;
+
+  printf(stdout, "dcache test\n");
+
+  unlink("dcfile");
+  if (open("dcfile", O_RDONLY) >= 0) {
+    printf(stdout, "dcache test: found dcfile before creating it\n");
+    exit(1);
+  }
+  if ((fd = open("dcfile", O_CREATE | O_RDWR)) < 0) {
+    printf(stdout, "dcache test: create dcfile failed\n");
+    exit(1);
+  }
+  close(fd);
+  if ((fd = open("dcfile", O_RDONLY)) < 0) {
+    printf(stdout, "dcache test: dcfile not found after creating it\n");
+    exit(1);
+  }
+  close(fd);
+  if (link("dcfile", "dclink") < 0 || (fd = open("dclink", O_RDONLY)) < 0) {
+    printf(stdout, "dcache test: dclink not found after linking it\n");
+    exit(1);
+  }
+  close(fd);
+  if (unlink("dcfile") < 0 || unlink("dclink") < 0 ||
+      open("dcfile", O_RDONLY) >= 0 || open("dclink", O_RDONLY) >= 0) {
+    printf(stdout, "dcache test: found a file after unlinking it\n");
+    exit(1);
+  }
+
+  if (mkdir("dcdir") < 0 || (fd = open("dcdir/under", O_CREATE)) < 0) {
+    printf(stdout, "dcache test: create dcdir/under failed\n");
+    exit(1);
+  }
+  close(fd);
+  if (mount(0, "dcdir", "objfs") != 0) {
+    printf(stdout, "dcache test: mount on dcdir failed\n");
+    exit(1);
+  }
+  if (open("dcdir/under", O_RDONLY) >= 0) {
+    printf(stdout, "dcache test: found dcdir/under through the mount\n");
+    exit(1);
+  }
+  if (umount("dcdir") < 0 || (fd = open("dcdir/under", O_RDONLY)) < 0) {
+    printf(stdout, "dcache test: dcdir/under not found after umount\n");
+    exit(1);
+  }
+  close(fd);
+  if (unlink("dcdir/under") < 0 || unlink("dcdir") < 0 ||
+      open("dcdir", O_RDONLY) >= 0) {
+    printf(stdout, "dcache test: dcdir cleanup failed\n");
+    exit(1);
+  }
+  printf(stdout, "dcache test ok\n");
+}
+
+#define MANYINODES_PROCS 12
+#define MANYINODES_FILES 11
+
+// Hold more inodes open at once than NINODE, so that the inode cache has to
+// grow.
+void manyinodestest(void) {
+  char name[] = "iXX";
+  int ready[2], go[2];
+  int i, j, fd, pid, wstatus;
+  char c;
+
+  printf(stdout, "many inodes test\n");
+
+  if (pipe(ready) < 0 || pipe(go) < 0) {
+    printf(stdout, "many inodes test: pipe failed\n");
+    exit(1);
+  }
+  for (i = 0; i < MANYINODES_PROCS; i++) {
+    if ((pid = fork()) < 0) {
+      printf(stdout, "many inodes test: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      close(ready[0]);
+      close(go[1]);
+      name[1] = 'a' + i;
+      for (j = 0; j < MANYINODES_FILES; j++) {
+        name[2] = 'a' + j;
+        if (open(name, O_CREATE | O_RDWR) < 0) {
+          printf(stdout, "many inodes test: create %s failed\n", name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  for (i = 0; i < MANYINODES_PROCS; i++) {
+    if (read(ready[0], &c, 1) != 1) {
+      printf(stdout, "many inodes test: a child failed\n");
+      exit(1);
+    }
+  }
+  close(go[1]);
+  close(ready[0]);
+  for (i = 0; i < MANYINODES_PROCS; i++) {
+    if (wait(&wstatus) < 0 || WEXITSTATUS(wstatus) != 0) {
+      printf(stdout, "many inodes test: a child failed\n");
+      exit(1);
+    }
+  }
+
+  for (i = 0; i < MANYINODES_PROCS; i++) {
+    name[1] = 'a' + i;
+    for (j = 0; j < MANYINODES_FILES; j++) {
+      name[2] = 'a' + j;
+      if (unlink(name) < 0) {
+        printf(stdout, "many inodes test: unlink %s failed\n", name);
+        exit(1);
+      }
+    }
+  }
+
+  if ((fd = open("/proc/icache", O_RDONLY)) < 0) {
+    printf(stdout, "many inodes test: no /proc/icache\n");
+    exit(1);
+  }
+  close(fd);
+  printf(stdout, "many inodes test ok\n");
+}
+
 void fs_tests(void) {
   // Run all tests with cache enabled.
   printf(stdout, "--- All fs tests with cache enabled ---\n");
@@ -2161,6 +2815,8 @@ void fs_tests(void) {
   set_fs_cache_state(1);
   nativefs_all_tests();
   objfs_all_tests();
+  objfs_disk_test();
+  objfs_dir_test();
   chdir("..");
   rm_recursive("cachce_enabled_tests");
 
@@ -2185,6 +2841,11 @@ void fs_tests(void) {
   // Performance tests
   objfs_performance_test();
   nativefs_performance_test();
+
+  // Performance test with the adaptive replacement policy
+  set_fs_cache_policy("arc\n");
+  nativefs_performance_test();
+  set_fs_cache_policy("lru\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -2201,6 +2862,14 @@ int main(int argc, char *argv[]) {
   argptest();
 
   fs_tests();
+  idestattest();
+  fsynctest();
+  manyinodestest();
+  dcachetest();
+  pipesizetest();
+  copyfdtest();
+  logsplittest();
+  logreadtest();
 
   bigargtest();
   bigargtest();
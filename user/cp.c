@@ -27,9 +27,11 @@ static int join_paths(char** dest, const char* lhs, const char* rhs) {
   return 0;
 }
 
+// Bytes to ask copyfd() for at a time.
+#define COPY_CHUNK (64 * 1024)
+
 static int copy_file(int fd, const char* target) {
   int fdt, n;
-  char buf[512];
 
   if ((fdt = open(target, O_CREATE | O_WRONLY)) < 0) {
     printf(stderr, "can't create %s, make sure the entire path exists\n",
@@ -37,11 +39,12 @@ static int copy_file(int fd, const char* target) {
     return -1;
   }
 
-  while ((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(fdt, buf, n) != n) {
-      printf(stderr, "cp: write error\n");
-      return -1;
-    }
+  while ((n = copyfd(fd, fdt, COPY_CHUNK)) > 0) {
+  }
+  close(fdt);
+  if (n < 0) {
+    printf(stderr, "cp: copy error\n");
+    return -1;
   }
 
   return 0;
@@ -60,6 +60,8 @@ int main(void) {
   mknod(DEV_DIR "tty0", 1, 1);
   mknod(DEV_DIR "tty1", 1, 2);
   mknod(DEV_DIR "tty2", 1, 3);
+  mknod(DEV_DIR "ide0", 2, 0);
+  mknod(DEV_DIR "ide1", 2, 1);
 
   if (init_image_dir() != 0) {
     printf(stdout, "init: init image_dir failed\n");
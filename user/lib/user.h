@@ -28,6 +28,8 @@ int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
 int fstat(int fd, struct stat*);
+int fsync(int fd);
+int copyfd(int in, int out, int n);
 int link(char*, char*);
 int mkdir(const char*);
 int chdir(char*);